@@ -17,7 +17,9 @@
 #pragma once
 
 #include <string>
-#include <vector>
+#include <memory>
+
+#include "../../system/file/FileBuffer.h"
 
 
 struct AudioSystemLoadFileEvent
@@ -25,11 +27,12 @@ struct AudioSystemLoadFileEvent
     enum Type
     {
         LOAD_AND_PAUSE,
-        LOAD_AND_PLAY
+        LOAD_AND_PLAY,
+        LOAD_AND_QUEUE
     };
 
     Type type;
     std::string path;
-    std::vector<uint8_t> buffer;
+    std::shared_ptr<const FileBuffer> buffer;
     int startTrack;
 };
@@ -24,6 +24,7 @@ struct AudioSystemPlayEvent
     enum Type
     {
         PLAYING,
+        PLAYING_QUEUED_FILE,
         PAUSED,
         STOPPED,
         STOPPED_BY_USER,
@@ -25,8 +25,12 @@ struct AudioSystemPlayTaskEvent
         PAUSE,
         PREV_SUBSONG,
         NEXT_SUBSONG,
-        STOP
+        STOP,
+        CLEAR_QUEUE,
+        SEEK
     };
 
     Type type;
+    // Milliseconds, SEEK only
+    int position;
 };
@@ -17,18 +17,17 @@
 #pragma once
 
 #include <string>
-#include <vector>
+#include <memory>
+
+#include "../../system/file/DirectoryListing.h"
 
 
 struct DirectoryLoadedEvent
 {
-    struct Item
-    {
-        bool isFolder;
-        std::string name;
-        uintmax_t size;
-    };
-
     std::string path;
-    std::vector<Item> items;
+    // Sorted by name, a big directory is sent in several batches to be appended to the first one.
+    // The sender forget the listing once it is sent, the receiver can keep it.
+    std::shared_ptr<DirectoryListing> listing;
+    bool isFirstBatch;
+    bool isLastBatch;
 };
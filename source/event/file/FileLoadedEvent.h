@@ -17,11 +17,13 @@
 #pragma once
 
 #include <string>
-#include <vector>
+#include <memory>
+
+#include "../../system/file/FileBuffer.h"
 
 
 struct FileLoadedEvent
 {
     std::string path;
-    std::vector<uint8_t> buffer;
+    std::shared_ptr<const FileBuffer> buffer;
 };
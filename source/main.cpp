@@ -48,6 +48,13 @@ int main(int argc, char *argv[])
     }
 
     TRACE("SWITCH started romfs module.");
+
+    if (R_FAILED(socketInitializeDefault()))
+    {
+        throw std::runtime_error("socketInitializeDefault failed");
+    }
+
+    TRACE("SWITCH started socket module.");
 #endif
 
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER) < 0)
@@ -218,6 +225,9 @@ int main(int argc, char *argv[])
     SDL_Quit();
 
 #if defined(__SWITCH__)
+    socketExit();
+    TRACE("SWITCH stopped socket module.");
+
     if (R_FAILED(romfsExit()))
     {
         throw std::runtime_error("romfsExit failed");
@@ -26,78 +26,130 @@
 #include "audio/GmePlugin.h"
 #include "audio/SidplayfpPlugin.h"
 #include "audio/Sc68Plugin.h"
+#include "audio/SampleConverter.h"
 
 #include "../event/audio/AudioSystemConfiguredEvent.h"
 #include "../tools/LanguageFile.h"
 #include "../config.h"
 
+#define DECODE_BLOCK_FRAMES 4096        // Number of frames rendered at once by the decode thread
+#define DECODE_THREAD_IDLE_MS 10        // Max time the decode thread sleep when there is nothing to do
+#define DEFAULT_RENDER_AHEAD_MS 250     // Default amount of sound decoded ahead of the audio callback
+#define MAX_RENDER_AHEAD_MS 1000        // Max amount of sound decoded ahead of the audio callback in adaptive mode
+#define DEFAULT_BUFFER_SAMPLES 2048     // Default size of the device buffer in frames
+#define LOW_LATENCY_BUFFER_SAMPLES 256  // Size of the device buffer in low latency mode
+#define ADAPTIVE_PERIOD_SECONDS 2.0f    // Period of the render ahead adjustment in adaptive mode
+#define ADAPTIVE_TARGET_MISS_RATE 0.001 // Rate of underruns and deadline misses per callback the adaptive mode tolerate
+#define DEFAULT_CROSSFADE_MS 0          // Default crossfade duration between two songs, 0 to disable
+#define RESAMPLE_BUFFER_FRAMES 8192     // Max number of frames decoded at the plugin rate at once
+#define CHANNELS 2                      // Everything is stereo
+#define COMMAND_QUEUE_SIZE 64           // Max number of commands waiting for the decode thread
+#define NOTIFICATION_QUEUE_SIZE 256     // Max number of notifications waiting for the main thread
+#define DECODER_WAIT_MS 1000            // Max time to wait for the decode thread to release a decoder
+#define POSITION_EVENT_MS 100           // Min position change before telling everyone about it
+#define DEFAULT_PCM_CACHE_MB 32         // Default size of the cache of rendered sound, 0 to disable
+#define LOAD_DEBOUNCE_SECONDS 0.15f     // Quiet time after a burst of files to play before the last one is opened
+
+
 AudioSystem::AudioSystem(Config config) :
 ECS::EntitySystem(),
 mConfig(config),
-mMutex(SDL_CreateMutex()),
+mDecodeSemaphore(SDL_CreateSemaphore(0)),
+mDecodeThread(nullptr),
 mCurrentPlugin(nullptr),
-mPlayStatus(NO_FILE)
+mPlayStatus(NO_FILE),
+mDecodeThreadRunning(false),
+mRenderAheadSize(0),
+mSampleRate(0),
+mDeviceFormat(AUDIO_F32SYS),
+mDeviceFrameSize(0),
+mFlushRequested(0),
+mFlushCompleted(0),
+mDecodedPosition(0),
+mDecodedPositionOffset(0),
+mDuration(0),
+mCallbackCount(0),
+mUnderrunCount(0),
+mDeadlineMissCount(0),
+mStreamEnded(true),
+mCallbackClockReset(true),
+mLastCallbackTime(0),
+mCallbackPeriod(0),
+mPerformanceFrequency(SDL_GetPerformanceFrequency()),
+mMaxRenderAheadFrames(0),
+mBufferSamples(0),
+mAdaptiveBuffering(false),
+mAdaptiveElapsed(0),
+mAdaptiveCallbacks(0),
+mAdaptiveMisses(0),
+mDecodeStatus(IDLE),
+mDecodeGeneration(0),
+mActiveDecoder(-1),
+mQueuedDecoder(-1),
+mQueuedCrossfadeFrames(0),
+mFadingDecoder(-1),
+mCurrentDecoder(-1),
+mGeneration(0),
+mPendingTrack(-1),
+mCurrentTrack(0),
+mTrackCount(0),
+mLastPositionSent(-1),
+mLastDurationSent(-1),
+mLoadQuietTime(LOAD_DEBOUNCE_SECONDS)
 {
 }
 
 AudioSystem::~AudioSystem()
 {
-    SDL_DestroyMutex(mMutex);
+    SDL_DestroySemaphore(mDecodeSemaphore);
 }
 
 void AudioSystem::configure(ECS::World* world)
 {
     TRACE(">>>");
 
-    // All plugin are setup in a way that they are outputting 48000Hz 16bits PCM stereo samples
-    SDL_AudioSpec obtainedAudioSpec;
-    SDL_AudioSpec wantedAudioSpec;
-    wantedAudioSpec.callback = AudioSystem::audioCallback;
-    wantedAudioSpec.userdata = this;
-    wantedAudioSpec.samples = 2048; // 2048 for better latency
-    wantedAudioSpec.channels = 2;
-    wantedAudioSpec.format = AUDIO_S16SYS;
-    wantedAudioSpec.freq = 48000;
+    // Plugins output float stereo samples at their own rate, they are resampled to the device rate when needed
+    auto lowLatency = mConfig.get("low_latency", false);
+    openAudioDevice(lowLatency ? LOW_LATENCY_BUFFER_SAMPLES : mConfig.get("audio_buffer_samples", DEFAULT_BUFFER_SAMPLES), false);
 
-    // Check if the audio device can handle the requested format (open device allowing format change then close it)
-    mAudioDevice = SDL_OpenAudioDevice(nullptr, 0, &wantedAudioSpec, &obtainedAudioSpec, SDL_AUDIO_ALLOW_ANY_CHANGE);
-    if (mAudioDevice <= 0)
-    {
-        throw std::runtime_error(SDL_GetError());
-    }
+    // The decode thread render big blocks of sound ahead of the audio callback into the ring buffer.
+    // The ring buffer is allocated for the biggest margin the adaptive mode can ask for.
+    auto renderAheadMs = lowLatency ? 0 : std::max(mConfig.get("render_ahead_ms", DEFAULT_RENDER_AHEAD_MS), 0);
+    mAdaptiveBuffering = lowLatency || mConfig.get("adaptive_buffering", true);
+    mMaxRenderAheadFrames = (size_t) mSampleRate * std::max(renderAheadMs, MAX_RENDER_AHEAD_MS) / 1000;
+    mRenderAheadSize = getRenderAheadSize((size_t) mSampleRate * renderAheadMs / 1000);
+    mDecodeBuffer.resize(DECODE_BLOCK_FRAMES * CHANNELS);
+    mFadeBuffer.resize(DECODE_BLOCK_FRAMES * CHANNELS);
+    mResampleBuffer.resize(RESAMPLE_BUFFER_FRAMES * CHANNELS);
+    mOutputBuffer.resize(DECODE_BLOCK_FRAMES * mDeviceFrameSize);
+    mRingBuffer.resize(mMaxRenderAheadFrames * mDeviceFrameSize + mOutputBuffer.size());
+    mCommands.resize(COMMAND_QUEUE_SIZE);
+    mNotifications.resize(NOTIFICATION_QUEUE_SIZE);
+    mMixer.setup(STREAM_COUNT, DECODE_BLOCK_FRAMES);
+    mMixer.setGain(FADING_STREAM, 0.0f);
+    mPcmCache.setup((size_t) std::max(mConfig.get("pcm_cache_mb", DEFAULT_PCM_CACHE_MB), 0) * 1024 * 1024);
 
-    // Reopen the device but force our format to be used (SDL will ressample)
-    SDL_CloseAudioDevice(mAudioDevice);
-    if (wantedAudioSpec.channels != obtainedAudioSpec.channels
-        || wantedAudioSpec.freq != obtainedAudioSpec.freq
-        || wantedAudioSpec.format != obtainedAudioSpec.format)
-    {
-        TRACE("SDL will ressample sound data from {:d} channels {:d}Hz (0x{:X}) to {:d} channels {:d}Hz (0x{:X})",
-            wantedAudioSpec.channels, wantedAudioSpec.freq, wantedAudioSpec.format,
-            obtainedAudioSpec.channels, obtainedAudioSpec.freq, obtainedAudioSpec.format);
-    }
+    TRACE("Render ahead: {:d} bytes{:s}, ring buffer size: {:d}", mRenderAheadSize.load(), mAdaptiveBuffering ? " (adaptive)" : "", mRingBuffer.getCapacity());
 
-    // Reopen the device but force using our format this time
-    mAudioDevice = SDL_OpenAudioDevice(nullptr, 0, &wantedAudioSpec, &obtainedAudioSpec, 0);
-    if (mAudioDevice <= 0)
+    // Dope, each decoder get its own instances
+    for (auto& decoder : mDecoders)
     {
-        throw std::runtime_error(SDL_GetError());
+        decoder.plugins = createPlugins();
+        decoder.plugin = nullptr;
+        decoder.inUse = false;
+        for (auto* plugin : decoder.plugins)
+        {
+            plugin->setup(mConfig, mSampleRate);
+        }
     }
 
-    TRACE("Current driver: {:s} {:d} channels {:d}Hz (0x{:X}), buffer size: {:d}",
-        SDL_GetCurrentAudioDriver(), obtainedAudioSpec.channels, obtainedAudioSpec.freq, obtainedAudioSpec.format, obtainedAudioSpec.samples);
-
-    // Dope
-    mPlugins.push_back(new OpenmptPlugin());
-    mPlugins.push_back(new GmePlugin());
-    mPlugins.push_back(new SidplayfpPlugin());
-    mPlugins.push_back(new Sc68Plugin());
-
-    // Setup each plugin and create data for other systems
+    // Create data for other systems. Settings are shared by all instances of a plugin (same config group),
+    // but stats and metadata have to come from the decoder currently heard. The decode thread may be rendering
+    // with that plugin, drawing only use what the plugin published and the position given by sendPosition().
     auto pluginInformations = std::vector<AudioSystemConfiguredEvent::PluginInformation>();
-    for (auto* plugin : mPlugins)
+    for (size_t i=0; i<mDecoders[0].plugins.size(); ++i)
     {
-        plugin->setup(mConfig);
+        auto* plugin = mDecoders[0].plugins[i];
         auto name = plugin->getName();
         auto version = plugin->getVersion();
         auto extensions = plugin->getSupportedExtensions();
@@ -113,181 +165,1175 @@ void AudioSystem::configure(ECS::World* world)
                     plugin->drawSettings(world, languageFile, deltaTime);
                 },
             .drawPlayerStats =
-                [plugin](ECS::World* world, LanguageFile languageFile, float deltaTime)
+                [this, i](ECS::World* world, LanguageFile languageFile, float deltaTime)
                 {
-                    plugin->drawPlayerStats(world, languageFile, deltaTime);
+                    if (mCurrentDecoder != -1)
+                    {
+                        mDecoders[mCurrentDecoder].plugins[i]->drawPlayerStats(world, languageFile, deltaTime);
+                    }
                 },
             .drawMetadata =
-                [plugin](ECS::World* world, LanguageFile languageFile, float deltaTime)
+                [this, i](ECS::World* world, LanguageFile languageFile, float deltaTime)
                 {
-                    plugin->drawMetadata(world, languageFile, deltaTime);
+                    if (mCurrentDecoder != -1)
+                    {
+                        mDecoders[mCurrentDecoder].plugins[i]->drawMetadata(world, languageFile, deltaTime);
+                    }
                 }
         });
 
         TRACE("Plugin {:s} {}", name, extensions);
     }
 
+    // Start rendering thread
+    mDecodeThreadRunning = true;
+    mDecodeThread = SDL_CreateThread(decodeThreadFunc, "OSPDECODE", this);
+
     // Subcribe for events
     world->subscribe<AudioSystemLoadFileEvent>(this);
     world->subscribe<AudioSystemPlayTaskEvent>(this);
+    world->subscribe<AudioSystemBufferChangeEvent>(this);
+
+    // Tells everyone we are configured
+    world->emit<AudioSystemConfiguredEvent>({.pluginInformations = pluginInformations});
+}
+
+void AudioSystem::unconfigure(ECS::World* world)
+{
+    TRACE(">>>");
+
+     // Unubscribe for events
+    world->unsubscribe<AudioSystemLoadFileEvent>(this);
+    world->unsubscribe<AudioSystemPlayTaskEvent>(this);
+    world->unsubscribe<AudioSystemBufferChangeEvent>(this);
+
+    // Stop rendering thread
+    mDecodeThreadRunning = false;
+    SDL_SemPost(mDecodeSemaphore);
+    SDL_WaitThread(mDecodeThread, nullptr);
+    mDecodeThread = nullptr;
+
+    if (mConfig.get("dump_audio_timings", false))
+    {
+        fmt::print("{:s}", getTimingReport());
+    }
+
+    // Release SDL resources used for audio
+    mDeferredLoad.reset();
+    if (mPlayStatus != NO_FILE)
+    {
+        stopAudio(world, true, false);
+    }
+
+    SDL_ClearQueuedAudio(mAudioDevice);
+    SDL_CloseAudioDevice(mAudioDevice);
+
+    // Release resources used by plugins, the decode thread is gone so every decoder belong to us
+    for (auto i=0; i<(int) std::size(mDecoders); ++i)
+    {
+        if (mDecoders[i].inUse)
+        {
+            closeDecoder(i);
+        }
+
+        for (auto* plugin : mDecoders[i].plugins)
+        {
+            plugin->cleanup();
+            delete plugin;
+        }
+        mDecoders[i].plugins.clear();
+    }
+}
+
+void AudioSystem::tick(ECS::World* world, float deltaTime)
+{
+    // Check what the decode thread has to say, it may have released a decoder
+    processNotifications(world);
+
+    // Open the file held back once the user stopped skipping, or once a decoder is free
+    mLoadQuietTime += deltaTime;
+    if (mDeferredLoad.has_value() && (mLoadQuietTime >= LOAD_DEBOUNCE_SECONDS || mDecoderWaitStart.has_value()))
+    {
+        auto event = mDeferredLoad.value();
+        mDeferredLoad.reset();
+        loadFile(world, event);
+    }
+
+    // The queued file took over and can be heard now
+    while (!mPendingSwitches.empty() && mRingBuffer.getReadPosition() >= mPendingSwitches.front().position)
+    {
+        processDecoderSwitch(world);
+    }
+
+    // The decoder reached the end of the song, stop once the audio callback played everything
+    if (mPlayStatus == PLAYING && mEndPosition.has_value() && mRingBuffer.getReadPosition() >= mEndPosition.value())
+    {
+        stopAudio(world, false, true);
+    }
+
+    if (mAdaptiveBuffering && mPlayStatus == PLAYING)
+    {
+        adaptRenderAhead(deltaTime);
+    }
+
+    if (mPlayStatus != NO_FILE)
+    {
+        sendPosition(world);
+    }
+}
+
+void AudioSystem::sendPosition(ECS::World* world)
+{
+    // What the decode thread published minus what is still waiting in the ring buffer
+    auto readPosition = mRingBuffer.getReadPosition();
+    auto offset = mDecodedPositionOffset.load();
+    auto position = mDecodedPosition.load();
+    if (offset > readPosition)
+    {
+        position -= (int) ((offset - readPosition) / mDeviceFrameSize * 1000 / mSampleRate);
+    }
+
+    position = std::max(position, 0);
+    auto duration = mDuration.load();
+    mCurrentPlugin->setPlayedPosition(position, duration);
+    if (std::abs(position - mLastPositionSent) < POSITION_EVENT_MS && duration == mLastDurationSent)
+    {
+        return;
+    }
+
+    mLastPositionSent = position;
+    mLastDurationSent = duration;
+    world->emit<AudioSystemPositionEvent>
+    ({
+        .position = position,
+        .duration = duration
+    });
+}
+
+void AudioSystem::openAudioDevice(int samples, bool isReopening)
+{
+    SDL_AudioSpec obtainedAudioSpec;
+    SDL_AudioSpec wantedAudioSpec;
+    wantedAudioSpec.callback = AudioSystem::audioCallback;
+    wantedAudioSpec.userdata = this;
+    wantedAudioSpec.samples = samples;
+    wantedAudioSpec.channels = CHANNELS;
+    wantedAudioSpec.format = isReopening ? mDeviceFormat : AUDIO_F32SYS;
+    wantedAudioSpec.freq = isReopening ? mSampleRate : 48000;
+
+    // Let the device choose its native rate and format so SDL never convert anything, we do it ourself on the decode thread.
+    // When reopening, the ring buffer already contains samples in the current format so SDL has to deal with a change.
+    auto allowedChanges = isReopening ? 0 : SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_FORMAT_CHANGE;
+    mAudioDevice = SDL_OpenAudioDevice(nullptr, 0, &wantedAudioSpec, &obtainedAudioSpec, allowedChanges);
+    if (mAudioDevice <= 0)
+    {
+        throw std::runtime_error(SDL_GetError());
+    }
+
+    if (obtainedAudioSpec.format != AUDIO_S16SYS
+        && obtainedAudioSpec.format != AUDIO_S32SYS
+        && obtainedAudioSpec.format != AUDIO_F32SYS)
+    {
+        // Unusual format, reopen the device in float and let SDL deal with it
+        TRACE("Unsupported device format 0x{:X}, SDL will convert from float", obtainedAudioSpec.format);
+        SDL_CloseAudioDevice(mAudioDevice);
+        mAudioDevice = SDL_OpenAudioDevice(nullptr, 0, &wantedAudioSpec, &obtainedAudioSpec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+        if (mAudioDevice <= 0)
+        {
+            throw std::runtime_error(SDL_GetError());
+        }
+    }
+
+    TRACE("Current driver: {:s} {:d} channels {:d}Hz (0x{:X}), buffer size: {:d}",
+        SDL_GetCurrentAudioDriver(), obtainedAudioSpec.channels, obtainedAudioSpec.freq, obtainedAudioSpec.format, obtainedAudioSpec.samples);
+
+    // The device start paused, the callback is not running yet
+    mSampleRate = obtainedAudioSpec.freq;
+    mDeviceFormat = obtainedAudioSpec.format;
+    mDeviceFrameSize = SDL_AUDIO_BITSIZE(mDeviceFormat) / 8 * CHANNELS;
+    mBufferSamples = obtainedAudioSpec.samples;
+    mCallbackPeriod = (uint64_t) obtainedAudioSpec.samples * mPerformanceFrequency / obtainedAudioSpec.freq;
+    mCallbackClockReset = true;
+}
+
+size_t AudioSystem::getRenderAheadSize(size_t frames) const
+{
+    // Keep at least one block and one device buffer of margin whatever the configuration says
+    auto minFrames = (size_t) DECODE_BLOCK_FRAMES + mBufferSamples;
+    return std::clamp(frames, minFrames, std::max(minFrames, mMaxRenderAheadFrames)) * mDeviceFrameSize;
+}
+
+void AudioSystem::adaptRenderAhead(float deltaTime)
+{
+    mAdaptiveElapsed += deltaTime;
+    if (mAdaptiveElapsed < ADAPTIVE_PERIOD_SECONDS)
+    {
+        return;
+    }
+
+    auto callbacks = mCallbackCount.load() - mAdaptiveCallbacks;
+    auto misses = mUnderrunCount.load() + mDeadlineMissCount.load() - mAdaptiveMisses;
+    auto frames = mRenderAheadSize / mDeviceFrameSize;
+    auto wantedFrames = frames;
+    if (callbacks > 0 && (double) misses / callbacks > ADAPTIVE_TARGET_MISS_RATE)
+    {
+        // The decode thread could not keep up, grow fast
+        wantedFrames = frames * 3 / 2;
+    }
+    else if (misses == 0 && mBlockTimes.getCount() > 0)
+    {
+        // Shrink slowly, but keep enough margin for two blocks decoded as slow as the worst ones seen lately
+        auto jitterFrames = (size_t) mBlockTimes.getPercentile(99) * mSampleRate / 1000000 * 2;
+        wantedFrames = std::max(frames * 7 / 8, (size_t) DECODE_BLOCK_FRAMES + mBufferSamples + jitterFrames);
+    }
+
+    auto renderAheadSize = getRenderAheadSize(wantedFrames);
+    if (renderAheadSize != mRenderAheadSize)
+    {
+        TRACE("Render ahead {:d} -> {:d} frames, {:d} misses in {:d} callbacks.", frames, renderAheadSize / mDeviceFrameSize, misses, callbacks);
+        mRenderAheadSize = renderAheadSize;
+    }
+
+    mAdaptiveElapsed = 0;
+    mAdaptiveCallbacks += callbacks;
+    mAdaptiveMisses += misses;
+    mBlockTimes.reset();
+}
+
+void AudioSystem::sendCommand(Command command)
+{
+    // The queue is only full if the decode thread is stuck in a plugin, wait for it
+    while (mCommands.write(&command, 1) == 0 && mDecodeThreadRunning)
+    {
+        SDL_SemPost(mDecodeSemaphore);
+        SDL_Delay(1);
+    }
+
+    SDL_SemPost(mDecodeSemaphore);
+}
+
+void AudioSystem::processNotifications(ECS::World* world)
+{
+    Notification notification;
+    while (mNotifications.read(&notification, 1) == 1)
+    {
+        switch (notification.type)
+        {
+            case DECODER_RELEASED:
+                if (notification.decoder == mCurrentDecoder && !mPendingSwitches.empty() && mPendingSwitches.front().previousDecoder == -1)
+                {
+                    // Faded out before the crossfade could be heard, keep it until the switch is
+                    mPendingSwitches.front().previousDecoder = notification.decoder;
+                    break;
+                }
+
+                closeDecoder(notification.decoder);
+            break;
+
+            case DECODER_SWITCHED:
+                if (notification.generation != mGeneration)
+                {
+                    // The file that ended is not heard anymore
+                    closeDecoder(notification.previousDecoder);
+                    break;
+                }
+
+                mEndPosition.reset();
+                mPendingSwitches.push_back
+                ({
+                    .decoder = notification.decoder,
+                    .previousDecoder = notification.previousDecoder,
+                    .track = notification.value,
+                    .position = notification.position
+                });
+            break;
+
+            case SONG_ENDED:
+                if (notification.generation == mGeneration)
+                {
+                    mEndPosition = notification.position;
+                }
+            break;
+
+            case SUBSONG_CHANGED:
+                if (notification.generation != mGeneration)
+                {
+                    break;
+                }
+
+                if (notification.value == mPendingTrack)
+                {
+                    mPendingTrack = -1;
+                }
+
+                mEndPosition.reset();
+                if (notification.decoder != mCurrentDecoder)
+                {
+                    // The queued decoder took over before the subsong was applied, it is not heard yet
+                    for (auto& pendingSwitch : mPendingSwitches)
+                    {
+                        if (pendingSwitch.decoder == notification.decoder)
+                        {
+                            pendingSwitch.track = notification.value;
+                        }
+                    }
+                    break;
+                }
+
+                mCurrentTrack = notification.value;
+                if (mPlayStatus == PLAYING)
+                {
+                    world->emit<AudioSystemPlayEvent>
+                    ({
+                        .type = AudioSystemPlayEvent::PLAYING,
+                        .pluginName = mCurrentPlugin->getName(),
+                        .filename = mCurrentFileLoaded,
+                        .trackNumber = mCurrentTrack,
+                        .trackCount = mTrackCount
+                    });
+                }
+            break;
+
+            case DECODE_FAILED:
+                if (notification.generation != mGeneration)
+                {
+                    break;
+                }
+
+                // Something bad happened, stop audio and send a notification about it
+                if (mPlayStatus != NO_FILE)
+                {
+                    stopAudio(world, true, true);
+                }
+
+                world->emit<AudioSystemErrorEvent>
+                ({
+                    .message = std::string("AudioSystem error: ").append(notification.message)
+                });
+            break;
+        }
+    }
+}
+
+void AudioSystem::processDecoderSwitch(ECS::World* world)
+{
+    // The previous decoder was handed back to us with the switch notification
+    auto pendingSwitch = mPendingSwitches.front();
+    mPendingSwitches.pop_front();
+    closeDecoder(pendingSwitch.previousDecoder);
+
+    mCurrentDecoder = pendingSwitch.decoder;
+    mCurrentPlugin = mDecoders[mCurrentDecoder].plugin;
+    mCurrentFileLoaded = mDecoders[mCurrentDecoder].filename;
+    mCurrentTrack = pendingSwitch.track;
+    mTrackCount = mDecoders[mCurrentDecoder].trackCount;
+    mPendingTrack = -1;
+    TRACE("Queued file {:s} is now playing.", mCurrentFileLoaded);
+
+    world->emit<AudioSystemPlayEvent>
+    ({
+        .type = AudioSystemPlayEvent::PLAYING_QUEUED_FILE,
+        .pluginName = mCurrentPlugin->getName(),
+        .filename = mCurrentFileLoaded,
+        .trackNumber = mCurrentTrack,
+        .trackCount = mTrackCount
+    });
+}
+
+int AudioSystem::acquireDecoder()
+{
+    for (auto i=0; i<(int) std::size(mDecoders); ++i)
+    {
+        if (!mDecoders[i].inUse)
+        {
+            mDecoders[i].inUse = true;
+            return i;
+        }
+    }
+
+    // Every decoder is still owned by the decode thread, it release them as soon as it read our commands
+    SDL_SemPost(mDecodeSemaphore);
+    return -1;
+}
+
+void AudioSystem::closeDecoder(int index)
+{
+    if (index == -1)
+    {
+        // Switch during a crossfade, the decoder fading out is released by the decode thread on its own
+        return;
+    }
+
+    auto& decoder = mDecoders[index];
+    if (decoder.plugin != nullptr)
+    {
+        decoder.plugin->close();
+        decoder.plugin = nullptr;
+    }
+
+    decoder.filename = "";
+    decoder.inUse = false;
+}
+
+void AudioSystem::setupResampler(Decoder& decoder)
+{
+    // Not done by the decode thread, the filter bank allocation take some time
+    auto quality = std::clamp(mConfig.get("resampler_quality", (int) Resampler::MEDIUM), 0, Resampler::QUALITY_COUNT - 1);
+    auto sampleRate = decoder.plugin->getSampleRate();
+    decoder.resampler.setup(sampleRate, mSampleRate, (Resampler::Quality) quality, RESAMPLE_BUFFER_FRAMES);
+    if (!decoder.resampler.isPassthrough())
+    {
+        TRACE("Resampling from {:d}Hz to {:d}Hz, quality {:d}.", sampleRate, mSampleRate, quality);
+    }
+}
+
+void AudioSystem::stopAudio(ECS::World* world, bool userStop, bool sendEvent)
+{
+    TRACE("Stop audio playback.");
+
+    // Pause SDL audio and clear current plugin and file
+    SDL_PauseAudioDevice(mAudioDevice, true);
+
+    // Prepare an event to tell everyone we stopped playback
+    auto event =
+    (AudioSystemPlayEvent) {
+        .type = userStop ? AudioSystemPlayEvent::STOPPED_BY_USER : AudioSystemPlayEvent::STOPPED,
+        .pluginName = mCurrentPlugin->getName(),
+        .filename = mCurrentFileLoaded,
+        .trackNumber = mCurrentTrack,
+        .trackCount = mTrackCount
+    };
+
+    // The decode thread release its decoders and drop what was rendered ahead, we don't wait for it
+    sendCommand
+    ({
+        .type = STOP,
+        .generation = ++mGeneration,
+        .flush = ++mFlushRequested
+    });
+
+    for (auto& pendingSwitch : mPendingSwitches)
+    {
+        closeDecoder(pendingSwitch.previousDecoder);
+    }
+    mPendingSwitches.clear();
+    mEndPosition.reset();
+
+    mCurrentDecoder = -1;
+    mCurrentPlugin = nullptr;
+    mCurrentTrack = 0;
+    mTrackCount = 0;
+    mPendingTrack = -1;
+    mLastPositionSent = -1;
+    mLastDurationSent = -1;
+    mPlayStatus = NO_FILE;
+    mCurrentFileLoaded = "";
+
+    if (sendEvent)
+    {
+        world->emit<AudioSystemPlayEvent>(event);
+    }
+}
+
+bool AudioSystem::processCommands()
+{
+    // Decode thread, apply what the main thread asked for between two blocks
+    auto processed = false;
+    Command command;
+    while (mCommands.read(&command, 1) == 1)
+    {
+        processed = true;
+        switch (command.type)
+        {
+            case ACTIVATE:
+                releaseDecoder(mQueuedDecoder);
+                releaseDecoder(mFadingDecoder);
+                if (command.value > 0 && mActiveDecoder != -1 && mDecodeStatus == DECODING)
+                {
+                    TRACE("Crossfade from {:s} in {:d} frames.", mDecoders[mActiveDecoder].filename, command.value);
+                    startCrossfade(command.value);
+                }
+                else
+                {
+                    releaseDecoder(mActiveDecoder);
+                    mMixer.setGain(MAIN_STREAM, 1.0f);
+                    mMixer.setGain(FADING_STREAM, 0.0f);
+                }
+
+                mActiveDecoder = command.decoder;
+                mDecodeGeneration = command.generation;
+                mDecodeStatus = DECODING;
+                startCache(mDecoders[mActiveDecoder]);
+                mRingBuffer.discard();
+                mFlushCompleted = command.flush;
+            break;
+
+            case QUEUE:
+                releaseDecoder(mQueuedDecoder);
+                mQueuedDecoder = command.decoder;
+                mQueuedCrossfadeFrames = command.value;
+                if (mActiveDecoder == -1)
+                {
+                    releaseDecoder(mQueuedDecoder);
+                    break;
+                }
+
+                startCache(mDecoders[mQueuedDecoder]);
+                if (mDecodeStatus == ENDED)
+                {
+                    // The current song already ended but the callback may still be playing it, chain right now
+                    pushNotification
+                    ({
+                        .type = DECODER_SWITCHED,
+                        .decoder = mQueuedDecoder,
+                        .previousDecoder = mActiveDecoder,
+                        .value = mDecoders[mQueuedDecoder].track,
+                        .position = mRingBuffer.getWritePosition(),
+                        .generation = mDecodeGeneration
+                    });
+                    mActiveDecoder = mQueuedDecoder;
+                    mQueuedDecoder = -1;
+                    mDecodeStatus = DECODING;
+                }
+            break;
+
+            case CLEAR_QUEUE:
+                releaseDecoder(mQueuedDecoder);
+            break;
+
+            case SET_SUBSONG:
+                if (mActiveDecoder != -1 && command.generation == mDecodeGeneration)
+                {
+                    auto& decoder = mDecoders[mActiveDecoder];
+                    try
+                    {
+                        decoder.plugin->setSubSong(command.value);
+                        decoder.track = command.value;
+                        decoder.resampler.reset();
+                        startCache(decoder);
+                        mDecodeStatus = DECODING;
+                        pushNotification
+                        ({
+                            .type = SUBSONG_CHANGED,
+                            .decoder = mActiveDecoder,
+                            .value = decoder.track,
+                            .generation = mDecodeGeneration
+                        });
+                    }
+                    catch(const std::exception& e)
+                    {
+                        pushFailure(e);
+                    }
+                }
+
+                mRingBuffer.discard();
+                mFlushCompleted = command.flush;
+            break;
+
+            case SEEK:
+                if (mActiveDecoder != -1 && command.generation == mDecodeGeneration)
+                {
+                    auto& decoder = mDecoders[mActiveDecoder];
+                    try
+                    {
+                        auto start = SDL_GetPerformanceCounter();
+                        seekDecoder(decoder, command.value);
+                        auto elapsed = getElapsedNanoseconds(start);
+                        decoder.plugin->recordSeekTime(elapsed);
+                        TRACE("Seek to {:d}ms took {:d}us{:s}.", command.value, elapsed / 1000, decoder.cacheState == CACHE_SERVING ? " (cached)" : "");
+
+                        decoder.resampler.reset();
+                        mDecodeStatus = DECODING;
+                    }
+                    catch(const std::exception& e)
+                    {
+                        pushFailure(e);
+                    }
+                }
+
+                mRingBuffer.discard();
+                mFlushCompleted = command.flush;
+            break;
+
+            case STOP:
+                releaseDecoder(mActiveDecoder);
+                releaseDecoder(mQueuedDecoder);
+                releaseDecoder(mFadingDecoder);
+                mMixer.setGain(MAIN_STREAM, 1.0f);
+                mMixer.setGain(FADING_STREAM, 0.0f);
+                mDecodeGeneration = command.generation;
+                mDecodeStatus = IDLE;
+                mRingBuffer.discard();
+                mFlushCompleted = command.flush;
+            break;
+        }
+    }
+
+    return processed;
+}
+
+void AudioSystem::releaseDecoder(int& index)
+{
+    // Decode thread, give the decoder back to the main thread which will close it
+    if (index != -1)
+    {
+        pushNotification({ .type = DECODER_RELEASED, .decoder = index });
+        index = -1;
+    }
+}
+
+void AudioSystem::pushNotification(Notification notification)
+{
+    // A lost notification would leak a decoder, wait for the main thread to make room
+    while (mNotifications.write(&notification, 1) == 0 && mDecodeThreadRunning)
+    {
+        SDL_Delay(1);
+    }
+}
+
+void AudioSystem::pushFailure(const std::exception& exception)
+{
+    TRACE("Decode thread error: {:s}", exception.what());
+
+    // The main thread will stop the playback when it see the error
+    mDecodeStatus = FAILED;
+    Notification notification = { .type = DECODE_FAILED, .generation = mDecodeGeneration };
+    strncpy(notification.message, exception.what(), sizeof(notification.message) - 1);
+    pushNotification(notification);
+}
+
+void AudioSystem::publishPosition()
+{
+    if (mActiveDecoder == -1)
+    {
+        return;
+    }
+
+    auto& decoder = mDecoders[mActiveDecoder];
+    mDecodedPosition = getDecoderPosition(decoder);
+    mDecodedPositionOffset = mRingBuffer.getWritePosition();
+    mDuration = decoder.plugin->getDuration();
+}
+
+void AudioSystem::decodeBlock()
+{
+    try
+    {
+        // Decode some frames of sound using the active decoder.
+        // If the song end in the middle of the block, continue with the queued decoder right after the last sample.
+        auto size = (size_t) DECODE_BLOCK_FRAMES;
+        auto decoded = (size_t) 0;
+        std::fill(mDecodeBuffer.begin(), mDecodeBuffer.end(), 0.0f);
+        if (mQueuedDecoder != -1 && mQueuedCrossfadeFrames > 0 && mFadingDecoder == -1 && mDecodeStatus == DECODING)
+        {
+            crossfadeQueuedDecoder();
+        }
+
+        while (decoded < size && mDecodeStatus == DECODING)
+        {
+            auto& decoder = mDecoders[mActiveDecoder];
+            auto frames = size - decoded;
+            auto isPlaying = decode(decoder, &mDecodeBuffer[decoded * CHANNELS], frames);
+            decoded += frames;
+
+            if (!isPlaying)
+            {
+                if (mQueuedDecoder != -1)
+                {
+                    pushNotification
+                    ({
+                        .type = DECODER_SWITCHED,
+                        .decoder = mQueuedDecoder,
+                        .previousDecoder = mActiveDecoder,
+                        .value = mDecoders[mQueuedDecoder].track,
+                        .position = mRingBuffer.getWritePosition() + decoded * mDeviceFrameSize,
+                        .generation = mDecodeGeneration
+                    });
+                    mActiveDecoder = mQueuedDecoder;
+                    mQueuedDecoder = -1;
+                }
+                else
+                {
+                    mDecodeStatus = ENDED;
+                }
+            }
+            else if (frames == 0)
+            {
+                // The plugin have nothing to give right now, output silence
+                decoded = size;
+            }
+        }
+
+        // Go through the mixer only during a crossfade
+        if (mFadingDecoder != -1 || mMixer.isFading(MAIN_STREAM))
+        {
+            mixDecoders(decoded);
+        }
+
+        writeOutput(decoded);
+
+        if (mDecodeStatus == ENDED)
+        {
+            pushNotification
+            ({
+                .type = SONG_ENDED,
+                .position = mRingBuffer.getWritePosition(),
+                .generation = mDecodeGeneration
+            });
+        }
+    }
+    catch(const std::exception& e)
+    {
+        pushFailure(e);
+    }
+}
+
+void AudioSystem::startCrossfade(size_t frames)
+{
+    // Decode thread. The active decoder fade out on its own stream, starting at the gain the main stream had
+    // in case a crossfade was already running, the caller set the decoder that fade in.
+    mFadingDecoder = mActiveDecoder;
+    mActiveDecoder = -1;
+    mMixer.setGain(FADING_STREAM, mMixer.getGain(MAIN_STREAM));
+    mMixer.fadeTo(FADING_STREAM, 0.0f, frames);
+    mMixer.setGain(MAIN_STREAM, 0.0f);
+    mMixer.fadeTo(MAIN_STREAM, 1.0f, frames);
+}
+
+void AudioSystem::crossfadeQueuedDecoder()
+{
+    // Decode thread. Only a song with a known duration can start fading out before it ends,
+    // any other one is followed by the queued song without a gap when it ends.
+    auto& decoder = mDecoders[mActiveDecoder];
+    auto duration = decoder.plugin->getDuration();
+    if (duration <= 0)
+    {
+        return;
+    }
+
+    auto remainingFrames = (int64_t) mSampleRate * (duration - getDecoderPosition(decoder)) / 1000;
+    if (remainingFrames > mQueuedCrossfadeFrames)
+    {
+        return;
+    }
+
+    // Queued late, fade over what is left of the song but never so fast that it click
+    auto frames = std::clamp(remainingFrames, (int64_t) std::min(DECODE_BLOCK_FRAMES, mQueuedCrossfadeFrames), (int64_t) mQueuedCrossfadeFrames);
+    TRACE("Crossfade from {:s} to the queued {:s} in {:d} frames.", decoder.filename, mDecoders[mQueuedDecoder].filename, frames);
+    pushNotification
+    ({
+        .type = DECODER_SWITCHED,
+        .decoder = mQueuedDecoder,
+        .previousDecoder = -1,
+        .value = mDecoders[mQueuedDecoder].track,
+        .position = mRingBuffer.getWritePosition(),
+        .generation = mDecodeGeneration
+    });
+
+    startCrossfade(frames);
+    mActiveDecoder = mQueuedDecoder;
+    mQueuedDecoder = -1;
+}
+
+void AudioSystem::mixDecoders(size_t frames)
+{
+    // Decode thread, mDecodeBuffer already contains frames from the active decoder
+    mMixer.clear(frames);
+    mMixer.add(MAIN_STREAM, mDecodeBuffer.data(), frames);
+
+    if (mFadingDecoder != -1)
+    {
+        auto& decoder = mDecoders[mFadingDecoder];
+        auto fadeFrames = frames;
+        std::fill_n(mFadeBuffer.begin(), frames * CHANNELS, 0.0f);
+        auto isPlaying = decode(decoder, mFadeBuffer.data(), fadeFrames);
+        mMixer.add(FADING_STREAM, mFadeBuffer.data(), frames);
+
+        if (!isPlaying || !mMixer.isFading(FADING_STREAM))
+        {
+            // Not audible anymore
+            TRACE("Crossfade of {:s} finished.", decoder.filename);
+            releaseDecoder(mFadingDecoder);
+            mMixer.setGain(FADING_STREAM, 0.0f);
+        }
+    }
+
+    mMixer.render(mDecodeBuffer.data(), frames);
+}
+
+void AudioSystem::writeOutput(size_t frames)
+{
+    // Decode thread, convert to the device format so the audio callback only copy
+    auto count = frames * CHANNELS;
+    switch (mDeviceFormat)
+    {
+        case AUDIO_S16SYS:
+            SampleConverter::floatToInt16(mDecodeBuffer.data(), (int16_t*) mOutputBuffer.data(), count);
+            mRingBuffer.write(mOutputBuffer.data(), frames * mDeviceFrameSize);
+        break;
+
+        case AUDIO_S32SYS:
+            SampleConverter::floatToInt32(mDecodeBuffer.data(), (int32_t*) mOutputBuffer.data(), count);
+            mRingBuffer.write(mOutputBuffer.data(), frames * mDeviceFrameSize);
+        break;
+
+        default:
+            mRingBuffer.write((uint8_t*) mDecodeBuffer.data(), frames * mDeviceFrameSize);
+        break;
+    }
+}
+
+bool AudioSystem::decode(Decoder& decoder, float* stream, size_t& frames)
+{
+    // Decode thread, same as Plugin::decode but output at the device rate
+    auto& resampler = decoder.resampler;
+    if (resampler.isPassthrough())
+    {
+        return decodeSource(decoder, stream, frames);
+    }
+
+    auto inputFrames = std::min(resampler.getInputFrames(frames), (size_t) RESAMPLE_BUFFER_FRAMES);
+    auto isPlaying = true;
+    if (inputFrames > 0)
+    {
+        isPlaying = decodeSource(decoder, mResampleBuffer.data(), inputFrames);
+    }
+
+    frames = resampler.process(mResampleBuffer.data(), inputFrames, stream, frames);
+    return isPlaying;
+}
+
+bool AudioSystem::decodeSource(Decoder& decoder, float* stream, size_t& frames)
+{
+    // Decode thread, same as Plugin::decode but served from the PCM cache when possible
+    if (decoder.cacheState == CACHE_SERVING)
+    {
+        auto read = mPcmCache.read(decoder.cacheKey, decoder.position, stream, frames);
+        if (read > 0)
+        {
+            decoder.position += read;
+            frames = read;
+            return true;
+        }
+
+        auto complete = false;
+        auto cachedFrames = mPcmCache.getFrameCount(decoder.cacheKey, complete);
+        if (complete && decoder.position >= cachedFrames)
+        {
+            frames = 0;
+            return false;
+        }
+
+        // Past the end of what is cached, or evicted meanwhile: the plugin take over from here.
+        // It seek in milliseconds, the few frames before the end of the cache are rendered and thrown
+        // away so the recording go on right where the entry stop.
+        if (decoder.pluginPosition != decoder.position)
+        {
+            auto sampleRate = decoder.plugin->getSampleRate();
+            auto target = decoder.position;
+            auto position = (int) (target * 1000 / sampleRate);
+            decoder.plugin->seek(position);
+            decoder.pluginPosition = (size_t) position * sampleRate / 1000;
+            while (decoder.pluginPosition < target)
+            {
+                auto skipped = std::min(target - decoder.pluginPosition, frames);
+                if (!decoder.plugin->decode(stream, skipped) || skipped == 0)
+                {
+                    break;
+                }
+
+                decoder.pluginPosition += skipped;
+            }
+            decoder.position = decoder.pluginPosition;
+        }
+
+        decoder.cacheState = decoder.position == cachedFrames ? CACHE_RECORDING : CACHE_BYPASS;
+    }
 
-    // Tells everyone we are configured
-    world->emit<AudioSystemConfiguredEvent>({.pluginInformations = pluginInformations});
-}
+    auto start = SDL_GetPerformanceCounter();
+    auto isPlaying = decoder.plugin->decode(stream, frames);
+    decoder.plugin->recordDecodeTime(getElapsedNanoseconds(start), frames);
 
-void AudioSystem::unconfigure(ECS::World* world)
-{
-    TRACE(">>>");
+    if (decoder.cacheState == CACHE_DISABLED)
+    {
+        return isPlaying;
+    }
 
-     // Unubscribe for events
-    world->unsubscribe<AudioSystemLoadFileEvent>(this);
-    world->unsubscribe<AudioSystemPlayTaskEvent>(this);
+    if (decoder.plugin->getCurrentTrack() != decoder.track)
+    {
+        // The plugin moved to another track by itself, positions do not mean anything anymore
+        decoder.cacheState = CACHE_DISABLED;
+        return isPlaying;
+    }
 
-    // Release SDL resources used for audio
-    if (mPlayStatus != NO_FILE)
+    if (decoder.cacheState == CACHE_RECORDING)
     {
-        stopAudio(world, true, false);
+        if (!mPcmCache.append(decoder.cacheKey, decoder.position, stream, frames))
+        {
+            decoder.cacheState = CACHE_BYPASS;
+        }
+        else if (!isPlaying)
+        {
+            mPcmCache.setComplete(decoder.cacheKey);
+        }
     }
 
-    SDL_ClearQueuedAudio(mAudioDevice);
-    SDL_CloseAudioDevice(mAudioDevice);
+    decoder.position += frames;
+    decoder.pluginPosition = decoder.position;
+    return isPlaying;
+}
 
-    // Release resources used by plugins
-    for (auto* plugin : mPlugins)
+void AudioSystem::startCache(Decoder& decoder)
+{
+    // Decode thread, called when the plugin was just opened or set to a subsong, so it is at the start of the track
+    decoder.position = 0;
+    decoder.pluginPosition = 0;
+    if (!mPcmCache.isEnabled())
     {
-        plugin->cleanup();
-        delete plugin;
+        decoder.cacheState = CACHE_DISABLED;
+        return;
     }
+
+    decoder.cacheKey =
+    {
+        .contentHash = decoder.contentHash,
+        .track = decoder.track,
+        .sampleRate = decoder.plugin->getSampleRate(),
+        .settingsVersion = decoder.settingsVersion
+    };
+
+    // Only a complete track is replayed from the cache, a partial one would stall the decode thread
+    // when the plugin has to catch up at its end. It is recorded again from the start instead.
+    decoder.cacheState = mPcmCache.lookup(decoder.cacheKey, 0, true) ? CACHE_SERVING : CACHE_RECORDING;
 }
 
-void AudioSystem::tick(ECS::World* world, float deltaTime)
+void AudioSystem::seekDecoder(Decoder& decoder, int position)
 {
-    // Check for pending event probably sent by the audio calback
-    SDL_LockMutex(mMutex);
-    if (mPendingAudioSystemErrorEvent.has_value())
+    // Decode thread, a seek inside what is cached does not touch the plugin at all
+    auto sampleRate = decoder.plugin->getSampleRate();
+    auto target = (size_t) std::max(position, 0) * sampleRate / 1000;
+    if (decoder.cacheState != CACHE_DISABLED && mPcmCache.lookup(decoder.cacheKey, target, false))
     {
-        world->emit(mPendingAudioSystemErrorEvent.value());
-        mPendingAudioSystemErrorEvent.reset();
+        decoder.position = target;
+        decoder.cacheState = CACHE_SERVING;
+        return;
     }
-    if (mPendingAudioSystemPlayEvent.has_value())
+
+    decoder.plugin->seek(position);
+    if (decoder.cacheState != CACHE_DISABLED)
     {
-        world->emit(mPendingAudioSystemPlayEvent.value());
-        mPendingAudioSystemPlayEvent.reset();
+        // The cache only hold a track from its start, there is a hole between its end and the new position
+        decoder.position = target;
+        decoder.pluginPosition = target;
+        decoder.cacheState = target == 0 ? CACHE_RECORDING : CACHE_BYPASS;
     }
-    SDL_UnlockMutex(mMutex);
 }
 
-void AudioSystem::stopAudio(ECS::World* world, bool userStop, bool sendEvent)
+int AudioSystem::getDecoderPosition(Decoder& decoder)
 {
-    TRACE("Stop audio playback.");
+    if (decoder.cacheState == CACHE_DISABLED)
+    {
+        return decoder.plugin->getPosition();
+    }
 
-    // Pause SDL audio and clear current plugin and file
-    SDL_PauseAudioDevice(mAudioDevice, true);
+    return (int) (decoder.position * 1000 / decoder.plugin->getSampleRate());
+}
 
-    // Prepare an event to tell everyone we stopped playback
-    auto event =
-    (AudioSystemPlayEvent) {
-        .type = userStop ? AudioSystemPlayEvent::STOPPED_BY_USER : AudioSystemPlayEvent::STOPPED,
-        .pluginName = mCurrentPlugin->getName(),
-        .filename = mCurrentFileLoaded,
-        .trackNumber = mCurrentPlugin->getCurrentTrack(),
-        .trackCount =  mCurrentPlugin->getTrackCount()
-    };
+uint64_t AudioSystem::getElapsedNanoseconds(uint64_t start) const
+{
+    return (SDL_GetPerformanceCounter() - start) * 1000000000 / mPerformanceFrequency;
+}
 
-    mCurrentPlugin->close();
-    mCurrentPlugin = nullptr;
+int AudioSystem::decodeThreadFunc(void* thiz)
+{
+    TRACE("Decode thread alive.");
+    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH) != 0)
+    {
+        TRACE("Set SDL_THREAD_PRIORITY_HIGH failed");
+    }
 
-    mPlayStatus = NO_FILE;
-    mCurrentFileLoaded = "";
+    auto* audioSystem = (AudioSystem*) thiz;
+    auto& ringBuffer = audioSystem->mRingBuffer;
 
-    if (sendEvent)
+    while (audioSystem->mDecodeThreadRunning)
     {
-        if (world != nullptr)
+        if (audioSystem->processCommands())
         {
-            world->emit<AudioSystemPlayEvent>(event);
+            audioSystem->publishPosition();
         }
-        else
+        audioSystem->mStreamEnded = audioSystem->mDecodeStatus != DECODING;
+
+        // Sleep until the audio callback consume something, or until a command is sent
+        if (audioSystem->mDecodeStatus != DECODING
+            || ringBuffer.getReadAvailable() + audioSystem->mOutputBuffer.size() > audioSystem->mRenderAheadSize)
         {
-            // If World is null place the event in the optional, this was probably called from a thread (audio callback)
-            SDL_LockMutex(mMutex);
-            mPendingAudioSystemPlayEvent.emplace(event);
-            SDL_UnlockMutex(mMutex);
+            SDL_SemWaitTimeout(audioSystem->mDecodeSemaphore, DECODE_THREAD_IDLE_MS);
+            continue;
         }
+
+        auto start = SDL_GetPerformanceCounter();
+        audioSystem->decodeBlock();
+        audioSystem->mBlockTimes.record(audioSystem->getElapsedNanoseconds(start) / 1000);
+        audioSystem->publishPosition();
+        audioSystem->mStreamEnded = audioSystem->mDecodeStatus != DECODING;
     }
+
+    TRACE("Decode thread finished.");
+    return 0;
 }
 
 void AudioSystem::audioCallback(void* thiz, uint8_t* stream, int len)
 {
     auto* audioSystem = (AudioSystem*) thiz;
-    memset(stream, 0, len);
 
-    try
+    // Measure the time elapsed since the previous callback, unless the device was paused in between
+    auto now = SDL_GetPerformanceCounter();
+    if (!audioSystem->mCallbackClockReset.exchange(false))
     {
-        // Decode some frames of sound using the current decoder
-        if (! audioSystem->mCurrentPlugin->decode(stream, len))
-        {
-            audioSystem->stopAudio(nullptr, false, true);
-            return;
-        }
+        auto period = now - audioSystem->mLastCallbackTime;
+        auto jitter = period > audioSystem->mCallbackPeriod ? period - audioSystem->mCallbackPeriod : audioSystem->mCallbackPeriod - period;
+        audioSystem->mCallbackJitter.record(jitter * 1000000 / audioSystem->mPerformanceFrequency);
     }
-    catch(const std::exception& e)
+    audioSystem->mLastCallbackTime = now;
+    audioSystem->mCallbackCount.fetch_add(1, std::memory_order_relaxed);
+
+    // Copy what was rendered ahead, output silence in case of underrun, at the end of the song,
+    // or while the decode thread did not drop what was rendered before the last command yet
+    auto read = (size_t) 0;
+    auto isFlushed = audioSystem->mFlushCompleted == audioSystem->mFlushRequested;
+    if (isFlushed)
     {
-        auto error = e.what();
-        TRACE("Audio callback error: {:s}", error);
+        read = audioSystem->mRingBuffer.read(stream, len);
+    }
 
-        // Something bad happened, stop audio and send a notification about it
-        audioSystem->stopAudio(nullptr, true, true);
+    if (read < (size_t) len)
+    {
+        memset(&stream[read], 0, len - read);
+    }
 
-        SDL_LockMutex(audioSystem->mMutex);
-        audioSystem->mPendingAudioSystemErrorEvent.emplace(
-        (AudioSystemErrorEvent) {
-            .message = std::string("AudioSystem error: ").append(error)
-        });
-        SDL_UnlockMutex(audioSystem->mMutex);
+    if (isFlushed && !audioSystem->mStreamEnded)
+    {
+        if (read < (size_t) len)
+        {
+            audioSystem->mUnderrunCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (audioSystem->mRingBuffer.getReadAvailable() < (size_t) len)
+        {
+            audioSystem->mDeadlineMissCount.fetch_add(1, std::memory_order_relaxed);
+        }
     }
+
+    // There is room in the ring buffer now, wake up the decode thread
+    SDL_SemPost(audioSystem->mDecodeSemaphore);
 }
 
 void AudioSystem::receive(ECS::World* world, const AudioSystemLoadFileEvent& event)
 {
-    TRACE("Received AudioSystemLoadFileEvent: {:d} {:s} ({:d} Kb), track: {:d}.", event.type, event.path, (uint32_t) event.buffer.size() / 1024, event.startTrack);
+    TRACE("Received AudioSystemLoadFileEvent: {:d} {:s} ({:d} Kb), track: {:d}.", event.type, event.path, (uint32_t) event.buffer->getSize() / 1024, event.startTrack);
 
-    // Stop playback but keep trace of what we were doing
-    if (mPlayStatus != NO_FILE)
+    if (event.type == AudioSystemLoadFileEvent::LOAD_AND_QUEUE)
     {
-        stopAudio(world, false, false);
+        queueFile(world, event);
+        return;
     }
 
-    std::string fileExtension = std::filesystem::path(event.path).extension();
-    std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
+    // Opening a plugin is not free, when files come in a burst only the last one is opened.
+    // The one held back is dropped with its buffer when another one come.
+    auto isBurst = mLoadQuietTime < LOAD_DEBOUNCE_SECONDS;
+    mLoadQuietTime = 0;
+    if (isBurst)
+    {
+        mDeferredLoad = event;
+        return;
+    }
+
+    mDeferredLoad.reset();
+    loadFile(world, event);
+}
 
-    for (auto* plugin : mPlugins)
+void AudioSystem::loadFile(ECS::World* world, const AudioSystemLoadFileEvent& event)
+{
+    if (mAudioDevice == 0)
     {
-        for (auto extension : plugin->getSupportedExtensions())
+        // The device was lost while changing its buffer size, try again with the last size that worked
+        try
         {
-            if (extension == fileExtension)
-            {
-                TRACE("Selecting {:s} plugin.", plugin->getName());
-                mCurrentPlugin = plugin;
-                break;
-            }
+            openAudioDevice(mBufferSamples, true);
+        }
+        catch(const std::exception& e)
+        {
+            mAudioDevice = 0;
+            world->emit<AudioSystemErrorEvent>
+            ({
+                .message = fmt::format("AudioSystem error: {:s}", e.what())
+            });
+
+            return;
+        }
+    }
+
+    // Stop playback but keep trace of what we were doing, unless the new file fade in over the current one
+    auto crossfadeMs = std::max(mConfig.get("crossfade_ms", DEFAULT_CROSSFADE_MS), 0);
+    auto isCrossfading = crossfadeMs > 0 && mPlayStatus == PLAYING && event.type == AudioSystemLoadFileEvent::LOAD_AND_PLAY;
+    if (!isCrossfading && mPlayStatus != NO_FILE)
+    {
+        stopAudio(world, false, false);
+    }
+
+    // Never wait for a decoder here, the load is tried again by tick() once the decode thread released one
+    auto decoderIndex = acquireDecoder();
+    if (decoderIndex == -1)
+    {
+        if (!mDecoderWaitStart.has_value())
+        {
+            mDecoderWaitStart = SDL_GetTicks();
         }
+
+        if (SDL_GetTicks() - mDecoderWaitStart.value() < DECODER_WAIT_MS)
+        {
+            mDeferredLoad = event;
+            return;
+        }
+
+        mDecoderWaitStart.reset();
+        world->emit<AudioSystemErrorEvent>
+        ({
+            .message = "AudioSystem error: the decode thread does not respond"
+        });
+        return;
     }
 
-    if (mCurrentPlugin == nullptr)
+    mDecoderWaitStart.reset();
+
+    auto& decoder = mDecoders[decoderIndex];
+    auto* plugin = selectPlugin(decoder, event.path);
+    if (plugin == nullptr)
     {
-        TRACE("Unsupported file extension: {:s}", fileExtension);
+        TRACE("Unsupported file extension: {:s}", event.path);
         // We should never reach this code because checks are done before (FileSystem)
+        closeDecoder(decoderIndex);
         return;
     }
 
     try
     {
-        mCurrentPlugin->open(event.buffer);
-        mCurrentPlugin->setSubSong(event.startTrack);
+        // The decode thread does not know about this decoder yet
+        decoder.plugin = plugin;
+        decoder.filename = event.path;
+        plugin->open(*event.buffer);
+        plugin->setSubSong(event.startTrack);
+        decoder.track = plugin->getCurrentTrack();
+        decoder.trackCount = plugin->getTrackCount();
+        decoder.contentHash = event.buffer->getHash();
+        decoder.settingsVersion = Config::getVersion();
+        plugin->resetDecodeTimes();
+        setupResampler(decoder);
     }
     catch(const std::exception& e)
     {
         // Something bad happened, tells everyone and close the plugin that was in use
+        closeDecoder(decoderIndex);
+        mCurrentPlugin = plugin;
         stopAudio(world, true, true);
 
         world->emit<AudioSystemErrorEvent>
@@ -298,16 +1344,41 @@ void AudioSystem::receive(ECS::World* world, const AudioSystemLoadFileEvent& eve
         return;
     }
 
+    // Hand the decoder over, a switch that was pending will never be heard because the ring buffer is discarded
+    for (auto& pendingSwitch : mPendingSwitches)
+    {
+        closeDecoder(pendingSwitch.previousDecoder);
+    }
+    mPendingSwitches.clear();
+    mEndPosition.reset();
+
+    // The track is read before the decode thread get the decoder, it may change it from now on
+    auto track = decoder.track;
+    auto crossfadeFrames = isCrossfading ? (int) ((int64_t) mSampleRate * crossfadeMs / 1000) : 0;
+    sendCommand
+    ({
+        .type = ACTIVATE,
+        .decoder = decoderIndex,
+        .value = crossfadeFrames,
+        .generation = ++mGeneration,
+        .flush = ++mFlushRequested
+    });
+
     // Start playing right now and tells everyone
+    mCurrentDecoder = decoderIndex;
+    mCurrentPlugin = plugin;
     mCurrentFileLoaded = event.path;
+    mCurrentTrack = track;
+    mTrackCount = decoder.trackCount;
+    mPendingTrack = -1;
     TRACE("File loaded.");
 
     auto audioEvent =
     (AudioSystemPlayEvent) {
         .pluginName = mCurrentPlugin->getName(),
         .filename = mCurrentFileLoaded,
-        .trackNumber = mCurrentPlugin->getCurrentTrack(),
-        .trackCount = mCurrentPlugin->getTrackCount()
+        .trackNumber = mCurrentTrack,
+        .trackCount = mTrackCount
     };
 
     switch (event.type)
@@ -316,6 +1387,7 @@ void AudioSystem::receive(ECS::World* world, const AudioSystemLoadFileEvent& eve
             // If before receiveing this event we were already playing or if no file was loaded
             mPlayStatus = PLAYING;
             audioEvent.type = AudioSystemPlayEvent::PLAYING;
+            mCallbackClockReset = true;
             SDL_PauseAudioDevice(mAudioDevice, false);
             TRACE("Playback started...");
         break;
@@ -326,24 +1398,127 @@ void AudioSystem::receive(ECS::World* world, const AudioSystemLoadFileEvent& eve
             audioEvent.type = AudioSystemPlayEvent::PAUSED;
             TRACE("Playback paused...");
         break;
+
+        case AudioSystemLoadFileEvent::LOAD_AND_QUEUE:
+            // Handled by queueFile()
+        break;
     }
 
     world->emit<AudioSystemPlayEvent>(audioEvent);
 }
 
+void AudioSystem::queueFile(ECS::World* world, const AudioSystemLoadFileEvent& event)
+{
+    // A pending switch mean the file heard is not the one rendered
+    if (mPlayStatus == NO_FILE || !mPendingSwitches.empty())
+    {
+        TRACE("No file to chain {:s} with.", event.path);
+        return;
+    }
+
+    // Don't wait here, the file will be loaded again the usual way if no decoder is free
+    auto queuedDecoder = -1;
+    for (auto i=0; i<(int) std::size(mDecoders) && queuedDecoder == -1; ++i)
+    {
+        if (!mDecoders[i].inUse)
+        {
+            queuedDecoder = i;
+        }
+    }
+
+    if (queuedDecoder == -1)
+    {
+        TRACE("No free decoder to queue {:s}.", event.path);
+        return;
+    }
+
+    auto& decoder = mDecoders[queuedDecoder];
+    decoder.inUse = true;
+    decoder.plugin = selectPlugin(decoder, event.path);
+    if (decoder.plugin == nullptr)
+    {
+        TRACE("Unsupported file extension: {:s}", event.path);
+        closeDecoder(queuedDecoder);
+        return;
+    }
+
+    try
+    {
+        // The decode thread does not know about this decoder until it is queued
+        decoder.plugin->open(*event.buffer);
+        decoder.plugin->setSubSong(event.startTrack);
+        decoder.track = decoder.plugin->getCurrentTrack();
+        decoder.trackCount = decoder.plugin->getTrackCount();
+        decoder.contentHash = event.buffer->getHash();
+        decoder.settingsVersion = Config::getVersion();
+        decoder.plugin->resetDecodeTimes();
+        decoder.filename = event.path;
+        setupResampler(decoder);
+    }
+    catch(const std::exception& e)
+    {
+        // The file will be loaded again the usual way when the current song stop, the error will be reported then
+        TRACE("Failed to queue {:s}: {:s}", event.path, e.what());
+        closeDecoder(queuedDecoder);
+        return;
+    }
+
+    // A previously queued decoder is released by the decode thread
+    auto crossfadeMs = std::max(mConfig.get("crossfade_ms", DEFAULT_CROSSFADE_MS), 0);
+    sendCommand
+    ({
+        .type = QUEUE,
+        .decoder = queuedDecoder,
+        .value = (int) ((int64_t) mSampleRate * crossfadeMs / 1000),
+        .generation = mGeneration
+    });
+
+    TRACE("File queued.");
+}
+
+void AudioSystem::changeSubSong(int track)
+{
+    // Applied by the decode thread at the next block, the callback output silence until then
+    mPendingTrack = track;
+    mEndPosition.reset();
+    sendCommand
+    ({
+        .type = SET_SUBSONG,
+        .value = track,
+        .generation = mGeneration,
+        .flush = ++mFlushRequested
+    });
+}
+
 void AudioSystem::receive(ECS::World* world, const AudioSystemPlayTaskEvent& event)
 {
     TRACE("Received AudioSystemPlayTaskEvent: {:d}.", event.type);
+    if (event.type == AudioSystemPlayTaskEvent::STOP)
+    {
+        // The user does not want to hear the file that was held back either
+        mDeferredLoad.reset();
+        mDecoderWaitStart.reset();
+    }
+
     if (mPlayStatus == NO_FILE)
     {
         return;
     }
 
+    // Commands apply to the file heard, if the queued file took over then make it current right now
+    while (!mPendingSwitches.empty())
+    {
+        processDecoderSwitch(world);
+    }
+
+    // The subsong asked before may not be applied yet
+    auto currentTrack = mPendingTrack != -1 ? mPendingTrack : mCurrentTrack;
     switch (event.type)
     {
         case AudioSystemPlayTaskEvent::PLAY:
             if (mPlayStatus == PAUSED)
             {
+                mCallbackClockReset = true;
                 SDL_PauseAudioDevice(mAudioDevice, false);
                 mPlayStatus = PLAYING;
                 world->emit<AudioSystemPlayEvent>
@@ -351,8 +1526,8 @@ void AudioSystem::receive(ECS::World* world, const AudioSystemPlayTaskEvent& eve
                     .type = AudioSystemPlayEvent::PLAYING,
                     .pluginName = mCurrentPlugin->getName(),
                     .filename = mCurrentFileLoaded,
-                    .trackNumber = mCurrentPlugin->getCurrentTrack(),
-                    .trackCount = mCurrentPlugin->getTrackCount()
+                    .trackNumber = currentTrack,
+                    .trackCount = mTrackCount
                 });
             }
         break;
@@ -367,88 +1542,200 @@ void AudioSystem::receive(ECS::World* world, const AudioSystemPlayTaskEvent& eve
                     .type = AudioSystemPlayEvent::PAUSED,
                     .pluginName = mCurrentPlugin->getName(),
                     .filename = mCurrentFileLoaded,
-                    .trackNumber = mCurrentPlugin->getCurrentTrack(),
-                    .trackCount = mCurrentPlugin->getTrackCount()
+                    .trackNumber = currentTrack,
+                    .trackCount = mTrackCount
                 });
             }
         break;
 
         case AudioSystemPlayTaskEvent::PREV_SUBSONG:
-            if (mCurrentPlugin->getTrackCount() <= 1
-                || mCurrentPlugin->getCurrentTrack() <= 1)
+            if (mTrackCount <= 1 || currentTrack <= 1)
             {
                 world->emit<AudioSystemPlayEvent>
                 ({
                     .type = AudioSystemPlayEvent::NO_PREV_SUBSONG,
                     .pluginName = mCurrentPlugin->getName(),
                     .filename = mCurrentFileLoaded,
-                    .trackNumber = mCurrentPlugin->getCurrentTrack(),
-                    .trackCount = mCurrentPlugin->getTrackCount()
+                    .trackNumber = currentTrack,
+                    .trackCount = mTrackCount
                 });
                 break;
             }
 
-            SDL_PauseAudioDevice(mAudioDevice, true);
-            if (mCurrentPlugin->getCurrentTrack() > 1)
-            {
-                mCurrentPlugin->setSubSong(mCurrentPlugin->getCurrentTrack()-1);
-            }
-
-            if (mPlayStatus != PAUSED)
-            {
-                SDL_PauseAudioDevice(mAudioDevice, false);
-                world->emit<AudioSystemPlayEvent>
-                ({
-                    .type = AudioSystemPlayEvent::PLAYING,
-                    .pluginName = mCurrentPlugin->getName(),
-                    .filename = mCurrentFileLoaded,
-                    .trackNumber = mCurrentPlugin->getCurrentTrack(),
-                    .trackCount = mCurrentPlugin->getTrackCount()
-                });
-            }
+            changeSubSong(currentTrack-1);
         break;
 
         case AudioSystemPlayTaskEvent::NEXT_SUBSONG:
-            if (mCurrentPlugin->getTrackCount() <= 1
-                || mCurrentPlugin->getCurrentTrack() >= mCurrentPlugin->getTrackCount())
+            if (mTrackCount <= 1 || currentTrack >= mTrackCount)
             {
                 world->emit<AudioSystemPlayEvent>
                 ({
                     .type = AudioSystemPlayEvent::NO_NEXT_SUBSONG,
                     .pluginName = mCurrentPlugin->getName(),
                     .filename = mCurrentFileLoaded,
-                    .trackNumber = mCurrentPlugin->getCurrentTrack(),
-                    .trackCount = mCurrentPlugin->getTrackCount()
+                    .trackNumber = currentTrack,
+                    .trackCount = mTrackCount
                 });
                 break;
             }
 
-            SDL_PauseAudioDevice(mAudioDevice, true);
-            if (mCurrentPlugin->getCurrentTrack() < mCurrentPlugin->getTrackCount())
+            changeSubSong(currentTrack+1);
+        break;
+
+        case AudioSystemPlayTaskEvent::STOP:
+            // If the user request a stop, then stop and send an event.
+            stopAudio(world, true, true);
+        break;
+
+        case AudioSystemPlayTaskEvent::CLEAR_QUEUE:
+            sendCommand({ .type = CLEAR_QUEUE });
+        break;
+
+        case AudioSystemPlayTaskEvent::SEEK:
+            // Done by the decode thread, the callback output silence until the engine get there
+            mEndPosition.reset();
+            sendCommand
+            ({
+                .type = SEEK,
+                .value = std::max(event.position, 0),
+                .generation = mGeneration,
+                .flush = ++mFlushRequested
+            });
+        break;
+    }
+}
+
+void AudioSystem::receive(ECS::World* world, const AudioSystemBufferChangeEvent& event)
+{
+    TRACE("Received AudioSystemBufferChangeEvent: {:d} samples, low latency: {}, adaptive: {}.", event.bufferSamples, event.lowLatency, event.adaptive);
+
+    mAdaptiveBuffering = event.lowLatency || event.adaptive;
+    if (event.lowLatency)
+    {
+        // Start from the smallest margin, the adaptive mode will grow it if this is not enough
+        mRenderAheadSize = getRenderAheadSize(0);
+    }
+    else if (!mAdaptiveBuffering)
+    {
+        auto renderAheadMs = std::max(mConfig.get("render_ahead_ms", DEFAULT_RENDER_AHEAD_MS), 0);
+        mRenderAheadSize = getRenderAheadSize((size_t) mSampleRate * renderAheadMs / 1000);
+    }
+
+    auto samples = event.lowLatency ? LOW_LATENCY_BUFFER_SAMPLES : event.bufferSamples;
+    if (samples == mBufferSamples)
+    {
+        return;
+    }
+
+    // Decoders and the ring buffer are left untouched so the song continue where it was,
+    // only what the previous device already took from the ring buffer is lost
+    auto previousSamples = mBufferSamples;
+    SDL_CloseAudioDevice(mAudioDevice);
+    try
+    {
+        openAudioDevice(samples, true);
+    }
+    catch(const std::exception& e)
+    {
+        world->emit<AudioSystemErrorEvent>
+        ({
+            .message = fmt::format("AudioSystem error: {:s}", e.what())
+        });
+
+        try
+        {
+            openAudioDevice(previousSamples, true);
+        }
+        catch(const std::exception& fallbackError)
+        {
+            // No device at all, stop the song since no callback will ever read it. Playing a file try to open it again.
+            mAudioDevice = 0;
+            if (mPlayStatus != NO_FILE)
+            {
+                stopAudio(world, true, true);
+            }
+
+            world->emit<AudioSystemErrorEvent>
+            ({
+                .message = fmt::format("AudioSystem error: {:s}", fallbackError.what())
+            });
+
+            return;
+        }
+    }
+
+    // The margin depend on the device buffer size
+    mRenderAheadSize = getRenderAheadSize(mRenderAheadSize / mDeviceFrameSize);
+    if (mPlayStatus == PLAYING)
+    {
+        SDL_PauseAudioDevice(mAudioDevice, false);
+    }
+}
+
+std::string AudioSystem::getTimingReport()
+{
+    auto report = fmt::format("Audio callback: {:d} calls, period {:d} us, jitter {:d} / {:d} / {:d} us (avg/p99/max)\n",
+        mCallbackCount.load(), mCallbackPeriod * 1000000 / mPerformanceFrequency,
+        mCallbackJitter.getMean(), mCallbackJitter.getPercentile(99), mCallbackJitter.getMax());
+    report += fmt::format("Audio callback: {:d} underruns, {:d} deadline misses\n", mUnderrunCount.load(), mDeadlineMissCount.load());
+    report += fmt::format("Render ahead: {:d} frames{:s}, device buffer: {:d} frames\n",
+        mRenderAheadSize / mDeviceFrameSize, mAdaptiveBuffering ? " (adaptive)" : "", mBufferSamples);
+    report += fmt::format("PCM cache: {:d} hits, {:d} misses, {:d} Kb used\n",
+        mPcmCache.getHitCount(), mPcmCache.getMissCount(), mPcmCache.getMemoryUsage() / 1024);
+
+    for (auto i=0; i<(int) std::size(mDecoders); ++i)
+    {
+        for (auto* plugin : mDecoders[i].plugins)
+        {
+            auto& decodeTimes = plugin->getDecodeTimes();
+            if (decodeTimes.getCount() == 0)
             {
-                mCurrentPlugin->setSubSong(mCurrentPlugin->getCurrentTrack()+1);
+                continue;
             }
 
-            if (mPlayStatus != PAUSED)
+            report += fmt::format("Decoder {:d} {:s}: {:d} calls, {:d} / {:d} / {:d} us (avg/p99/max), {:.1f}x realtime\n",
+                i, plugin->getName(), decodeTimes.getCount(),
+                decodeTimes.getMean(), decodeTimes.getPercentile(99), decodeTimes.getMax(), plugin->getRealtimeFactor());
+
+            auto& seekTimes = plugin->getSeekTimes();
+            if (seekTimes.getCount() > 0)
             {
-                SDL_PauseAudioDevice(mAudioDevice, false);
-                world->emit<AudioSystemPlayEvent>
-                ({
-                    .type = AudioSystemPlayEvent::PLAYING,
-                    .pluginName = mCurrentPlugin->getName(),
-                    .filename = mCurrentFileLoaded,
-                    .trackNumber = mCurrentPlugin->getCurrentTrack(),
-                    .trackCount = mCurrentPlugin->getTrackCount()
-                });
+                report += fmt::format("Decoder {:d} {:s}: {:d} seeks, {:d} / {:d} / {:d} us (avg/p99/max)\n",
+                    i, plugin->getName(), seekTimes.getCount(), seekTimes.getMean(), seekTimes.getPercentile(99), seekTimes.getMax());
             }
-        break;
+        }
+    }
 
-        case AudioSystemPlayTaskEvent::STOP:
-            if (mPlayStatus != NO_FILE)
+    return report;
+}
+
+Plugin* AudioSystem::selectPlugin(const Decoder& decoder, std::string path)
+{
+    std::string fileExtension = std::filesystem::path(path).extension();
+    std::transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
+
+    for (auto* plugin : decoder.plugins)
+    {
+        for (auto extension : plugin->getSupportedExtensions())
+        {
+            if (extension == fileExtension)
             {
-                // If the user request a stop, then stop and send an event.
-                stopAudio(world, true, true);
+                TRACE("Selecting {:s} plugin.", plugin->getName());
+                return plugin;
             }
-        break;
+        }
     }
+
+    return nullptr;
+}
+
+std::vector<Plugin*> AudioSystem::createPlugins()
+{
+    return
+    {
+        new OpenmptPlugin(),
+        new GmePlugin(),
+        new SidplayfpPlugin(),
+        new Sc68Plugin()
+    };
 }
@@ -17,24 +17,34 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <optional>
 #include <string>
+#include <atomic>
 
 #include <SDL2/SDL.h>
 #include <ECS.h>
 
 #include "audio/Plugin.h"
+#include "audio/Mixer.h"
+#include "audio/Resampler.h"
+#include "audio/PcmCache.h"
 #include "../event/audio/AudioSystemLoadFileEvent.h"
 #include "../event/audio/AudioSystemPlayTaskEvent.h"
 #include "../event/audio/AudioSystemPlayEvent.h"
 #include "../event/audio/AudioSystemErrorEvent.h"
+#include "../event/audio/AudioSystemBufferChangeEvent.h"
+#include "../event/audio/AudioSystemPositionEvent.h"
 #include "../tools/ConfigFile.h"
+#include "../tools/RingBuffer.h"
+#include "../tools/Histogram.h"
 
 
 class AudioSystem :
 public ECS::EntitySystem,
 public ECS::EventSubscriber<AudioSystemLoadFileEvent>,
-public ECS::EventSubscriber<AudioSystemPlayTaskEvent>
+public ECS::EventSubscriber<AudioSystemPlayTaskEvent>,
+public ECS::EventSubscriber<AudioSystemBufferChangeEvent>
 {
 public:
     AudioSystem(Config config);
@@ -46,6 +56,10 @@ public:
 
     virtual void receive(ECS::World* world, const AudioSystemLoadFileEvent& event) override;
     virtual void receive(ECS::World* world, const AudioSystemPlayTaskEvent& event) override;
+    virtual void receive(ECS::World* world, const AudioSystemBufferChangeEvent& event) override;
+
+    // Decode and audio callback timings in a human readable form, for logs or headless runs
+    std::string getTimingReport();
 
 private:
     enum AudioSystemStatus
@@ -55,19 +69,232 @@ private:
         PAUSED
     };
 
+    enum DecodeStatus
+    {
+        IDLE,
+        DECODING,
+        ENDED,
+        FAILED
+    };
+
+    enum MixerStream
+    {
+        MAIN_STREAM,
+        FADING_STREAM,
+        STREAM_COUNT
+    };
+
+    // Sent by the main thread to the decode thread
+    enum CommandType
+    {
+        ACTIVATE,       // Start rendering decoder, crossfade with the previous one over value frames if not 0
+        QUEUE,          // Chain decoder after the active one, crossfade over the last value frames if not 0 and the duration is known
+        CLEAR_QUEUE,    // Release the queued decoder
+        SET_SUBSONG,    // Switch the active decoder to the subsong value
+        SEEK,           // Move the active decoder to value milliseconds
+        STOP            // Release every decoder
+    };
+
+    // Sent by the decode thread to the main thread
+    enum NotificationType
+    {
+        DECODER_RELEASED,   // The decode thread will not touch decoder anymore
+        DECODER_SWITCHED,   // The queued decoder took over previousDecoder playing the track value, heard when the read position reach position.
+                            // previousDecoder is -1 if it is fading out, it will be released once not audible anymore.
+        SONG_ENDED,         // The song end when the read position reach position
+        SUBSONG_CHANGED,    // The active decoder now play the subsong value
+        DECODE_FAILED       // The active decoder failed with message
+    };
+
+    // How a decoder use the PCM cache
+    enum CacheState
+    {
+        CACHE_DISABLED,     // Not cached, the plugin position is the only one that matter
+        CACHE_RECORDING,    // Rendered by the plugin and appended to the cache
+        CACHE_SERVING,      // Read from the cache, the plugin is left where it was
+        CACHE_BYPASS        // Rendered by the plugin somewhere the cache cannot follow, after a seek
+    };
+
+    // Both are copied into lock-free queues, keep them trivially copyable
+    struct Command
+    {
+        CommandType type;
+        int decoder;
+        int value;
+        uint32_t generation;
+        uint32_t flush;
+    };
+
+    struct Notification
+    {
+        NotificationType type;
+        int decoder;
+        int previousDecoder;
+        int value;
+        size_t position;
+        uint32_t generation;
+        char message[256];
+    };
+
+    struct Decoder
+    {
+        // Each decoder own an instance of every plugin, so the next file can be opened while the current one play
+        std::vector<Plugin*> plugins;
+        Plugin* plugin;
+        std::string filename;
+        // Convert from the plugin sample rate to the device one
+        Resampler resampler;
+        // Main thread only, a decoder in use is either being opened or owned by the decode thread until it is released
+        bool inUse;
+        // Identify the rendered sound in the PCM cache, set by the main thread when the file is opened.
+        // The track is the one selected by the last setSubSong, the decode thread update it on SET_SUBSONG.
+        // The track count never change, the main thread read it instead of asking a plugin it does not own.
+        uint64_t contentHash;
+        uint32_t settingsVersion;
+        int track;
+        int trackCount;
+        // Decode thread only, positions in frames at the plugin rate
+        PcmCache::Key cacheKey;
+        CacheState cacheState;
+        size_t position;
+        size_t pluginPosition;
+    };
+
+    struct PendingSwitch
+    {
+        int decoder;
+        int previousDecoder;
+        int track;
+        size_t position;
+    };
+
     Config mConfig;
     SDL_AudioDeviceID mAudioDevice;
-    SDL_mutex* mMutex;
+    SDL_sem* mDecodeSemaphore;
+    SDL_Thread* mDecodeThread;
     Plugin* mCurrentPlugin;
     AudioSystemStatus mPlayStatus;
 
+    // Nothing is shared between threads but lock-free queues and the ring buffer.
+    // The main thread open and close plugins, the decode thread is the only one to render them once they are handed over,
+    // every change to what is rendered go through mCommands and come back through mNotifications.
+    // The SDL audio callback only read from the ring buffer, which already contains samples in the device format.
+    RingBuffer<Command> mCommands;
+    RingBuffer<Notification> mNotifications;
+    std::atomic<bool> mDecodeThreadRunning;
+    std::atomic<size_t> mRenderAheadSize;
+    int mSampleRate;
+    SDL_AudioFormat mDeviceFormat;
+    size_t mDeviceFrameSize;
+    RingBuffer<uint8_t> mRingBuffer;
+
+    // Commands that discard the ring buffer carry a flush number, the audio callback output silence
+    // until the decode thread processed the last one, so nothing rendered before the command is heard.
+    std::atomic<uint32_t> mFlushRequested;
+    std::atomic<uint32_t> mFlushCompleted;
+
+    // Position of the active decoder in milliseconds after the last block, and the ring buffer write position
+    // it correspond to. The main thread deduce the position heard from the ring buffer read position.
+    std::atomic<int> mDecodedPosition;
+    std::atomic<size_t> mDecodedPositionOffset;
+    std::atomic<int> mDuration;
+
+    // Audio callback timings, the callback only use atomics and never allocate.
+    // The jitter is the difference between the time elapsed since the previous callback and the device period.
+    // An underrun is a callback that did not get enough samples while the song was playing, a deadline miss
+    // a callback that left less than one device buffer in the ring buffer, the next one will probably underrun.
+    Histogram mCallbackJitter;
+    std::atomic<uint64_t> mCallbackCount;
+    std::atomic<uint64_t> mUnderrunCount;
+    std::atomic<uint64_t> mDeadlineMissCount;
+    std::atomic<bool> mStreamEnded;
+    std::atomic<bool> mCallbackClockReset;
+    uint64_t mLastCallbackTime;
+    uint64_t mCallbackPeriod;
+    uint64_t mPerformanceFrequency;
+
+    // The device buffer size set how fast play, pause and skip react, the render ahead margin how much
+    // decode jitter can be absorbed. In adaptive mode the margin follow the measured time to decode a block
+    // and grow when the callback miss too many deadlines, the device buffer size is left to the user.
+    Histogram mBlockTimes;
+    size_t mMaxRenderAheadFrames;
+    int mBufferSamples;
+    bool mAdaptiveBuffering;
+    float mAdaptiveElapsed;
+    uint64_t mAdaptiveCallbacks;
+    uint64_t mAdaptiveMisses;
+
+    // Decode thread only
+    DecodeStatus mDecodeStatus;
+    uint32_t mDecodeGeneration;
+    int mActiveDecoder;
+    int mQueuedDecoder;
+    int mQueuedCrossfadeFrames;
+    int mFadingDecoder;
+    std::vector<float> mDecodeBuffer;
+    std::vector<float> mFadeBuffer;
+    std::vector<float> mResampleBuffer;
+    std::vector<uint8_t> mOutputBuffer;
+    Mixer mMixer;
+    PcmCache mPcmCache;
+
+    // Main thread only. mCurrentDecoder is the one heard by the user, the generation is bumped each time
+    // a file is activated or stopped so notifications about a previous file are ignored.
+    // When the queued decoder take over the switch is kept pending until the read position reach it.
+    // The track heard is followed from notifications, plugins belong to the decode thread while they play.
+    Decoder mDecoders[4];
+    int mCurrentDecoder;
+    uint32_t mGeneration;
+    int mPendingTrack;
+    std::optional<size_t> mEndPosition;
+    std::deque<PendingSwitch> mPendingSwitches;
     std::string mCurrentFileLoaded;
-    std::vector<Plugin*> mPlugins;
-    std::optional<AudioSystemErrorEvent> mPendingAudioSystemErrorEvent;
-    std::optional<AudioSystemPlayEvent> mPendingAudioSystemPlayEvent;
+    int mCurrentTrack;
+    int mTrackCount;
+    int mLastPositionSent;
+    int mLastDurationSent;
+    // Files to play coming in a burst are held back, only the last one is opened once they stop
+    std::optional<AudioSystemLoadFileEvent> mDeferredLoad;
+    float mLoadQuietTime;
+    // Set while the deferred load wait for the decode thread to release a decoder
+    std::optional<uint32_t> mDecoderWaitStart;
 
     AudioSystem(const AudioSystem& copy);
 
+    void openAudioDevice(int samples, bool isReopening);
+    size_t getRenderAheadSize(size_t frames) const;
+    void adaptRenderAhead(float deltaTime);
     void stopAudio(ECS::World* world, bool userStop, bool sendEvent);
+    void loadFile(ECS::World* world, const AudioSystemLoadFileEvent& event);
+    void queueFile(ECS::World* world, const AudioSystemLoadFileEvent& event);
+    void changeSubSong(int track);
+    int acquireDecoder();
+    void closeDecoder(int index);
+    void sendCommand(Command command);
+    void processNotifications(ECS::World* world);
+    void processDecoderSwitch(ECS::World* world);
+    void sendPosition(ECS::World* world);
+    void setupResampler(Decoder& decoder);
+
+    bool processCommands();
+    void decodeBlock();
+    void releaseDecoder(int& index);
+    void pushNotification(Notification notification);
+    void pushFailure(const std::exception& exception);
+    void publishPosition();
+    void startCrossfade(size_t frames);
+    void crossfadeQueuedDecoder();
+    void mixDecoders(size_t frames);
+    void writeOutput(size_t frames);
+    bool decode(Decoder& decoder, float* stream, size_t& frames);
+    bool decodeSource(Decoder& decoder, float* stream, size_t& frames);
+    void startCache(Decoder& decoder);
+    void seekDecoder(Decoder& decoder, int position);
+    int getDecoderPosition(Decoder& decoder);
+    uint64_t getElapsedNanoseconds(uint64_t start) const;
+
+    static Plugin* selectPlugin(const Decoder& decoder, std::string path);
+    static std::vector<Plugin*> createPlugins();
+    static int decodeThreadFunc(void* thiz);
     static void audioCallback(void* thiz, uint8_t* stream, int len);
 };
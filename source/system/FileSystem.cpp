@@ -22,9 +22,31 @@
 #include <fmt/ranges.h>
 
 #include "file/LocalMountPoint.h"
+#include "file/FtpMountPoint.h"
+#include "file/HttpMountPoint.h"
+#include "file/ZipMountPoint.h"
+#include "file/PackMountPoint.h"
+#include "file/Decompressor.h"
+#include "file/DirectoryListing.h"
 #include "../config.h"
 
-#define FILE_CHUNK_SIZE 16384 // Size of read buffer when opening a file from a mount point
+#define FILE_CHUNK_SIZE 16384           // Size of read buffer when opening a file from a mount point
+#define DIRECTORY_FIRST_BATCH_ITEMS 256 // Items listed before the first batch is sent, so something show up right away
+#define DIRECTORY_BATCH_ITEMS 8192      // Items listed before each following batch is sent
+#define DIRECTORY_NAME_BYTES 32         // Average name length used to reserve the listing arenas
+#define INTERACTIVE_WORKERS 2           // Threads loading what the user asked for
+#define BACKGROUND_WORKERS 1            // Threads for the work nobody is waiting for
+#define LOAD_DEBOUNCE_SECONDS 0.15f     // Quiet time after a burst of load requests before the last one is started
+#define DEFAULT_PREFETCH_CACHE_MB 64    // Default size of the cache of files read ahead, 0 to disable
+#define MAX_OPEN_ARCHIVES 4             // Archives kept open with their index, the least recently used is closed
+#define DECOMPRESSED_MAX_SIZE 67108864  // Compressed files bigger than this once decompressed are refused
+#define FTP_MOUNTPOINT "ftp:"           // Scheme of the FTP mount point
+#define DEFAULT_FTP_HOST "ftp.modland.com"
+#define DEFAULT_FTP_PORT 21
+#define DEFAULT_FTP_ROOT "/pub/modules"
+#define DEFAULT_FTP_USER "anonymous"
+#define DEFAULT_FTP_PASSWORD "osp@"
+#define HTTP_MOUNTPOINT "http:"         // Scheme of the HTTP mount point
 
 
 FileSystem::FileSystem(Config config, LanguageFile languageFile) :
@@ -32,16 +54,17 @@ ECS::EntitySystem(),
 mConfig(config),
 mLanguageFile(languageFile),
 mWorkerThreadMutex(SDL_CreateMutex()),
-mThreadParams
-({
-    {.thread = nullptr, .status = IDLE, .path = {}},
-    {.thread = nullptr, .status = IDLE, .path = {}}
-})
+mFileGeneration(0),
+mDirectoryGeneration(0),
+mFileQuietTime(LOAD_DEBOUNCE_SECONDS),
+mDirectoryQuietTime(LOAD_DEBOUNCE_SECONDS),
+mArchiveMutex(SDL_CreateMutex())
 {
 }
 
 FileSystem::~FileSystem()
 {
+    SDL_DestroyMutex(mArchiveMutex);
     SDL_DestroyMutex(mWorkerThreadMutex);
 }
 
@@ -49,9 +72,41 @@ void FileSystem::configure(ECS::World* world)
 {
     TRACE(">>>");
 
+    // Interactive threads serve what the user clicked, at most a file and a directory at once
+    mWorkerPool.setup(INTERACTIVE_WORKERS, BACKGROUND_WORKERS);
+    mFileCache.setup((size_t) std::max(mConfig.get("prefetch_cache_mb", DEFAULT_PREFETCH_CACHE_MB), 0) * 1024 * 1024);
+
     // Add mount point
     mMountPoints.push_back(new LocalMountPoint(mLanguageFile.getc("mount_points.default_filesystem"), DEFAULT_MOUNTPOINT));
 
+    // Modland by default, an empty host remove it
+    auto ftpHost = mConfig.get("ftp_host", std::string(DEFAULT_FTP_HOST));
+    if (!ftpHost.empty())
+    {
+        mMountPoints.push_back(new FtpMountPoint(
+            fmt::format("{:s} {:s}", mLanguageFile.getc("mount_points.ftp"), ftpHost),
+            FTP_MOUNTPOINT,
+            ftpHost,
+            (uint16_t) mConfig.get("ftp_port", DEFAULT_FTP_PORT),
+            mConfig.get("ftp_root", std::string(DEFAULT_FTP_ROOT)),
+            mConfig.get("ftp_user", std::string(DEFAULT_FTP_USER)),
+            mConfig.get("ftp_password", std::string(DEFAULT_FTP_PASSWORD))));
+    }
+
+    // Only mounted when an url is given
+    auto httpHost = std::string();
+    auto httpPort = (uint16_t) 0;
+    auto httpRoot = std::string();
+    if (HttpMountPoint::parseUrl(mConfig.get("http_url", std::string()), httpHost, httpPort, httpRoot))
+    {
+        mMountPoints.push_back(new HttpMountPoint(
+            fmt::format("{:s} {:s}", mLanguageFile.getc("mount_points.http"), httpHost),
+            HTTP_MOUNTPOINT,
+            httpHost,
+            httpPort,
+            httpRoot));
+    }
+
     // Initialize all mount point
     for (auto* mountPoint : mMountPoints)
     {
@@ -61,6 +116,8 @@ void FileSystem::configure(ECS::World* world)
     // Subscribe for events
     world->subscribe<FileSystemLoadTaskEvent>(this);
     world->subscribe<FileSystemCancelTaskEvent>(this);
+    world->subscribe<FileSystemPrefetchEvent>(this);
+    world->subscribe<AudioSystemConfiguredEvent>(this);
 
     // Tells everyone what is mounted
     listMountPoints(world);
@@ -73,10 +130,22 @@ void FileSystem::unconfigure(ECS::World* world)
     // Unubscribe for events
     world->unsubscribe<FileSystemLoadTaskEvent>(this);
     world->unsubscribe<FileSystemCancelTaskEvent>(this);
+    world->unsubscribe<FileSystemPrefetchEvent>(this);
+    world->unsubscribe<AudioSystemConfiguredEvent>(this);
+
+    // If we are working stop right now, this is the only place where we wait for the workers
+    cancelFileTask();
+    cancelDirectoryTask();
+    mPrefetchTasks.clear();
+    mWorkerPool.cleanup();
+
+    if (mConfig.get("dump_file_timings", false))
+    {
+        fmt::print("{:s}", getTimingReport());
+    }
 
-    // If we are working stop right now
-    cancelFileThread();
-    cancelDirectoryThread();
+    mFileCache.clear();
+    mArchives.clear();
 
     // Release any resources used by MountPoints
     for (auto* mountPoint : mMountPoints)
@@ -88,6 +157,23 @@ void FileSystem::unconfigure(ECS::World* world)
 
 void FileSystem::tick(ECS::World* world, float deltaTime)
 {
+    // Load what was held back once the requests stopped coming
+    mFileQuietTime += deltaTime;
+    mDirectoryQuietTime += deltaTime;
+    if (mDeferredFileTask.has_value() && mFileQuietTime >= LOAD_DEBOUNCE_SECONDS)
+    {
+        auto event = mDeferredFileTask.value();
+        mDeferredFileTask.reset();
+        startLoadTask(world, event);
+    }
+
+    if (mDeferredDirectoryTask.has_value() && mDirectoryQuietTime >= LOAD_DEBOUNCE_SECONDS)
+    {
+        auto event = mDeferredDirectoryTask.value();
+        mDeferredDirectoryTask.reset();
+        startLoadTask(world, event);
+    }
+
     // Check for pending event probably fired by one of the worker thread
     SDL_LockMutex(mWorkerThreadMutex);
     if (!mPendingFileSystemBusyEvent.empty())
@@ -110,35 +196,41 @@ void FileSystem::tick(ECS::World* world, float deltaTime)
 
     if (mPendingFileLoadedEvent.has_value())
     {
-        world->emit(mPendingFileLoadedEvent.value());
+        // A receiver may request another file, which drop the pending event. Nobody keep the
+        // buffer once the plugin opened it, dropping the last reference here free the file content.
+        auto event = std::move(mPendingFileLoadedEvent.value());
         mPendingFileLoadedEvent.reset();
+        world->emit(event);
     }
 
-    if (mPendingDirectoryLoadedEvent.has_value())
+    if (!mPendingDirectoryLoadedEvents.empty())
     {
-        world->emit(mPendingDirectoryLoadedEvent.value());
-        mPendingDirectoryLoadedEvent.reset();
+        // A receiver may start another listing, which drop the pending batches
+        auto events = std::move(mPendingDirectoryLoadedEvents);
+        mPendingDirectoryLoadedEvents.clear();
+        for (auto& event : events)
+        {
+            world->emit(event);
+        }
     }
     SDL_UnlockMutex(mWorkerThreadMutex);
 }
 
 void FileSystem::listMountPoints(ECS::World* world)
 {
-    auto items = std::vector<DirectoryLoadedEvent::Item>();
+    auto listing = std::make_shared<DirectoryListing>();
     for (auto* mountPoint : mMountPoints)
     {
-        items.push_back
-        ({
-            .isFolder = true,
-            .name = mountPoint->getName(),
-            .size = 0
-        });
+        listing->add(mountPoint->getName(), true, 0, false);
     }
+    listing->sort(DirectorySort::NAME);
 
     world->emit<DirectoryLoadedEvent>
     ({
         .path = "",
-        .items = items
+        .listing = listing,
+        .isFirstBatch = true,
+        .isLastBatch = true
     });
 }
 
@@ -146,54 +238,109 @@ void FileSystem::receive(ECS::World* world, const FileSystemLoadTaskEvent& event
 {
     TRACE("Received FileSystemLoadTaskEvent type {:d}, {:s}", event.type, event.path);
 
-    // Cancel any work
-    ThreadParams* target;
+    // Cancel any work, a request following another one too closely is held back until they stop coming
+    // so scrubbing through a playlist or folders only read the last target
+    auto isBurst = false;
     switch (event.type)
     {
         case FileSystemLoadTaskEvent::LOAD_DIRECTORY:
-            cancelDirectoryThread();
-            target = &mThreadParams[DIRECTORY];
+            cancelDirectoryTask();
+            isBurst = mDirectoryQuietTime < LOAD_DEBOUNCE_SECONDS;
+            mDirectoryQuietTime = 0;
+            if (isBurst)
+            {
+                mDeferredDirectoryTask = event;
+            }
         break;
         case FileSystemLoadTaskEvent::LOAD_FILE:
-            cancelFileThread();
-            target = &mThreadParams[FILE];
+            cancelFileTask();
+            isBurst = mFileQuietTime < LOAD_DEBOUNCE_SECONDS;
+            mFileQuietTime = 0;
+            if (isBurst)
+            {
+                mDeferredFileTask = event;
+            }
         break;
     }
 
-    // Build path to navigate
-    target->path.clear();
-    auto path = std::filesystem::path(event.path);
-    for (auto elm : path)
+    if (isBurst)
     {
-        target->path.push_back(elm);
+        SDL_LockMutex(mWorkerThreadMutex);
+        mPendingFileSystemBusyEvent.push_back(
+        (FileSystemBusyEvent) {
+            .isLoading = true,
+            .type = event.type == FileSystemLoadTaskEvent::LOAD_FILE ? FileSystemBusyEvent::FILE : FileSystemBusyEvent::DIRECTORY
+        });
+        SDL_UnlockMutex(mWorkerThreadMutex);
+        return;
     }
 
-    // Replace the mount point name by his scheme if present
-    for (auto* mountPoint : mMountPoints)
-    {
-        if (target->path[0] == mountPoint->getName())
-        {
-            target->path[0] = mountPoint->getScheme();
-            break;
-        }
-    }
+    startLoadTask(world, event);
+}
 
+void FileSystem::startLoadTask(ECS::World* world, const FileSystemLoadTaskEvent& event)
+{
+    // Build path to navigate
+    auto pathElements = splitPath(event.path);
     if (event.type == FileSystemLoadTaskEvent::LOAD_DIRECTORY)
     {
         // Catch if we request the mount point listing
-        if (target->path.size() == 2 && target->path[1] == "..")
+        if (pathElements.size() == 2 && pathElements[1] == "..")
         {
             listMountPoints(world);
             return;
         }
 
         // Navigate to path
-        target->thread = SDL_CreateThread(workerThreadFuncDirectory, "OSPFILE", this);
+        SDL_LockMutex(mWorkerThreadMutex);
+        auto generation = mDirectoryGeneration;
+        mPendingFileSystemBusyEvent.push_back(
+        (FileSystemBusyEvent) {
+            .isLoading = true,
+            .type = FileSystemBusyEvent::DIRECTORY
+        });
+        SDL_UnlockMutex(mWorkerThreadMutex);
+
+        mDirectoryTask = mWorkerPool.push(WorkerPool::INTERACTIVE,
+            [this, pathElements, generation](const std::atomic<bool>& canceled) { loadDirectory(pathElements, generation, canceled); });
     }
     else if (event.type == FileSystemLoadTaskEvent::LOAD_FILE)
     {
+        // Read ahead files are served on the next tick, even when requested while a FileLoadedEvent
+        // is being dispatched. A request held back by receive() already told that we are loading.
+        auto path = joinPath(pathElements);
+        auto buffer = mFileCache.lookup(path);
+        if (buffer != nullptr)
+        {
+            TRACE("File served from the cache: {:s}.", path.string());
+            SDL_LockMutex(mWorkerThreadMutex);
+            mPendingFileLoadedEvent.emplace(
+            (FileLoadedEvent) {
+                .path = getLoadedPath(path),
+                .buffer = buffer
+            });
+
+            mPendingFileSystemBusyEvent.push_back(
+            (FileSystemBusyEvent) {
+                .isLoading = false,
+                .type = FileSystemBusyEvent::FILE
+            });
+            SDL_UnlockMutex(mWorkerThreadMutex);
+            return;
+        }
+
         // Get the file stored in path
-       target->thread = SDL_CreateThread(workerThreadFuncFile, "OSPDIR", this);
+        SDL_LockMutex(mWorkerThreadMutex);
+        auto generation = mFileGeneration;
+        mPendingFileSystemBusyEvent.push_back(
+        (FileSystemBusyEvent) {
+            .isLoading = true,
+            .type = FileSystemBusyEvent::FILE
+        });
+        SDL_UnlockMutex(mWorkerThreadMutex);
+
+        mFileTask = mWorkerPool.push(WorkerPool::INTERACTIVE,
+            [this, pathElements, generation](const std::atomic<bool>& canceled) { loadFile(pathElements, generation, canceled); });
     }
 }
 
@@ -203,90 +350,205 @@ void FileSystem::receive(ECS::World* world, const FileSystemCancelTaskEvent& eve
     switch (event.type)
     {
         case FileSystemCancelTaskEvent::LOAD_FILE:
-            cancelFileThread();
+            cancelFileTask();
         break;
         case FileSystemCancelTaskEvent::LOAD_DIRECTORY:
-            cancelDirectoryThread();
+            cancelDirectoryTask();
         break;
     }
 }
 
-int FileSystem::workerThreadFuncDirectory(void* thiz)
+void FileSystem::receive(ECS::World* world, const FileSystemPrefetchEvent& event)
 {
-    TRACE("Directory thread alive.");
-    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW) != 0)
+    TRACE("Received FileSystemPrefetchEvent: {:d} file(s).", event.paths.size());
+    if (!mFileCache.isEnabled())
+    {
+        return;
+    }
+
+    // Stop reading what is not wanted anymore, forget what is done
+    for (auto it = mPrefetchTasks.begin(); it != mPrefetchTasks.end();)
     {
-        TRACE("Set SDL_THREAD_PRIORITY_LOW failed");
+        if (std::find(event.paths.begin(), event.paths.end(), it->first) == event.paths.end())
+        {
+            mWorkerPool.cancel(it->second);
+            it = mPrefetchTasks.erase(it);
+        }
+        else if (mFileCache.contains(joinPath(splitPath(it->first))))
+        {
+            it = mPrefetchTasks.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
     }
 
-    auto* fileSystem = (FileSystem*) thiz;
-    auto* threadParams = &fileSystem->mThreadParams[DIRECTORY];
+    for (auto& path : event.paths)
+    {
+        auto pathElements = splitPath(path);
+        if (mPrefetchTasks.count(path) > 0 || mFileCache.contains(joinPath(pathElements)))
+        {
+            continue;
+        }
 
-    // Tells everyone we are working
-    threadParams->status = WORKING;
-    SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-    fileSystem->mPendingFileSystemBusyEvent.push_back(
-    (FileSystemBusyEvent) {
-        .isLoading = true,
-        .type = FileSystemBusyEvent::DIRECTORY
-    });
-    SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
+        mPrefetchTasks[path] = mWorkerPool.push(WorkerPool::BACKGROUND,
+            [this, pathElements](const std::atomic<bool>& canceled) { prefetchFile(pathElements, canceled); });
+    }
+}
 
-    // Select the mount point to use
-    auto* selectedMountPoint = (MountPoint*) nullptr;
-    for (auto* mountPoint : fileSystem->mMountPoints)
+void FileSystem::receive(ECS::World* world, const AudioSystemConfiguredEvent& event)
+{
+    TRACE("Received AudioSystemConfiguredEvent.");
+    for (auto& pluginInformation : event.pluginInformations)
     {
-        if (threadParams->path[0] == mountPoint->getScheme())
+        for (auto& extension : pluginInformation.supportedExtensions)
         {
-            selectedMountPoint = mountPoint;
-            break;
+            mSupportedExtensions.push_back(extension);
+            std::transform(extension.begin(), extension.end(), mSupportedExtensions.back().begin(), ::tolower);
+        }
+    }
+}
+
+std::string FileSystem::getTimingReport()
+{
+    auto report = std::string();
+    for (auto* mountPoint : mMountPoints)
+    {
+        auto& connectTimes = mountPoint->getConnectTimes();
+        if (connectTimes.getCount() > 0)
+        {
+            report += fmt::format("Mount point {:s}: {:d} connections, {:d} / {:d} / {:d} us (avg/p99/max)\n",
+                mountPoint->getName(), connectTimes.getCount(),
+                connectTimes.getMean(), connectTimes.getPercentile(99), connectTimes.getMax());
         }
+
+        auto& firstByteTimes = mountPoint->getFirstByteTimes();
+        auto& transferTimes = mountPoint->getTransferTimes();
+        if (transferTimes.getCount() > 0)
+        {
+            report += fmt::format("Mount point {:s}: {:d} transfers, first byte {:d} / {:d} / {:d} us, total {:d} / {:d} / {:d} us (avg/p99/max)\n",
+                mountPoint->getName(), transferTimes.getCount(),
+                firstByteTimes.getMean(), firstByteTimes.getPercentile(99), firstByteTimes.getMax(),
+                transferTimes.getMean(), transferTimes.getPercentile(99), transferTimes.getMax());
+        }
+    }
+
+    auto lookupCount = mFileCache.getHitCount() + mFileCache.getMissCount();
+    if (lookupCount > 0)
+    {
+        report += fmt::format("File cache: {:d} hit(s) out of {:d} file(s) loaded ({:.1f}%), {:d} KB used\n",
+            mFileCache.getHitCount(), lookupCount, mFileCache.getHitCount() * 100.0 / lookupCount,
+            mFileCache.getMemoryUsage() / 1024);
+    }
+
+    return report;
+}
+
+bool FileSystem::isFileSupported(const std::string& name) const
+{
+    auto dot = name.rfind('.');
+    if (dot == std::string::npos)
+    {
+        return false;
     }
 
+    auto length = name.size() - dot;
+    for (auto& extension : mSupportedExtensions)
+    {
+        if (extension.size() == length && std::equal(extension.begin(), extension.end(), name.begin() + dot,
+            [](char a, char b) { return a == ::tolower((unsigned char) b); }))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FileSystem::loadDirectory(std::vector<std::string> pathElements, uint32_t generation, const std::atomic<bool>& canceled)
+{
+    // Select the mount point to use
+    auto* selectedMountPoint = findMountPoint(pathElements[0]);
+
     if (selectedMountPoint == nullptr)
     {
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingFileSystemErrorEvent.push_back(
-        (FileSystemErrorEvent) {
-            .message = fmt::format("No mountpoint available to open {:s}", threadParams->path.back())
-        });
+        SDL_LockMutex(mWorkerThreadMutex);
+        if (generation == mDirectoryGeneration)
+        {
+            mPendingFileSystemErrorEvent.push_back(
+            (FileSystemErrorEvent) {
+                .message = fmt::format("No mountpoint available to open {:s}", pathElements.back())
+            });
 
-        fileSystem->mPendingFileSystemBusyEvent.push_back(
-        (FileSystemBusyEvent) {
-            .isLoading = true,
-            .type = FileSystemBusyEvent::DIRECTORY
-        });
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
-        return 0;
+            mPendingFileSystemBusyEvent.push_back(
+            (FileSystemBusyEvent) {
+                .isLoading = false,
+                .type = FileSystemBusyEvent::DIRECTORY
+            });
+        }
+        SDL_UnlockMutex(mWorkerThreadMutex);
+        return;
     }
 
-    if (threadParams->path.back() == "..")
+    if (pathElements.back() == "..")
     {
         // We want to go up
-        threadParams->path.pop_back();
-        threadParams->path.pop_back();
+        pathElements.pop_back();
+        pathElements.pop_back();
     }
 
-    auto path = std::filesystem::path();
-    for (auto elm : threadParams->path)
+    auto path = joinPath(pathElements);
+
+    // Entries are sent in sorted batches while the directory is listed, the first one is kept small
+    // so something show up right away. A canceled listing send nothing more.
+    auto failed = false;
+    auto listing = std::make_shared<DirectoryListing>();
+    listing->add("..", true, 0, false);
+    auto isFirstBatch = true;
+    auto sendBatch = [&](bool isLastBatch)
     {
-        path /= elm;
-    }
+        listing->sort(DirectorySort::NAME);
+        SDL_LockMutex(mWorkerThreadMutex);
+        if (generation == mDirectoryGeneration)
+        {
+            mPendingDirectoryLoadedEvents.push_back(
+            (DirectoryLoadedEvent) {
+                .path = path,
+                .listing = listing,
+                .isFirstBatch = isFirstBatch,
+                .isLastBatch = isLastBatch
+            });
+        }
+        SDL_UnlockMutex(mWorkerThreadMutex);
+
+        listing = std::make_shared<DirectoryListing>();
+        listing->reserve(DIRECTORY_BATCH_ITEMS, DIRECTORY_BATCH_ITEMS * DIRECTORY_NAME_BYTES);
+        isFirstBatch = false;
+    };
 
-    auto items = std::vector<DirectoryLoadedEvent::Item>();
     try
     {
-        selectedMountPoint->navigate(
-            path,
+        // Archives are browsed like directories
+        auto mountPointPath = path;
+        auto archive = openArchive(mountPointPath);
+        auto* mountPoint = archive != nullptr ? archive.get() : selectedMountPoint;
+        auto isLocal = archive == nullptr && selectedMountPoint->getScheme() == DEFAULT_MOUNTPOINT;
+        mountPoint->navigate(
+            mountPointPath,
             [&](std::string name, bool isFolder, uintmax_t size)
             {
-                items.push_back
-                ({
-                    .isFolder = isFolder,
-                    .name = name,
-                    .size = size
-                });
-                return threadParams->status != CANCELING;
+                // Archives are only opened from the local file system, not from another archive
+                auto isArchiveFile = isLocal && !isFolder && isArchive(name);
+                // Compressed files are playable if what they contain is
+                auto isPlayable = !isFolder && !isArchiveFile && (isFileSupported(name) || isFileSupported(Decompressor::getInnerName(name)));
+                listing->add(name, isFolder || isArchiveFile, size, isPlayable);
+                if (!canceled && listing->getCount() >= (isFirstBatch ? DIRECTORY_FIRST_BATCH_ITEMS : DIRECTORY_BATCH_ITEMS))
+                {
+                    sendBatch(false);
+                }
+
+                return !canceled;
             });
     }
     catch(const std::exception& e)
@@ -296,207 +558,403 @@ int FileSystem::workerThreadFuncDirectory(void* thiz)
         TRACE("{:s}.", error);
 
         // Send a notification event if something goes wrong
-        threadParams->status = CANCELING;
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingFileSystemErrorEvent.push_back(
-        (FileSystemErrorEvent) {
-            .message = error
-        });
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
+        failed = true;
+        SDL_LockMutex(mWorkerThreadMutex);
+        if (generation == mDirectoryGeneration)
+        {
+            mPendingFileSystemErrorEvent.push_back(
+            (FileSystemErrorEvent) {
+                .message = error
+            });
+        }
+        SDL_UnlockMutex(mWorkerThreadMutex);
     }
 
-    // If not cancelled sort by folder and filename asc then add back navigation
-    if (threadParams->status != CANCELING)
+    if (!canceled && !failed)
     {
-        std::sort(items.begin(), items.end(),
-        [](auto a, auto b)
-        {
-            if (a.isFolder != b.isFolder)
-            {
-                return a.isFolder;
-            }
-
-            std::transform(a.name.begin(), a.name.end(), a.name.begin(), ::tolower);
-            std::transform(b.name.begin(), b.name.end(), b.name.begin(), ::tolower);
-            return a.name < b.name;
-        });
-
-        items.insert(items.begin(),
-        {
-            .isFolder = true,
-            .name = "..",
-            .size = 0
-        });
+        // Tells to everyone what was left in the directory and we stopped working
+        sendBatch(true);
     }
 
-    if (threadParams->status != CANCELING)
+    // Tells to everyone that we are finished working
+    SDL_LockMutex(mWorkerThreadMutex);
+    if (generation == mDirectoryGeneration)
     {
-        // Tells to everyone what was in the directory and we stopped working
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingDirectoryLoadedEvent.emplace(
-        (DirectoryLoadedEvent) {
-            .path = path,
-            .items = items
-        });
-
-        fileSystem->mPendingFileSystemBusyEvent.push_back(
+        mPendingFileSystemBusyEvent.push_back(
         (FileSystemBusyEvent) {
             .isLoading = false,
             .type = FileSystemBusyEvent::DIRECTORY
         });
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
     }
-    else
+    SDL_UnlockMutex(mWorkerThreadMutex);
+}
+
+void FileSystem::loadFile(std::vector<std::string> pathElements, uint32_t generation, const std::atomic<bool>& canceled)
+{
+    // Select mountpoint to use
+    auto* selectedMountPoint = findMountPoint(pathElements[0]);
+
+    if (selectedMountPoint == nullptr)
     {
-        // Tells to everyone that we are finished working
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingFileSystemBusyEvent.push_back(
-        (FileSystemBusyEvent) {
-            .isLoading = false,
-            .type = FileSystemBusyEvent::DIRECTORY
-        });
+        auto error = fmt::format("No mountpoint available to open {:s}", pathElements.back());
+        TRACE("{:s}.", error);
 
-        // Restore old path
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
+        // Send a notification event if something goes wrong
+        SDL_LockMutex(mWorkerThreadMutex);
+        if (generation == mFileGeneration)
+        {
+            mPendingFileSystemErrorEvent.push_back(
+            (FileSystemErrorEvent) {
+                .message = error
+            });
+
+            mPendingFileSystemBusyEvent.push_back(
+            (FileSystemBusyEvent) {
+                .isLoading = false,
+                .type = FileSystemBusyEvent::FILE
+            });
+        }
+        SDL_UnlockMutex(mWorkerThreadMutex);
+        return;
     }
 
-    threadParams->status = IDLE;
-    return 0;
-}
+    auto path = joinPath(pathElements);
 
-int FileSystem::workerThreadFuncFile(void* thiz)
-{
-    TRACE("File thread alive.");
-    if (SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW) != 0)
+    auto failed = false;
+    auto fileBuffer = std::make_shared<FileBuffer>();
+    try
     {
-        TRACE("Set SDL_THREAD_PRIORITY_LOW failed");
+        readFile(selectedMountPoint, path, *fileBuffer, canceled);
+        fileBuffer = decompressFile(path, fileBuffer, canceled);
+        if (!canceled)
+        {
+            // The audio system identify the file by its content, the whole file is read so not on the main thread
+            fileBuffer->updateHash();
+        }
     }
+    catch(const std::exception& e)
+    {
+        auto error = e.what();
+
+        TRACE("{:s}.", error);
+        failed = true;
 
-    auto fileSystem = (FileSystem*) thiz;
-    auto* threadParams = &fileSystem->mThreadParams[FILE];
+        // Send a notification event if something goes wrong
+        SDL_LockMutex(mWorkerThreadMutex);
+        if (generation == mFileGeneration)
+        {
+            mPendingFileSystemErrorEvent.push_back(
+            (FileSystemErrorEvent) {
+                .message = error
+            });
+        }
+        SDL_UnlockMutex(mWorkerThreadMutex);
+    }
 
-    // Tells everyone we are working
-    threadParams->status = WORKING;
-    SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-    fileSystem->mPendingFileSystemBusyEvent.push_back(
-    (FileSystemBusyEvent) {
-        .isLoading = true,
-        .type = FileSystemBusyEvent::FILE
-    });
-    SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
+    if (!canceled && !failed && mFileCache.isEnabled())
+    {
+        // Going back to it later will not read it again
+        mFileCache.insert(path, fileBuffer);
+    }
 
-    // Select mountpoint to use
-    auto* selectedMountPoint = (MountPoint*) nullptr;
-    for (auto* mountPoint : fileSystem->mMountPoints)
+    if (!canceled && !failed)
     {
-        if (threadParams->path[0] == mountPoint->getScheme())
+        // If not canceled tells to everyone that a file was read and we are now not working
+        SDL_LockMutex(mWorkerThreadMutex);
+        if (generation == mFileGeneration)
         {
-            selectedMountPoint = mountPoint;
-            break;
+            mPendingFileLoadedEvent.emplace(
+            (FileLoadedEvent) {
+                .path = getLoadedPath(path),
+                .buffer = fileBuffer
+            });
+
+            mPendingFileSystemBusyEvent.push_back(
+            (FileSystemBusyEvent) {
+                .isLoading = false,
+                .type = FileSystemBusyEvent::FILE
+            });
         }
+        SDL_UnlockMutex(mWorkerThreadMutex);
     }
+    else
+    {
+        // If  canceled tells to everyone we are now not working
+        SDL_LockMutex(mWorkerThreadMutex);
+        if (generation == mFileGeneration)
+        {
+            mPendingFileSystemBusyEvent.push_back(
+            (FileSystemBusyEvent) {
+                .isLoading = false,
+                .type = FileSystemBusyEvent::FILE
+            });
+        }
+        SDL_UnlockMutex(mWorkerThreadMutex);
+    }
+}
 
+void FileSystem::prefetchFile(std::vector<std::string> pathElements, const std::atomic<bool>& canceled)
+{
+    auto* selectedMountPoint = findMountPoint(pathElements[0]);
     if (selectedMountPoint == nullptr)
     {
-        auto error = fmt::format("No mountpoint available to open {:s}", threadParams->path.back());
-        TRACE("{:s}.", error);
+        return;
+    }
 
-        // Send a notification event if something goes wrong
-        threadParams->status = CANCELING;
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingFileSystemErrorEvent.push_back(
-        (FileSystemErrorEvent) {
-            .message = error
-        });
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
-        return 0;
+    auto path = joinPath(pathElements);
+    auto fileBuffer = std::make_shared<FileBuffer>();
+    try
+    {
+        readFile(selectedMountPoint, path, *fileBuffer, canceled);
+        fileBuffer = decompressFile(path, fileBuffer, canceled);
+        if (!canceled)
+        {
+            // The audio system identify the file by its content, the whole file is read so not on the main thread
+            fileBuffer->updateHash();
+        }
+    }
+    catch(const std::exception& e)
+    {
+        // Nobody is waiting for this file, the error will show up if it is really loaded
+        TRACE("Prefetch failed: {:s}.", e.what());
+        return;
     }
 
-    auto path = std::filesystem::path();
-    for (auto elm : threadParams->path)
+    if (!canceled)
     {
-        path /= elm;
+        mFileCache.insert(path, fileBuffer);
     }
+}
 
-    auto fileBuffer = std::vector<uint8_t>();
-    try
+std::shared_ptr<FileBuffer> FileSystem::decompressFile(const std::filesystem::path& path, std::shared_ptr<FileBuffer> fileBuffer,
+    const std::atomic<bool>& canceled) const
+{
+    // Plugins reading compressed files by themselves (vgz...) get them as they are
+    if (canceled || isFileSupported(path.filename().string()))
+    {
+        return fileBuffer;
+    }
+
+    auto format = Decompressor::detect(fileBuffer->getData(), fileBuffer->getSize());
+    if (format == Decompressor::NONE)
+    {
+        return fileBuffer;
+    }
+
+    auto output = std::make_shared<FileBuffer>();
+    Decompressor::decompress(format, fileBuffer->getData(), fileBuffer->getSize(), *output, DECOMPRESSED_MAX_SIZE, canceled);
+    return output;
+}
+
+std::filesystem::path FileSystem::getLoadedPath(const std::filesystem::path& path) const
+{
+    // The plugin is selected from the name of what was inside the compressed file
+    auto name = path.filename().string();
+    if (isFileSupported(name))
+    {
+        return path;
+    }
+
+    return path.parent_path() / Decompressor::getInnerName(name);
+}
+
+void FileSystem::readFile(MountPoint* mountPoint, const std::filesystem::path& path, FileBuffer& fileBuffer, const std::atomic<bool>& canceled)
+{
+    // Archive members are inflated from the archive
+    auto mountPointPath = path;
+    auto archive = openArchive(mountPointPath);
+    if (archive != nullptr)
+    {
+        mountPoint = archive.get();
+    }
+
+    // Mapped files are handed over as they are, others are read chunk by chunk
+    if (!mountPoint->mapFile(mountPointPath, fileBuffer.getMappedFile()))
     {
-        selectedMountPoint->getFile(
-            path,
+        mountPoint->getFile(
+            mountPointPath,
             FILE_CHUNK_SIZE,
             [&](const std::vector<uint8_t>& chunkBuffer)
             {
-                fileBuffer.insert(fileBuffer.end(), chunkBuffer.begin(), chunkBuffer.end());
-                return threadParams->status != CANCELING;
+                fileBuffer.append(chunkBuffer.data(), chunkBuffer.size());
+                return !canceled;
             });
     }
-    catch(const std::exception& e)
+}
+
+bool FileSystem::isArchive(const std::string& name)
+{
+    auto dot = name.rfind('.');
+    if (dot == std::string::npos)
     {
-        auto error = e.what();
+        return false;
+    }
 
-        TRACE("{:s}.", error);
-        threadParams->status = CANCELING;
+    auto extension = name.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension == ".zip" || extension == ".osp";
+}
 
-        // Send a notification event if something goes wrong
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingFileSystemErrorEvent.push_back(
-        (FileSystemErrorEvent) {
-            .message = error
-        });
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
+std::shared_ptr<MountPoint> FileSystem::openArchive(std::filesystem::path& path)
+{
+    // Look for an archive stored on the local file system along the path
+    auto archivePath = std::filesystem::path();
+    for (auto element = path.begin(); element != path.end(); ++element)
+    {
+        archivePath /= *element;
+        auto error = std::error_code();
+        if (!isArchive(element->string()) || !std::filesystem::is_regular_file(archivePath, error))
+        {
+            continue;
+        }
+
+        // What follow is the path inside the archive
+        auto archiveMemberPath = std::filesystem::path();
+        for (++element; element != path.end(); ++element)
+        {
+            archiveMemberPath /= *element;
+        }
+
+        SDL_LockMutex(mArchiveMutex);
+        auto archive = std::find_if(mArchives.begin(), mArchives.end(),
+            [&archivePath](const std::shared_ptr<MountPoint>& mountPoint) { return mountPoint->getScheme() == archivePath.string(); });
+
+        auto mountPoint = std::shared_ptr<MountPoint>();
+        if (archive != mArchives.end())
+        {
+            mountPoint = *archive;
+            mArchives.erase(archive);
+        }
+        else
+        {
+            // Reading the index take a while for big archives, other workers wait for it instead of reading it too
+            try
+            {
+                auto name = archivePath.filename().string();
+                auto extension = archivePath.extension().string();
+                std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+                if (extension == ".osp")
+                {
+                    mountPoint = std::make_shared<PackMountPoint>(name, archivePath.string());
+                }
+                else
+                {
+                    mountPoint = std::make_shared<ZipMountPoint>(name, archivePath.string());
+                }
+                mountPoint->setup();
+            }
+            catch(...)
+            {
+                SDL_UnlockMutex(mArchiveMutex);
+                throw;
+            }
+        }
+
+        // Most recently used first, a worker may still hold the one dropped
+        mArchives.insert(mArchives.begin(), mountPoint);
+        if (mArchives.size() > MAX_OPEN_ARCHIVES)
+        {
+            mArchives.pop_back();
+        }
+        SDL_UnlockMutex(mArchiveMutex);
+
+        path = archiveMemberPath;
+        return mountPoint;
     }
 
-    if (threadParams->status != CANCELING)
+    return nullptr;
+}
+
+MountPoint* FileSystem::findMountPoint(const std::string& scheme) const
+{
+    for (auto* mountPoint : mMountPoints)
     {
-        // If not canceled tells to everyone that a file was read and we are now not working
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingFileLoadedEvent.emplace(
-        (FileLoadedEvent) {
-            .path = path,
-            .buffer = fileBuffer
-        });
+        if (scheme == mountPoint->getScheme())
+        {
+            return mountPoint;
+        }
+    }
 
-        fileSystem->mPendingFileSystemBusyEvent.push_back(
-        (FileSystemBusyEvent) {
-            .isLoading = false,
-            .type = FileSystemBusyEvent::FILE
-        });
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
+    return nullptr;
+}
+
+std::vector<std::string> FileSystem::splitPath(const std::string& path) const
+{
+    auto pathElements = std::vector<std::string>();
+    for (auto elm : std::filesystem::path(path))
+    {
+        pathElements.push_back(elm);
     }
-    else
+
+    // Replace the mount point name by his scheme if present
+    for (auto* mountPoint : mMountPoints)
     {
-        // If  canceled tells to everyone we are now not working
-        SDL_LockMutex(fileSystem->mWorkerThreadMutex);
-        fileSystem->mPendingFileSystemBusyEvent.push_back(
-        (FileSystemBusyEvent) {
-            .isLoading = false,
-            .type = FileSystemBusyEvent::FILE
-        });
-        SDL_UnlockMutex(fileSystem->mWorkerThreadMutex);
+        if (pathElements[0] == mountPoint->getName())
+        {
+            pathElements[0] = mountPoint->getScheme();
+            break;
+        }
+    }
+
+    return pathElements;
+}
+
+std::filesystem::path FileSystem::joinPath(const std::vector<std::string>& pathElements)
+{
+    auto path = std::filesystem::path();
+    for (auto elm : pathElements)
+    {
+        path /= elm;
     }
 
-    threadParams->status = IDLE;
-    return 0;
+    return path;
 }
 
-void FileSystem::cancelFileThread()
+void FileSystem::cancelFileTask()
 {
-    if (mThreadParams[FILE].thread != nullptr)
+    // Never wait here, a read stuck on slow media would freeze the whole UI. Whatever the
+    // canceled task still produces is dropped since its generation is not the current one anymore.
+    SDL_LockMutex(mWorkerThreadMutex);
+    ++mFileGeneration;
+    mPendingFileLoadedEvent.reset();
+    if (mFileTask != nullptr || mDeferredFileTask.has_value())
     {
-        mThreadParams[FILE].status = CANCELING;
-        SDL_WaitThread(mThreadParams[FILE].thread, nullptr);
-        TRACE("Waiting file worker thread to finish...");
-        mThreadParams[FILE].thread = nullptr;
+        if (mFileTask != nullptr)
+        {
+            mWorkerPool.cancel(mFileTask);
+            mFileTask.reset();
+        }
+
+        mDeferredFileTask.reset();
+        mPendingFileSystemBusyEvent.push_back(
+        (FileSystemBusyEvent) {
+            .isLoading = false,
+            .type = FileSystemBusyEvent::FILE
+        });
     }
+    SDL_UnlockMutex(mWorkerThreadMutex);
 }
 
-void FileSystem::cancelDirectoryThread()
+void FileSystem::cancelDirectoryTask()
 {
-    if (mThreadParams[DIRECTORY].thread != nullptr)
+    // Same as above, batches of the canceled listing must not be merged with the next one
+    SDL_LockMutex(mWorkerThreadMutex);
+    ++mDirectoryGeneration;
+    mPendingDirectoryLoadedEvents.clear();
+    if (mDirectoryTask != nullptr || mDeferredDirectoryTask.has_value())
     {
-        mThreadParams[DIRECTORY].status = CANCELING;
-        SDL_WaitThread(mThreadParams[DIRECTORY].thread, nullptr);
-        TRACE("Waiting directory worker thread to finish...");
-        mThreadParams[DIRECTORY].thread = nullptr;
+        if (mDirectoryTask != nullptr)
+        {
+            mWorkerPool.cancel(mDirectoryTask);
+            mDirectoryTask.reset();
+        }
+
+        mDeferredDirectoryTask.reset();
+        mPendingFileSystemBusyEvent.push_back(
+        (FileSystemBusyEvent) {
+            .isLoading = false,
+            .type = FileSystemBusyEvent::DIRECTORY
+        });
     }
+    SDL_UnlockMutex(mWorkerThreadMutex);
 }
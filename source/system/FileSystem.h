@@ -16,28 +16,37 @@
  */
 #pragma once
 
+#include <map>
+#include <memory>
 #include <vector>
 #include <string>
 #include <optional>
+#include <filesystem>
 
 #include <SDL2/SDL.h>
 #include <ECS.h>
 
 #include "file/MountPoint.h"
+#include "file/FileCache.h"
 #include "../event/file/FileSystemLoadTaskEvent.h"
 #include "../event/file/DirectoryLoadedEvent.h"
 #include "../event/file/FileLoadedEvent.h"
 #include "../event/file/FileSystemBusyEvent.h"
 #include "../event/file/FileSystemCancelTaskEvent.h"
+#include "../event/file/FileSystemPrefetchEvent.h"
 #include "../event/file/FileSystemErrorEvent.h"
+#include "../event/audio/AudioSystemConfiguredEvent.h"
 #include "../tools/ConfigFile.h"
 #include "../tools/LanguageFile.h"
+#include "../tools/WorkerPool.h"
 
 
 class FileSystem :
 public ECS::EntitySystem,
 public ECS::EventSubscriber<FileSystemLoadTaskEvent>,
-public ECS::EventSubscriber<FileSystemCancelTaskEvent>
+public ECS::EventSubscriber<FileSystemCancelTaskEvent>,
+public ECS::EventSubscriber<FileSystemPrefetchEvent>,
+public ECS::EventSubscriber<AudioSystemConfiguredEvent>
 {
 public:
     FileSystem(Config config, LanguageFile languageFile);
@@ -49,44 +58,62 @@ public:
 
     virtual void receive(ECS::World* world, const FileSystemLoadTaskEvent& event) override;
     virtual void receive(ECS::World* world, const FileSystemCancelTaskEvent& event) override;
+    virtual void receive(ECS::World* world, const FileSystemPrefetchEvent& event) override;
+    virtual void receive(ECS::World* world, const AudioSystemConfiguredEvent& event) override;
 
-private:
-    enum WorkThreadStatus
-    {
-        IDLE,
-        WORKING,
-        CANCELING
-    };
-
-    enum Thread
-    {
-        FILE,
-        DIRECTORY
-    };
-
-    struct ThreadParams
-    {
-        SDL_Thread* thread;
-        WorkThreadStatus status;
-        std::vector<std::string> path;
-    };
+    // Network timings of the remote mount points in a human readable form, for logs or headless runs
+    std::string getTimingReport();
 
+private:
     Config mConfig;
     LanguageFile mLanguageFile;
     SDL_mutex* mWorkerThreadMutex;
-    ThreadParams mThreadParams[2];
+    WorkerPool mWorkerPool;
+    WorkerPool::CancelToken mFileTask;
+    WorkerPool::CancelToken mDirectoryTask;
+    // Bumped on each cancel, results of an older generation are dropped
+    uint32_t mFileGeneration;
+    uint32_t mDirectoryGeneration;
+    // Requests coming in bursts are held back, only the last one is started once they stop
+    std::optional<FileSystemLoadTaskEvent> mDeferredFileTask;
+    std::optional<FileSystemLoadTaskEvent> mDeferredDirectoryTask;
+    float mFileQuietTime;
+    float mDirectoryQuietTime;
+    // Read ahead on the background lane, by path as asked
+    FileCache mFileCache;
+    std::map<std::string, WorkerPool::CancelToken> mPrefetchTasks;
+    // Archives opened by the workers
+    SDL_mutex* mArchiveMutex;
+    std::vector<std::shared_ptr<MountPoint>> mArchives;
 
     std::vector<MountPoint*> mMountPoints;
+    // Set once at startup before any worker run, lower case with the leading dot
+    std::vector<std::string> mSupportedExtensions;
     std::vector<FileSystemBusyEvent> mPendingFileSystemBusyEvent;
     std::vector<FileSystemErrorEvent> mPendingFileSystemErrorEvent;
-    std::optional<DirectoryLoadedEvent> mPendingDirectoryLoadedEvent;
+    std::vector<DirectoryLoadedEvent> mPendingDirectoryLoadedEvents;
     std::optional<FileLoadedEvent> mPendingFileLoadedEvent;
 
     FileSystem(const FileSystem& copy);
 
-    void cancelFileThread();
-    void cancelDirectoryThread();
+    void startLoadTask(ECS::World* world, const FileSystemLoadTaskEvent& event);
+    void cancelFileTask();
+    void cancelDirectoryTask();
     void listMountPoints(ECS::World* world);
-    static int workerThreadFuncDirectory(void* thiz);
-    static int workerThreadFuncFile(void* thiz);
+    bool isFileSupported(const std::string& name) const;
+    void loadDirectory(std::vector<std::string> pathElements, uint32_t generation, const std::atomic<bool>& canceled);
+    void loadFile(std::vector<std::string> pathElements, uint32_t generation, const std::atomic<bool>& canceled);
+    void prefetchFile(std::vector<std::string> pathElements, const std::atomic<bool>& canceled);
+    MountPoint* findMountPoint(const std::string& scheme) const;
+    std::vector<std::string> splitPath(const std::string& path) const;
+    static std::filesystem::path joinPath(const std::vector<std::string>& pathElements);
+    void readFile(MountPoint* mountPoint, const std::filesystem::path& path, FileBuffer& fileBuffer, const std::atomic<bool>& canceled);
+    // Return the decompressed content of fileBuffer if it is wrapped in gz, xz or zstd, or fileBuffer itself
+    std::shared_ptr<FileBuffer> decompressFile(const std::filesystem::path& path, std::shared_ptr<FileBuffer> fileBuffer,
+        const std::atomic<bool>& canceled) const;
+    // Path given to the audio system, without the compression extension
+    std::filesystem::path getLoadedPath(const std::filesystem::path& path) const;
+    // Return the archive found in path and make path relative to it, or nullptr
+    std::shared_ptr<MountPoint> openArchive(std::filesystem::path& path);
+    static bool isArchive(const std::string& name);
 };
@@ -29,10 +29,14 @@
 #include "audio/Plugin.h"
 #include "../event/file/FileSystemLoadTaskEvent.h"
 #include "../event/file/FileSystemCancelTaskEvent.h"
+#include "../event/file/FileSystemPrefetchEvent.h"
 #include "../event/audio/AudioSystemPlayTaskEvent.h"
 #include "../event/audio/AudioSystemLoadFileEvent.h"
+#include "../event/audio/AudioSystemBufferChangeEvent.h"
 #include "../config.h"
 
+#define DEFAULT_PREFETCH_COUNT 3        // Default number of playlist items read ahead of the current one
+
 UiSystem::UiSystem(Config config, LanguageFile languageFile, SDL_Window* window) :
 ECS::EntitySystem(),
 mWindow(window),
@@ -41,11 +45,12 @@ mLanguageFile(languageFile),
 mAudioSystemStatus(STOPPED),
 mPlaylist
 ({
-    .index = -1, .inUse = false, .loop = false
+    .index = -1, .queuedIndex = -1, .inUse = false, .loop = false
 }),
 mLoadDirectoryParams
 ({
-    .addToPlaylist = false
+    .addToPlaylist = false,
+    .playlistListing = std::make_shared<DirectoryListing>()
 }),
 mShowWorkSpace(true),
 mShowDemoWindow(false),
@@ -54,7 +59,11 @@ mShowSettingsWindow(false),
 mShowAboutWindow(false),
 mIsLoadingDirectory(false),
 mIsLoadingFile(false),
-mNotificationDisplayTimeMs(5000)
+mNotificationDisplayTimeMs(5000),
+mPlaybackPosition(0),
+mPlaybackDuration(0),
+mSeekPosition(-1),
+mCurrentListing(std::make_shared<DirectoryListing>())
 {
 }
 
@@ -135,6 +144,7 @@ void UiSystem::configure(ECS::World* world)
 
     // Playlist have no selection
     mPlaylist.index = -1;
+    mPlaylist.queuedIndex = -1;
     mPlaylist.loop = false;
     mPlaylist.inUse = false;
 
@@ -147,6 +157,7 @@ void UiSystem::configure(ECS::World* world)
     world->subscribe<AudioSystemConfiguredEvent>(this);
     world->subscribe<AudioSystemPlayEvent>(this);
     world->subscribe<AudioSystemErrorEvent>(this);
+    world->subscribe<AudioSystemPositionEvent>(this);
 
     mStatusMessage = mLanguageFile.get("status.ready");
 }
@@ -164,6 +175,7 @@ void UiSystem::unconfigure(ECS::World* world)
     world->unsubscribe<AudioSystemConfiguredEvent>(this);
     world->unsubscribe<AudioSystemPlayEvent>(this);
     world->unsubscribe<AudioSystemErrorEvent>(this);
+    world->unsubscribe<AudioSystemPositionEvent>(this);
 
     // Release the texture atlas resources
     mIconAtlas.cleanup();
@@ -293,20 +305,23 @@ void UiSystem::tick(ECS::World* world, float deltaTime)
             // Save cursor position & draw visible rows
             auto savedWindowPos = ImGui::GetWindowPos();
             auto savedWindowSize = ImGui::GetWindowSize();
-            auto clipper = ImGuiListClipper(mCurrentPathItems.size());
+            // Selecting a row can replace the listing, keep this one alive until the table is drawn
+            auto currentListing = mCurrentListing;
+            auto& listing = *currentListing;
+            auto clipper = ImGuiListClipper(listing.getCount());
             while (clipper.Step())
             {
                 for (auto row=clipper.DisplayStart; row<clipper.DisplayEnd; ++row)
                 {
-                    auto& item = mCurrentPathItems[row];
-                    auto rowId = item.name.c_str();
+                    auto rowId = listing.getName(row);
                     auto rowIsSelected = ImGui::IsPopupOpen(rowId);
+                    auto isFolder = listing.isFolder(row);
 
                     // Column 1 - File icon+name
                     ImGui::TableNextColumn();
-                    if (item.isFolder)
+                    if (isFolder)
                     {
-                        ImGui::TextColored(style.Colors[ImGuiCol_PlotHistogram], item.name == ".." ? "\uf259" : "\uf24b");
+                        ImGui::TextColored(style.Colors[ImGuiCol_PlotHistogram], listing.isParent(row) ? "\uf259" : "\uf24b");
                     }
                     else
                     {
@@ -316,37 +331,37 @@ void UiSystem::tick(ECS::World* world, float deltaTime)
                     ImGui::SameLine();
                     if (ImGui::Selectable(rowId, rowIsSelected, ImGuiSelectableFlags_SpanAllColumns))
                     {
-                        if (item.isFolder || isFileSupported(item.name))
+                        if (isFolder || listing.isPlayable(row))
                         {
-                            processFileItemSelection(world, item, false);
+                            processFileItemSelection(world, rowId, isFolder, false);
                         }
                         else
                         {
                             // The file is not usable by any audio plugin
-                            auto message = fmt::format("{:s} {:s}", mLanguageFile.getc("files.unsupported_file_type"), item.name);
+                            auto message = fmt::format("{:s} {:s}", mLanguageFile.getc("files.unsupported_file_type"), rowId);
                             pushNotification(Notification::INFO, message);
                             TRACE("{:s}", message);
                         }
                     }
 
                     // Context menu (right click)
-                    auto disabled = item.name == ".." || mCurrentPathItems.size() == 1;
+                    auto disabled = listing.isParent(row) || listing.getCount() == 1;
                     if (!disabled && ImGui::BeginPopupContextItem(rowId, ImGuiPopupFlags_MouseButtonRight))
                     {
                         auto textAddToPlaylist =  mLanguageFile.getc("add_to_playlist");
                         auto menuItemId = fmt::format("\uf416 {:s}", textAddToPlaylist);
-                        if (ImGui::MenuItem(menuItemId.c_str(), nullptr, false, item.isFolder || isFileSupported(item.name)))
+                        if (ImGui::MenuItem(menuItemId.c_str(), nullptr, false, isFolder || listing.isPlayable(row)))
                         {
-                            processFileItemSelection(world, item, true);
+                            processFileItemSelection(world, rowId, isFolder, true);
                         }
                         ImGui::EndPopup();
                     }
 
                     // Column 2 - File size
                     ImGui::TableNextColumn();
-                    if (!item.isFolder)
+                    if (!isFolder)
                     {
-                        auto fileSizeStr = fmt::format("{:d} Kb ", (uint32_t) (item.size / 1024));
+                        auto fileSizeStr = fmt::format("{:d} Kb ", (uint32_t) (listing.getSize(row) / 1024));
                         ImGui::Text("%s", fileSizeStr.c_str());
                     }
                     else
@@ -484,6 +499,40 @@ void UiSystem::tick(ECS::World* world, float deltaTime)
         }
         ImGui::PopID();
 
+        // ----------------------------------------------------------
+        // ----------------------------------------------------------
+        // Right panel - seek bar, the AudioSystem is asked to seek only when the user release it
+        auto canSeek = mCurrentPluginUsed.has_value() && mPlaybackDuration > 0;
+        auto seekPosition = mSeekPosition != -1 ? mSeekPosition : std::min(mPlaybackPosition, mPlaybackDuration);
+        auto seekLabel = canSeek
+            ? fmt::format("{:d}:{:02d} / {:d}:{:02d}", seekPosition / 60000, seekPosition / 1000 % 60, mPlaybackDuration / 60000, mPlaybackDuration / 1000 % 60)
+            : fmt::format("{:d}:{:02d}", mPlaybackPosition / 60000, mPlaybackPosition / 1000 % 60);
+
+        ImGui::Spacing();
+        ImGui::SetNextItemWidth(ImGui::GetContentRegionAvailWidth());
+        if (!canSeek)
+        {
+            ImGui::PushStyleVar(ImGuiStyleVar_Alpha, style.Alpha * 0.5f);
+        }
+        if (ImGui::SliderInt("##seekBar", &seekPosition, 0, std::max(mPlaybackDuration, 1), seekLabel.c_str()) && canSeek)
+        {
+            mSeekPosition = seekPosition;
+        }
+        if (ImGui::IsItemDeactivated() && mSeekPosition != -1)
+        {
+            world->emit<AudioSystemPlayTaskEvent>
+            ({
+                .type = AudioSystemPlayTaskEvent::SEEK,
+                .position = mSeekPosition
+            });
+            mPlaybackPosition = mSeekPosition;
+            mSeekPosition = -1;
+        }
+        if (!canSeek)
+        {
+            ImGui::PopStyleVar();
+        }
+
         // ----------------------------------------------------------
         // ----------------------------------------------------------
         // Right panel - track information if a song is loaded (wrapped in a frame)
@@ -567,7 +616,7 @@ void UiSystem::tick(ECS::World* world, float deltaTime)
                 if (ImGui::SmallButton("\uf49f"))
                 {
                     // Shuffle playlist
-                    resetPlaylist(false);
+                    resetPlaylist(world, false);
 
                     auto rng = std::default_random_engine {};
                     std::shuffle(std::begin(mPlaylist.paths), std::end(mPlaylist.paths), rng);
@@ -575,7 +624,7 @@ void UiSystem::tick(ECS::World* world, float deltaTime)
                 ImGui::SameLine();
                 if (ImGui::SmallButton("\uf413"))
                 {
-                    resetPlaylist(true);
+                    resetPlaylist(world, true);
                 }
                 ImGui::SameLine();
                 ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(0,0));
@@ -634,7 +683,7 @@ void UiSystem::tick(ECS::World* world, float deltaTime)
                             ImGui::TableNextColumn();
                             if (ImGui::SmallButton(buttonDeleteId.c_str()))
                             {
-                                removeItemFromPlaylist(row);
+                                removeItemFromPlaylist(world, row);
                             }
                         }
                     }
@@ -823,12 +872,82 @@ void UiSystem::tick(ECS::World* world, float deltaTime)
                 }
             }
 
+            // Only the current listing is sorted again, the directory is not read again
+            auto sortOrder = (int) getSortOrder();
+            if (ImGui::Combo(mLanguageFile.getc("settings.sort_order"), &sortOrder, "Name\0Size\0Extension\0"))
+            {
+                mConfig.set("sort_order", sortOrder);
+                mCurrentListing->sort((DirectorySort::Order) sortOrder);
+            }
+
             auto alwaysStartFirstTrack = mConfig.get("always_start_first_track", true);
             if (ImGui::Checkbox(mLanguageFile.getc("settings.always_start_first_track"), &alwaysStartFirstTrack))
             {
                 mConfig.set("always_start_first_track", alwaysStartFirstTrack);
             }
 
+            auto gaplessPlayback = mConfig.get("gapless_playback", true);
+            if (ImGui::Checkbox(mLanguageFile.getc("settings.gapless_playback"), &gaplessPlayback))
+            {
+                mConfig.set("gapless_playback", gaplessPlayback);
+            }
+
+            auto crossfadeMs = mConfig.get("crossfade_ms", 0);
+            if (ImGui::SliderInt(mLanguageFile.getc("settings.crossfade"), &crossfadeMs, 0, 10000, "%d ms"))
+            {
+                mConfig.set("crossfade_ms", crossfadeMs);
+            }
+
+            auto resamplerQuality = mConfig.get("resampler_quality", 1);
+            if (ImGui::Combo(mLanguageFile.getc("settings.resampler_quality"), &resamplerQuality, "Low\0Medium\0High\0"))
+            {
+                mConfig.set("resampler_quality", resamplerQuality);
+            }
+
+            // The AudioSystem reopen the device when the buffer size change
+            auto lowLatency = mConfig.get("low_latency", false);
+            auto adaptiveBuffering = mConfig.get("adaptive_buffering", true);
+            auto bufferSamples = mConfig.get("audio_buffer_samples", 2048);
+            auto bufferChanged = false;
+            if (ImGui::Checkbox(mLanguageFile.getc("settings.low_latency"), &lowLatency))
+            {
+                mConfig.set("low_latency", lowLatency);
+                bufferChanged = true;
+            }
+
+            if (!lowLatency)
+            {
+                if (ImGui::BeginCombo(mLanguageFile.getc("settings.audio_buffer"), fmt::format("{:d}", bufferSamples).c_str()))
+                {
+                    for (auto samples : { 512, 1024, 2048, 4096, 8192 })
+                    {
+                        if (ImGui::Selectable(fmt::format("{:d}", samples).c_str(), samples == bufferSamples))
+                        {
+                            bufferSamples = samples;
+                            mConfig.set("audio_buffer_samples", bufferSamples);
+                            bufferChanged = true;
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+
+                if (ImGui::Checkbox(mLanguageFile.getc("settings.adaptive_buffering"), &adaptiveBuffering))
+                {
+                    mConfig.set("adaptive_buffering", adaptiveBuffering);
+                    bufferChanged = true;
+                }
+            }
+
+            if (bufferChanged)
+            {
+                world->emit<AudioSystemBufferChangeEvent>
+                ({
+                    .bufferSamples = bufferSamples,
+                    .lowLatency = lowLatency,
+                    .adaptive = adaptiveBuffering
+                });
+            }
+
 #if defined(__SWITCH__)
             bool mouseEmulation = mConfig.get("mouse_emulation", true);
             if (ImGui::Checkbox(mLanguageFile.getc("settings.mouse_emulation"), &mouseEmulation))
@@ -971,18 +1090,39 @@ void UiSystem::receive(ECS::World* world, const SDL_Event& event)
 
 void UiSystem::receive(ECS::World* world, const DirectoryLoadedEvent& event)
 {
-    TRACE("Received DirectoryLoadedEvent: \"{:s}\" ({:d} items).", event.path, event.items.size());
-    if (mLoadDirectoryParams.addToPlaylist)
+    TRACE("Received DirectoryLoadedEvent: \"{:s}\" ({:d} items).", event.path, event.listing->getCount());
+
+    // The first batch is kept as it is, the following ones are merged into it to keep the listing sorted
+    auto& listing = mLoadDirectoryParams.addToPlaylist ? mLoadDirectoryParams.playlistListing : mCurrentListing;
+    auto order = mLoadDirectoryParams.addToPlaylist ? DirectorySort::NAME : getSortOrder();
+    if (event.isFirstBatch)
+    {
+        listing = event.listing;
+        if (order != DirectorySort::NAME)
+        {
+            listing->sort(order);
+        }
+    }
+    else
+    {
+        listing->append(*event.listing, order);
+    }
+
+    if (!mLoadDirectoryParams.addToPlaylist)
+    {
+        mCurrentPath = event.path;
+    }
+    else if (event.isLastBatch)
     {
         int itemsAdded = 0;
-        for (auto& item : event.items)
+        for (size_t row=0; row<listing->getCount(); ++row)
         {
             auto path = std::filesystem::path(event.path);
-            path /=  item.name;
+            path /=  listing->getName(row);
 
             if (std::find(mPlaylist.paths.begin(), mPlaylist.paths.end(), path) == mPlaylist.paths.end())
             {
-                if (!item.isFolder && isFileSupported(path))
+                if (!listing->isFolder(row) && listing->isPlayable(row))
                 {
 
                     mPlaylist.paths.push_back(path);
@@ -993,20 +1133,31 @@ void UiSystem::receive(ECS::World* world, const DirectoryLoadedEvent& event)
 
         auto itemsAddedStr = fmt::format("{:d} item(s) added to the playlist", itemsAdded);
         pushNotification(Notification::INFO, itemsAddedStr);
-    }
-    else
-    {
-        mCurrentPath = event.path;
-        mCurrentPathItems.clear();
-        mCurrentPathItems.insert(mCurrentPathItems.end(), event.items.begin(), event.items.end());
+        listing = std::make_shared<DirectoryListing>();
     }
 }
 
 void UiSystem::receive(ECS::World* world, const FileLoadedEvent& event)
 {
+    if (mLoadFileParams.queue)
+    {
+        // Next playlist item, the AudioSystem will chain it with the current song
+        auto alwaysStartFirstTrack = mConfig.get("always_start_first_track", true);
+        world->emit<AudioSystemLoadFileEvent>
+        ({
+            .type = AudioSystemLoadFileEvent::LOAD_AND_QUEUE,
+            .path = event.path,
+            .buffer = event.buffer,
+            .startTrack = alwaysStartFirstTrack ? 1 : 0
+        });
+        return;
+    }
+
+    // Loading a file drop the one queued in the AudioSystem
+    mPlaylist.queuedIndex = -1;
     if (mLoadFileParams.playlistIndex == -1)
     {
-        resetPlaylist(false);
+        resetPlaylist(world, false);
     }
     else
     {
@@ -1076,6 +1227,17 @@ void UiSystem::receive(ECS::World* world, const AudioSystemPlayEvent& event)
         case AudioSystemPlayEvent::PLAYING:
             mAudioSystemStatus = PLAYING;
             mStatusMessage = std::string("\uf40a ").append(event.filename);
+            queueNextPlaylistItem(world);
+        break;
+
+        case AudioSystemPlayEvent::PLAYING_QUEUED_FILE:
+            // The AudioSystem moved to the queued file by itself
+            mAudioSystemStatus = PLAYING;
+            mStatusMessage = std::string("\uf40a ").append(event.filename);
+            mPlaylist.index = mPlaylist.queuedIndex;
+            mPlaylist.queuedIndex = -1;
+            prefetchPlaylistItems(world);
+            queueNextPlaylistItem(world);
         break;
 
         case AudioSystemPlayEvent::PAUSED:
@@ -1107,13 +1269,18 @@ void UiSystem::receive(ECS::World* world, const AudioSystemPlayEvent& event)
 
         case AudioSystemPlayEvent::STOPPED_BY_USER:
                 mAudioSystemStatus = STOPPED;
+                mPlaybackPosition = 0;
+                mPlaybackDuration = 0;
                 mStatusMessage = mLanguageFile.getc("status.ready");
-                resetPlaylist(false);
+                resetPlaylist(world, false);
                 mCurrentPluginUsed.reset();
         break;
 
         case AudioSystemPlayEvent::STOPPED:
             mAudioSystemStatus = STOPPED;
+            mPlaybackPosition = 0;
+            mPlaybackDuration = 0;
+            mPlaylist.queuedIndex = -1;
             if (mPlaylist.inUse)
             {
                 processNextPlaylistItem(world);
@@ -1142,6 +1309,12 @@ void UiSystem::receive(ECS::World* world, const AudioSystemErrorEvent& event)
     pushNotification(Notification::ERROR, event.message);
 }
 
+void UiSystem::receive(ECS::World* world, const AudioSystemPositionEvent& event)
+{
+    mPlaybackPosition = event.position;
+    mPlaybackDuration = event.duration;
+}
+
 void UiSystem::pushNotification(Notification::Type type, std::string message)
 {
     // Add a new notification object into the list
@@ -1153,6 +1326,11 @@ void UiSystem::pushNotification(Notification::Type type, std::string message)
     });
 }
 
+DirectorySort::Order UiSystem::getSortOrder()
+{
+    return (DirectorySort::Order) std::clamp(mConfig.get("sort_order", (int) DirectorySort::NAME), 0, DirectorySort::ORDER_COUNT - 1);
+}
+
 bool UiSystem::isFileSupported(std::string path)
 {
     // Check extension supported (convert to lower case beforehand)
@@ -1173,12 +1351,12 @@ bool UiSystem::isFileSupported(std::string path)
     return false;
 }
 
-void UiSystem::processFileItemSelection(ECS::World* world, DirectoryLoadedEvent::Item item, bool addToPlaylist)
+void UiSystem::processFileItemSelection(ECS::World* world, std::string name, bool isFolder, bool addToPlaylist)
 {
     // Build the item path and send it to the filesystem to be loaded or add it to the playlist
-    auto itemPath =  std::filesystem::path(mCurrentPath) / item.name;
+    auto itemPath =  std::filesystem::path(mCurrentPath) / name;
 
-    if (!item.isFolder)
+    if (!isFolder)
     {
         if(addToPlaylist)
         {
@@ -1192,6 +1370,7 @@ void UiSystem::processFileItemSelection(ECS::World* world, DirectoryLoadedEvent:
             mLoadFileParams.forceStart = true;
             mLoadFileParams.playlistIndex = -1;
             mLoadFileParams.isGoingBack = false;
+            mLoadFileParams.queue = false;
             world->emit<FileSystemLoadTaskEvent>
             ({
                 .type = FileSystemLoadTaskEvent::LOAD_FILE,
@@ -1217,6 +1396,12 @@ void UiSystem::processFileItemSelection(ECS::World* world, DirectoryLoadedEvent:
     mLoadFileParams.forceStart = !stayPaused;
     mLoadFileParams.playlistIndex = selectedIndex;
     mLoadFileParams.isGoingBack = goingBackward;
+    mLoadFileParams.queue = false;
+
+    // Show the new position right away, when skipping fast only the last one is loaded by the FileSystem
+    mPlaylist.inUse = true;
+    mPlaylist.index = selectedIndex;
+    prefetchPlaylistItems(world);
     world->emit<FileSystemLoadTaskEvent>
     ({
         .type = FileSystemLoadTaskEvent::LOAD_FILE,
@@ -1224,24 +1409,70 @@ void UiSystem::processFileItemSelection(ECS::World* world, DirectoryLoadedEvent:
     });
  }
 
-void UiSystem::resetPlaylist(bool eraseAllPaths)
+void UiSystem::resetPlaylist(ECS::World* world, bool eraseAllPaths)
 {
+    if (mPlaylist.queuedIndex != -1)
+    {
+        // The current song must not be followed by a playlist item anymore
+        world->emit<AudioSystemPlayTaskEvent>({.type = AudioSystemPlayTaskEvent::CLEAR_QUEUE});
+    }
+
     mPlaylist.inUse = false;
     mPlaylist.index = -1;
+    mPlaylist.queuedIndex = -1;
     if (eraseAllPaths)
     {
         mPlaylist.paths.clear();
     };
+
+    prefetchPlaylistItems(world);
+}
+
+void UiSystem::prefetchPlaylistItems(ECS::World* world)
+{
+    // Let the FileSystem read the next items ahead of time, and the previous one for who goes back.
+    // A shuffled playlist is reordered in place so its neighbours are the ones that will be played.
+    // With gapless playback the next item is loaded by queueNextPlaylistItem(), it is not read twice.
+    auto paths = std::vector<std::string>();
+    auto count = (int) mPlaylist.paths.size();
+    if (mPlaylist.inUse && mPlaylist.index != -1)
+    {
+        auto queuedIndex = mConfig.get("gapless_playback", true) && (mPlaylist.index + 1 < count || mPlaylist.loop)
+            ? (mPlaylist.index + 1) % count : -1;
+        auto prefetchCount = std::min(std::max(mConfig.get("prefetch_count", DEFAULT_PREFETCH_COUNT), 0), count - 1);
+        for (auto i=1; i<=prefetchCount; ++i)
+        {
+            auto index = mPlaylist.index + i;
+            if (index >= count && !mPlaylist.loop)
+            {
+                break;
+            }
+
+            if (index % count != queuedIndex)
+            {
+                paths.push_back(mPlaylist.paths[index % count]);
+            }
+        }
+
+        auto previousIndex = mPlaylist.index > 0 ? mPlaylist.index - 1 : mPlaylist.loop ? count - 1 : -1;
+        if (prefetchCount > 0 && previousIndex != -1 && previousIndex != mPlaylist.index && previousIndex != queuedIndex
+            && std::find(paths.begin(), paths.end(), mPlaylist.paths[previousIndex]) == paths.end())
+        {
+            paths.push_back(mPlaylist.paths[previousIndex]);
+        }
+    }
+
+    world->emit<FileSystemPrefetchEvent>({.paths = paths});
 }
 
-void UiSystem::removeItemFromPlaylist(int index)
+void UiSystem::removeItemFromPlaylist(ECS::World* world, int index)
 {
     // todo: alert dialog ?
     if (mPlaylist.index == index)
     {
         // If we delete the current playing index we let the song finish but
         // the index is reset to -1 (playlist not in use)
-        resetPlaylist(false);
+        resetPlaylist(world, false);
     }
     else if (mPlaylist.index > index)
     {
@@ -1250,7 +1481,55 @@ void UiSystem::removeItemFromPlaylist(int index)
         mPlaylist.index--;
     }
 
+    if (mPlaylist.queuedIndex == index)
+    {
+        // Forget the queued song, the next one will be queued instead
+        world->emit<AudioSystemPlayTaskEvent>({.type = AudioSystemPlayTaskEvent::CLEAR_QUEUE});
+        mPlaylist.queuedIndex = -1;
+    }
+    else if (mPlaylist.queuedIndex > index)
+    {
+        mPlaylist.queuedIndex--;
+    }
+
     mPlaylist.paths.erase(mPlaylist.paths.begin()+index);
+    queueNextPlaylistItem(world);
+}
+
+void UiSystem::queueNextPlaylistItem(ECS::World* world)
+{
+    // Load the next item ahead of time so the AudioSystem can chain it without a gap.
+    // Only done when nothing else is loading, a file requested by the user always win.
+    if (!mConfig.get("gapless_playback", true)
+        || !mPlaylist.inUse
+        || mPlaylist.queuedIndex != -1
+        || mIsLoadingFile
+        || mAudioSystemStatus != PLAYING)
+    {
+        return;
+    }
+
+    auto nextIndex = mPlaylist.index + 1;
+    if (nextIndex >= (int) mPlaylist.paths.size())
+    {
+        if (!mPlaylist.loop)
+        {
+            return;
+        }
+
+        nextIndex = 0;
+    }
+
+    mPlaylist.queuedIndex = nextIndex;
+    mLoadFileParams.forceStart = false;
+    mLoadFileParams.playlistIndex = nextIndex;
+    mLoadFileParams.isGoingBack = false;
+    mLoadFileParams.queue = true;
+    world->emit<FileSystemLoadTaskEvent>
+    ({
+        .type = FileSystemLoadTaskEvent::LOAD_FILE,
+        .path = mPlaylist.paths[nextIndex]
+    });
 }
 
 void UiSystem::processNextPlaylistItem(ECS::World* world)
@@ -1272,7 +1551,7 @@ void UiSystem::processNextPlaylistItem(ECS::World* world)
         // We reset the UiSystem now
         mStatusMessage = mLanguageFile.getc("status.ready");
         mCurrentPluginUsed.reset();
-        resetPlaylist(false);
+        resetPlaylist(world, false);
         world->emit<AudioSystemPlayTaskEvent>({.type = AudioSystemPlayTaskEvent::STOP});
     }
 }
@@ -1296,7 +1575,7 @@ void UiSystem::processPrevPlaylistItem(ECS::World* world)
         // We reset the UiSystem now
         mStatusMessage = mLanguageFile.getc("status.ready");
         mCurrentPluginUsed.reset();
-        resetPlaylist(false);
+        resetPlaylist(world, false);
         world->emit<AudioSystemPlayTaskEvent>({.type = AudioSystemPlayTaskEvent::STOP});
     }
 }
@@ -20,6 +20,7 @@
 #include <vector>
 #include <deque>
 #include <optional>
+#include <memory>
 
 #include <SDL2/SDL.h>
 #include <ECS.h>
@@ -31,9 +32,11 @@
 #include "../event/audio/AudioSystemConfiguredEvent.h"
 #include "../event/audio/AudioSystemPlayEvent.h"
 #include "../event/audio/AudioSystemErrorEvent.h"
+#include "../event/audio/AudioSystemPositionEvent.h"
 #include "../tools/AtlasTexture.h"
 #include "../tools/ConfigFile.h"
 #include "../tools/LanguageFile.h"
+#include "file/DirectoryListing.h"
 
 
 class UiSystem :
@@ -45,7 +48,8 @@ public ECS::EventSubscriber<DirectoryLoadedEvent>,
 public ECS::EventSubscriber<FileLoadedEvent>,
 public ECS::EventSubscriber<AudioSystemConfiguredEvent>,
 public ECS::EventSubscriber<AudioSystemPlayEvent>,
-public ECS::EventSubscriber<AudioSystemErrorEvent>
+public ECS::EventSubscriber<AudioSystemErrorEvent>,
+public ECS::EventSubscriber<AudioSystemPositionEvent>
 {
 public:
     UiSystem(Config config, LanguageFile languageFile, SDL_Window* window);
@@ -63,6 +67,7 @@ public:
     virtual void receive(ECS::World* world, const AudioSystemConfiguredEvent& event) override;
     virtual void receive(ECS::World* world, const AudioSystemPlayEvent& event) override;
     virtual void receive(ECS::World* world, const AudioSystemErrorEvent& event) override;
+    virtual void receive(ECS::World* world, const AudioSystemPositionEvent& event) override;
 
 private:
     struct Notification
@@ -81,6 +86,7 @@ private:
     {
         std::vector<std::string> paths;
         int index;
+        int queuedIndex;
         bool inUse;
         bool loop;
     };
@@ -89,12 +95,15 @@ private:
     {
         bool forceStart;
         bool isGoingBack;
+        bool queue;
         int playlistIndex;
     };
 
     struct LoadDirectoryParams
     {
         bool addToPlaylist;
+        // Batches received so far when adding a directory to the playlist
+        std::shared_ptr<DirectoryListing> playlistListing;
     };
 
     enum AudioSystemStatus
@@ -121,10 +130,14 @@ private:
     bool mIsLoadingDirectory;
     bool mIsLoadingFile;
     float mNotificationDisplayTimeMs;
+    // Milliseconds, mSeekPosition is -1 unless the user is dragging the seek bar
+    int mPlaybackPosition;
+    int mPlaybackDuration;
+    int mSeekPosition;
 
     std::string mStatusMessage;
     std::string mCurrentPath;
-    std::vector<DirectoryLoadedEvent::Item> mCurrentPathItems;
+    std::shared_ptr<DirectoryListing> mCurrentListing;
     std::vector<AudioSystemConfiguredEvent::PluginInformation> mPluginInformations;
     std::optional<AudioSystemConfiguredEvent::PluginInformation> mCurrentPluginUsed;
     std::deque<Notification> mNotifications;
@@ -132,12 +145,15 @@ private:
     UiSystem(const UiSystem& copy);
 
     void pushNotification(Notification::Type type, std::string message);
+    DirectorySort::Order getSortOrder();
     bool isFileSupported(std::string path);
-    void processFileItemSelection(ECS::World* world, DirectoryLoadedEvent::Item item, bool addToPlaylist);
+    void processFileItemSelection(ECS::World* world, std::string name, bool isFolder, bool addToPlaylist);
     void processPlaylistItemSelection(ECS::World* world, int selectedIndex, bool stayPaused, bool goingBackward);
 
-    void resetPlaylist(bool eraseAllPaths);
-    void removeItemFromPlaylist(int index);
+    void resetPlaylist(ECS::World* world, bool eraseAllPaths);
+    void removeItemFromPlaylist(ECS::World* world, int index);
+    void prefetchPlaylistItems(ECS::World* world);
+    void queueNextPlaylistItem(ECS::World* world);
     void processNextPlaylistItem(ECS::World* world);
     void processPrevPlaylistItem(ECS::World* world);
 };
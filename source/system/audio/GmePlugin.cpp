@@ -17,6 +17,7 @@
 #include "GmePlugin.h"
 
 #include <stdexcept>
+#include <cstring>
 
 // Need to undef check because it's causing issue with fmt when used with gme ?
 #undef check
@@ -24,6 +25,8 @@
 
 #include <imgui/imgui.h>
 
+#include "SampleConverter.h"
+
 
 GmePlugin::GmePlugin() :
 Plugin(),
@@ -56,9 +59,9 @@ std::vector<std::string> GmePlugin::getSupportedExtensions()
     };
 }
 
-void GmePlugin::setup(Config config)
+void GmePlugin::setup(Config config, int deviceSampleRate)
 {
-    Plugin::setup(config);
+    Plugin::setup(config, deviceSampleRate);
 }
 
 void GmePlugin::cleanup()
@@ -66,15 +69,17 @@ void GmePlugin::cleanup()
     Plugin::cleanup();
 }
 
-void GmePlugin::open(const std::vector<uint8_t>& buffer)
+void GmePlugin::open(const FileBuffer& buffer)
 {
-    auto header = gme_identify_header(buffer.data());
+    auto header = gme_identify_header(buffer.getData());
     if (header[0] == '\0')
     {
         throw std::runtime_error(gme_wrong_file_type);
     }
 
-    auto error = gme_open_data(buffer.data(), buffer.size(), &mMusicEmu, 48000);
+    // SPC are natively rendered at 32000Hz, anything else would go through the gme ressampler first
+    mSampleRate = selectSampleRate(strcmp(header, "SPC") == 0 ? 32000 : 0);
+    auto error = gme_open_data(buffer.getData(), buffer.getSize(), &mMusicEmu, mSampleRate);
     if (error != nullptr)
     {
         throw std::runtime_error(error);
@@ -91,6 +96,7 @@ void GmePlugin::open(const std::vector<uint8_t>& buffer)
     gme_set_autoload_playback_limit(mMusicEmu, loadPlaybackLimit);
     gme_ignore_silence(mMusicEmu, ignoreSilence);
     gme_start_track(mMusicEmu, mCurrentTrack);
+    publishInformation();
 }
 
 int GmePlugin::getCurrentTrack()
@@ -124,6 +130,51 @@ void GmePlugin::setSubSong(int subsong)
         mCurrentTrack = subsong-1;
         gme_start_track(mMusicEmu, mCurrentTrack);
     }
+
+    publishInformation();
+}
+
+int GmePlugin::getPosition()
+{
+    if (mMusicEmu == nullptr)
+    {
+        return 0;
+    }
+
+    return gme_tell(mMusicEmu);
+}
+
+int GmePlugin::getDuration()
+{
+    if (mMusicEmu == nullptr)
+    {
+        return 0;
+    }
+
+    gme_info_t* info;
+    if (gme_track_info(mMusicEmu, &info, mCurrentTrack) != nullptr)
+    {
+        return 0;
+    }
+
+    auto duration = info->length > 0 ? info->length : info->play_length;
+    gme_free_info(info);
+    return duration;
+}
+
+void GmePlugin::seek(int milliseconds)
+{
+    if (mMusicEmu == nullptr)
+    {
+        return;
+    }
+
+    // Game music emu run the emulation without generating sound to get there
+    auto error = gme_seek(mMusicEmu, milliseconds);
+    if (error != nullptr)
+    {
+        throw std::runtime_error(error);
+    }
 }
 
 void GmePlugin::close()
@@ -136,17 +187,20 @@ void GmePlugin::close()
 
     mCurrentTrack = 0;
     mTrackCount = 0;
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>());
 }
 
-bool GmePlugin::decode(uint8_t* stream, size_t len)
+bool GmePlugin::decode(float* stream, size_t& frames)
 {
     if (mMusicEmu == nullptr)
     {
+        frames = 0;
         return false;
     }
 
-    auto size = (int) len / 2;
-    auto error = gme_play(mMusicEmu, size, (short*) stream);
+    auto* samples = getSampleBuffer(frames);
+    auto error = gme_play(mMusicEmu, (int) frames * 2, samples);
+    SampleConverter::int16ToFloat(samples, stream, frames * 2);
     bool ended = gme_track_ended(mMusicEmu);
 
     if (ended && mCurrentTrack+1 < mTrackCount)
@@ -183,53 +237,47 @@ void GmePlugin::drawSettings(ECS::World* world, LanguageFile languageFile, float
     {
         mConfig.set("ignore_silence", ignoreSilence);
     }
+
+    drawSampleRateSetting(languageFile);
 }
 
 void GmePlugin::drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mMusicEmu == nullptr)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
-    gme_info_t* info;
-    gme_track_info(mMusicEmu, &info, mCurrentTrack);
-    auto position = (gme_tell_samples(mMusicEmu) / 48000) / 2;
-    auto duration = (info->length > 0 ? info->length : info->play_length) / 1000;
-
     if (Plugin::beginTable(languageFile.getc("player"), false))
     {
-        Plugin::drawRow(languageFile.getc("player.title"),        info->song);
-        Plugin::drawRow(languageFile.getc("player.track"),        fmt::format("{:d}/{:d}",     mCurrentTrack+1, mTrackCount));
-        Plugin::drawRow(languageFile.getc("player.duration"),     fmt::format("{:d}:{:02d}",   duration / 60, duration % 60));
-        Plugin::drawRow(languageFile.getc("player.position"),     fmt::format("{:d}:{:02}",    position / 60, position % 60));
+        Plugin::drawRow(languageFile.getc("player.title"),        information->song);
+        Plugin::drawRow(languageFile.getc("player.track"),        fmt::format("{:d}/{:d}",     information->track, information->trackCount));
+        Plugin::drawPositionStats(languageFile);
+        Plugin::drawDecodeStats(languageFile, deltaTime);
         Plugin::endTable();
     }
-
-    gme_free_info(info);
 }
 
 void GmePlugin::drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mMusicEmu == nullptr)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
-    gme_info_t* info;
-    gme_track_info(mMusicEmu, &info, mCurrentTrack);
-
     if (Plugin::beginTable(languageFile.getc("metadata"), false))
     {
-        Plugin::drawRow(languageFile.getc("metadata.game"),         info->game);
-        Plugin::drawRow(languageFile.getc("metadata.author"),       info->author);
-        Plugin::drawRow(languageFile.getc("metadata.copyright"),    info->copyright);
-        Plugin::drawRow(languageFile.getc("metadata.system"),       info->system);
-        Plugin::drawRow(languageFile.getc("metadata.dumper"),       info->dumper);
+        Plugin::drawRow(languageFile.getc("metadata.game"),         information->game);
+        Plugin::drawRow(languageFile.getc("metadata.author"),       information->author);
+        Plugin::drawRow(languageFile.getc("metadata.copyright"),    information->copyright);
+        Plugin::drawRow(languageFile.getc("metadata.system"),       information->system);
+        Plugin::drawRow(languageFile.getc("metadata.dumper"),       information->dumper);
         ImGui::EndTable();
     }
 
-    if (strlen(info->comment) > 0)
+    if (information->comment.length() > 0)
     {
         ImGui::Spacing();
         if (Plugin::beginTable(languageFile.getc("metadata.comments"), true, false))
@@ -237,11 +285,32 @@ void GmePlugin::drawMetadata(ECS::World* world, LanguageFile languageFile, float
             auto& io = ImGui::GetIO();
             ImGui::PushFont(io.Fonts->Fonts[1]);
             ImGui::TableNextColumn();
-            ImGui::TextWrapped("%s", info->comment);
+            ImGui::TextWrapped("%s", information->comment.c_str());
             ImGui::PopFont();
             Plugin::endTable();
         }
     }
+}
 
-    gme_free_info(info);
+void GmePlugin::publishInformation()
+{
+    // gme is not thread safe, the main thread draw this copy while the decode thread render
+    auto information = std::make_shared<Information>();
+    information->track = mCurrentTrack+1;
+    information->trackCount = mTrackCount;
+
+    gme_info_t* info;
+    if (gme_track_info(mMusicEmu, &info, mCurrentTrack) == nullptr)
+    {
+        information->song = info->song;
+        information->game = info->game;
+        information->author = info->author;
+        information->copyright = info->copyright;
+        information->system = info->system;
+        information->dumper = info->dumper;
+        information->comment = info->comment;
+        gme_free_info(info);
+    }
+
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>(information));
 }
@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
 #include <gme/gme.h>
 #include <ECS.h>
@@ -38,24 +39,44 @@ public:
     virtual std::string getVersion() override;
     virtual std::vector<std::string> getSupportedExtensions() override;
 
-    virtual void setup(Config config) override;
+    virtual void setup(Config config, int deviceSampleRate) override;
     virtual void cleanup() override;
-    virtual void open(const std::vector<uint8_t>& buffer) override;
+    virtual void open(const FileBuffer& buffer) override;
     virtual void close() override;
-    virtual bool decode(uint8_t* stream, size_t len) override;
+    virtual bool decode(float* stream, size_t& frames) override;
 
     virtual int getCurrentTrack();
     virtual int getTrackCount();
     virtual void setSubSong(int subsong);
+    virtual int getPosition();
+    virtual int getDuration();
+    virtual void seek(int milliseconds);
 
     virtual void drawSettings(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
     virtual void drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
     virtual void drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
 
 private:
+    // What the player stats and metadata show, replaced as a whole by the thread that own the plugin
+    struct Information
+    {
+        int track;
+        int trackCount;
+        std::string song;
+        std::string game;
+        std::string author;
+        std::string copyright;
+        std::string system;
+        std::string dumper;
+        std::string comment;
+    };
+
     Music_Emu* mMusicEmu;
     int mCurrentTrack;
     int mTrackCount;
+    std::shared_ptr<const Information> mInformation;
+
+    void publishInformation();
 
     GmePlugin(const GmePlugin& copy);
 };
@@ -0,0 +1,116 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Mixer.h"
+
+#include <algorithm>
+
+#define MIXER_CHANNELS 2                // Interleaved stereo only
+
+
+Mixer::Mixer()
+{
+}
+
+Mixer::~Mixer()
+{
+}
+
+void Mixer::setup(int streamCount, size_t maxFrames)
+{
+    mEnvelopes.assign(streamCount, { .gain = 1.0f, .target = 1.0f, .step = 0.0f, .remainingFrames = 0 });
+    mAccumulator.assign(maxFrames * MIXER_CHANNELS, 0.0f);
+}
+
+float Mixer::getGain(int stream) const
+{
+    return mEnvelopes[stream].gain;
+}
+
+bool Mixer::isFading(int stream) const
+{
+    return mEnvelopes[stream].remainingFrames > 0;
+}
+
+void Mixer::setGain(int stream, float gain)
+{
+    mEnvelopes[stream] = { .gain = gain, .target = gain, .step = 0.0f, .remainingFrames = 0 };
+}
+
+void Mixer::fadeTo(int stream, float gain, size_t frames)
+{
+    if (frames == 0)
+    {
+        setGain(stream, gain);
+        return;
+    }
+
+    auto& envelope = mEnvelopes[stream];
+    envelope.target = gain;
+    envelope.step = (gain - envelope.gain) / (float) frames;
+    envelope.remainingFrames = frames;
+}
+
+void Mixer::clear(size_t frames)
+{
+    std::fill_n(mAccumulator.begin(), frames * MIXER_CHANNELS, 0.0f);
+}
+
+void Mixer::add(int stream, const float* __restrict samples, size_t frames)
+{
+    auto& envelope = mEnvelopes[stream];
+    auto* __restrict accumulator = mAccumulator.data();
+
+    // Linear ramp first, the gain is computed from the frame index so the loop has no dependency.
+    // Blocks are small, an int index convert to float way faster than a size_t one.
+    auto rampFrames = std::min(frames, envelope.remainingFrames);
+    if (rampFrames > 0)
+    {
+        auto gain = envelope.gain;
+        auto step = envelope.step;
+        for (int i=0; i<(int) rampFrames; ++i)
+        {
+            auto frameGain = gain + step * (float) (i + 1);
+            accumulator[i*2] += samples[i*2] * frameGain;
+            accumulator[i*2+1] += samples[i*2+1] * frameGain;
+        }
+
+        envelope.remainingFrames -= rampFrames;
+        envelope.gain = envelope.remainingFrames == 0
+            ? envelope.target
+            : gain + step * (float) rampFrames;
+    }
+
+    // Then a constant gain for what remain, silent streams cost nothing
+    auto gain = envelope.gain;
+    if (gain == 0.0f)
+    {
+        return;
+    }
+
+    auto offset = rampFrames * MIXER_CHANNELS;
+    auto sampleCount = frames * MIXER_CHANNELS;
+    for (size_t i=offset; i<sampleCount; ++i)
+    {
+        accumulator[i] += samples[i] * gain;
+    }
+}
+
+void Mixer::render(float* output, size_t frames)
+{
+    // No saturation here, it is done once by the conversion to the device format
+    std::copy_n(mAccumulator.begin(), frames * MIXER_CHANNELS, output);
+}
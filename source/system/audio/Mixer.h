@@ -0,0 +1,59 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * Mix several interleaved float stereo streams together, each one with its own gain envelope.
+ * Everything is summed into an accumulator allocated once by setup(), loops are kept
+ * simple enough to be vectorized by the compiler. Not thread safe, the caller must serialize access.
+ */
+class Mixer
+{
+public:
+    Mixer();
+    virtual ~Mixer();
+
+    void setup(int streamCount, size_t maxFrames);
+
+    float getGain(int stream) const;
+    bool isFading(int stream) const;
+    void setGain(int stream, float gain);
+    void fadeTo(int stream, float gain, size_t frames);
+
+    // Start a new block, add every streams to it then render the result
+    void clear(size_t frames);
+    void add(int stream, const float* samples, size_t frames);
+    void render(float* output, size_t frames);
+
+private:
+    struct Envelope
+    {
+        float gain;
+        float target;
+        float step;
+        size_t remainingFrames;
+    };
+
+    std::vector<Envelope> mEnvelopes;
+    std::vector<float> mAccumulator;
+
+    Mixer(const Mixer& copy);
+};
@@ -58,9 +58,9 @@ std::vector<std::string> OpenmptPlugin::getSupportedExtensions()
     return extensionsWithDot;
 }
 
-void OpenmptPlugin::setup(Config config)
+void OpenmptPlugin::setup(Config config, int deviceSampleRate)
 {
-    Plugin::setup(config);
+    Plugin::setup(config, deviceSampleRate);
 }
 
 void OpenmptPlugin::cleanup()
@@ -68,14 +68,26 @@ void OpenmptPlugin::cleanup()
     Plugin::cleanup();
 }
 
-void OpenmptPlugin::open(const std::vector<uint8_t>& buffer)
+void OpenmptPlugin::open(const FileBuffer& buffer)
 {
     auto amigaRessampler = mConfig.get("emulate_paula_chip", true);
     mLoopEnabled = mConfig.get("loop", false);
+    mSampleRate = selectSampleRate();
 
-    mModule = new openmpt::module(buffer);
+    mModule = new openmpt::module(buffer.getData(), buffer.getSize());
     mModule->ctl_set_boolean("render.resampler.emulate_amiga", amigaRessampler);
     mModule->ctl_set_text("play.at_end", mLoopEnabled ? "continue" : "stop");
+
+    // The module belong to the decode thread once the file is handed over, keep what is drawn
+    auto information = std::make_shared<Information>();
+    information->title = mModule->get_metadata("title");
+    information->type = mModule->get_metadata("type");
+    information->typeLong = mModule->get_metadata("type_long");
+    information->artist = mModule->get_metadata("artist");
+    information->tracker = mModule->get_metadata("tracker");
+    information->date = mModule->get_metadata("date");
+    information->message = mModule->get_metadata("message");
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>(information));
 }
 
 int OpenmptPlugin::getCurrentTrack()
@@ -94,6 +106,37 @@ void OpenmptPlugin::setSubSong(int subsong)
     // Not yet implemented.
 }
 
+int OpenmptPlugin::getPosition()
+{
+    if (mModule == nullptr)
+    {
+        return 0;
+    }
+
+    return (int) (mModule->get_position_seconds() * 1000);
+}
+
+int OpenmptPlugin::getDuration()
+{
+    if (mModule == nullptr)
+    {
+        return 0;
+    }
+
+    return (int) (mModule->get_duration_seconds() * 1000);
+}
+
+void OpenmptPlugin::seek(int milliseconds)
+{
+    if (mModule == nullptr)
+    {
+        return;
+    }
+
+    // libopenmpt jump to the closest row without rendering anything
+    mModule->set_position_seconds(milliseconds / 1000.0);
+}
+
 void OpenmptPlugin::close()
 {
     if (mModule != nullptr)
@@ -101,23 +144,27 @@ void OpenmptPlugin::close()
         delete mModule;
         mModule = nullptr;
     }
+
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>());
 }
 
-bool OpenmptPlugin::decode(uint8_t* stream, size_t len)
+bool OpenmptPlugin::decode(float* stream, size_t& frames)
 {
     if (mModule == nullptr)
     {
+        frames = 0;
         return false;
     }
 
-    auto size = (size_t) len / 4;
-    auto reads = mModule->read_interleaved_stereo(48000, size, (int16_t*) stream);
-    if (reads != size && mLoopEnabled)
+    // libopenmpt mix in float internally, no need to go through 16 bits
+    auto reads = mModule->read_interleaved_stereo(mSampleRate, frames, stream);
+    if (reads != frames && mLoopEnabled)
     {
         // loop
-        reads = mModule->read_interleaved_stereo(48000, size - reads, (int16_t*) &stream[reads]);
+        reads += mModule->read_interleaved_stereo(mSampleRate, frames - reads, &stream[reads * 2]);
     }
 
+    frames = reads;
     return reads > 0 || mLoopEnabled;
 }
 
@@ -134,56 +181,47 @@ void OpenmptPlugin::drawSettings(ECS::World* world, LanguageFile languageFile, f
     {
         mConfig.set("emulate_paula_chip", amigaRessampler);
     }
+
+    drawSampleRateSetting(languageFile);
 }
 
 void OpenmptPlugin::drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mModule == nullptr)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
-    auto title = mModule->get_metadata("title");
-    auto duration = (int) mModule->get_duration_seconds();
-    auto position = (int) mModule->get_position_seconds();
-
     if (Plugin::beginTable(languageFile.getc("player"), false))
     {
-        Plugin::drawRow(languageFile.getc("player.title"),      title);
+        Plugin::drawRow(languageFile.getc("player.title"),      information->title);
         Plugin::drawRow(languageFile.getc("player.track"),      "1/1");
-        Plugin::drawRow(languageFile.getc("player.duration"),   fmt::format("{:d}:{:02d}",   duration / 60, duration % 60));
-        Plugin::drawRow(languageFile.getc("player.position"),   fmt::format("{:d}:{:02}",    position / 60, position % 60));
+        Plugin::drawPositionStats(languageFile);
+        Plugin::drawDecodeStats(languageFile, deltaTime);
         Plugin::endTable();
     }
 }
 
 void OpenmptPlugin::drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mModule == nullptr)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
-    auto type = mModule->get_metadata("type");
-    auto type_long = mModule->get_metadata("type_long");
-    auto original_type = mModule->get_metadata("type");
-    auto original_type_long = mModule->get_metadata("type_long");
-    auto artist = mModule->get_metadata("artist");
-    auto tracker = mModule->get_metadata("tracker");
-    auto date = mModule->get_metadata("date");
-    auto msg = mModule->get_metadata("message");
-
     if (Plugin::beginTable(languageFile.getc("metadata"),  false))
     {
-        Plugin::drawRow(languageFile.getc("metadata.type"),             fmt::format("{:s} ({:s})",   type_long, type));
-        Plugin::drawRow(languageFile.getc("metadata.original_type"),    fmt::format("{:s} ({:s})",   original_type_long, original_type));
-        Plugin::drawRow(languageFile.getc("metadata.author"),           artist);
-        Plugin::drawRow(languageFile.getc("metadata.last_saved"),       date);
-        Plugin::drawRow(languageFile.getc("metadata.tracker_used"),     tracker);
+        Plugin::drawRow(languageFile.getc("metadata.type"),             fmt::format("{:s} ({:s})",   information->typeLong, information->type));
+        Plugin::drawRow(languageFile.getc("metadata.original_type"),    fmt::format("{:s} ({:s})",   information->typeLong, information->type));
+        Plugin::drawRow(languageFile.getc("metadata.author"),           information->artist);
+        Plugin::drawRow(languageFile.getc("metadata.last_saved"),       information->date);
+        Plugin::drawRow(languageFile.getc("metadata.tracker_used"),     information->tracker);
         Plugin::endTable();
     }
 
-    if (msg.length() > 0)
+    if (information->message.length() > 0)
     {
         ImGui::Spacing();
         if (Plugin::beginTable(languageFile.getc("metadata.comments_or_samples"), true, false))
@@ -191,7 +229,7 @@ void OpenmptPlugin::drawMetadata(ECS::World* world, LanguageFile languageFile, f
             auto& io = ImGui::GetIO();
             ImGui::PushFont(io.Fonts->Fonts[1]);
             ImGui::TableNextColumn();
-            ImGui::TextWrapped("%s", msg.c_str());
+            ImGui::TextWrapped("%s", information->message.c_str());
             ImGui::PopFont();
             Plugin::endTable();
         }
@@ -0,0 +1,472 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PcmCache.h"
+
+#include <cmath>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+
+#include "SampleConverter.h"
+
+
+#define PCM_CACHE_BLOCK_FRAMES 4096     // Number of frames encoded together
+#define PCM_CACHE_CHANNELS 2            // Interleaved stereo only
+#define PCM_CACHE_ENTRY_OVERHEAD 256    // Rough size of an entry without its samples, counted in the memory usage
+#define PCM_CACHE_PARTITION_FRAMES 256  // Frames of a channel sharing a predictor and a Rice parameter
+#define PCM_CACHE_PREDICTOR_COUNT 3     // Fixed polynomial predictors of order 0 to 2
+#define PCM_CACHE_MAX_RICE_PARAMETER 17 // Largest Rice parameter tried
+#define PCM_CACHE_RICE_ESCAPE 8         // Unary length announcing a residual stored on PCM_CACHE_ESCAPED_BITS
+#define PCM_CACHE_ESCAPED_BITS 18       // Enough for any residual of the order 2 predictor
+#define PCM_CACHE_HEADER_BITS 7         // Predictor order in the 2 high bits, Rice parameter in the 5 low bits
+#define PCM_CACHE_VERBATIM 0x7F         // Header of a partition stored as plain 16 bits samples
+
+
+// MSB first bit packing for the PCM cache blocks
+struct BitWriter
+{
+    std::vector<uint8_t>& output;
+    uint64_t bits;
+    int count;
+
+    void write(uint32_t value, int size)
+    {
+        bits = (bits << size) | value;
+        count += size;
+        while (count >= 8)
+        {
+            count -= 8;
+            output.push_back((uint8_t) (bits >> count));
+        }
+    }
+
+    void flush()
+    {
+        if (count > 0)
+        {
+            write(0, 8 - count);
+        }
+    }
+};
+
+struct BitReader
+{
+    const uint8_t* data;
+    size_t length;
+    size_t offset;
+    uint64_t bits;
+    int count;
+
+    uint32_t read(int size)
+    {
+        while (count < size)
+        {
+            // Past the end only happen with a corrupted block, read zeroes
+            bits = (bits << 8) | (offset < length ? data[offset] : 0);
+            ++offset;
+            count += 8;
+        }
+
+        count -= size;
+        return (uint32_t) (bits >> count) & (uint32_t) ((1ULL << size) - 1);
+    }
+};
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static int32_t predict(int order, const int32_t* previous)
+{
+    switch (order)
+    {
+        case 1:  return previous[0];
+        case 2:  return 2 * previous[0] - previous[1];
+        default: return 0;
+    }
+}
+
+
+bool PcmCache::Key::operator==(const Key& other) const
+{
+    return contentHash == other.contentHash
+        && track == other.track
+        && sampleRate == other.sampleRate
+        && settingsVersion == other.settingsVersion;
+}
+
+PcmCache::PcmCache() :
+mMaxBytes(0),
+mUseCounter(0),
+mMemoryUsage(0),
+mHitCount(0),
+mMissCount(0),
+mDecodedEntry(nullptr),
+mDecodedBlock(0)
+{
+}
+
+PcmCache::~PcmCache()
+{
+}
+
+void PcmCache::setup(size_t maxBytes)
+{
+    mEntries.clear();
+    mMaxBytes = maxBytes;
+    mMemoryUsage = 0;
+    mDecodedEntry = nullptr;
+    mDecodedSamples.assign(PCM_CACHE_BLOCK_FRAMES * PCM_CACHE_CHANNELS, 0);
+}
+
+bool PcmCache::isEnabled() const
+{
+    return mMaxBytes > 0;
+}
+
+size_t PcmCache::getFrameCount(const Key& key, bool& complete)
+{
+    auto* entry = find(key);
+    complete = entry != nullptr && entry->complete;
+    return entry != nullptr ? entry->frameCount : 0;
+}
+
+bool PcmCache::lookup(const Key& key, size_t position, bool requireComplete)
+{
+    auto* entry = find(key);
+    auto isHit = entry != nullptr
+        && position < entry->frameCount
+        && (entry->complete || !requireComplete);
+
+    if (isHit)
+    {
+        entry->lastUse = ++mUseCounter;
+        mHitCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        mMissCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return isHit;
+}
+
+size_t PcmCache::read(const Key& key, size_t position, float* stream, size_t frames)
+{
+    auto* entry = find(key);
+    if (entry == nullptr || position >= entry->frameCount)
+    {
+        return 0;
+    }
+
+    entry->lastUse = ++mUseCounter;
+    frames = std::min(frames, entry->frameCount - position);
+
+    auto read = (size_t) 0;
+    while (read < frames)
+    {
+        auto block = position / PCM_CACHE_BLOCK_FRAMES;
+        auto offset = position % PCM_CACHE_BLOCK_FRAMES;
+        auto count = std::min(frames - read, (size_t) PCM_CACHE_BLOCK_FRAMES - offset);
+
+        const int16_t* samples;
+        if (block < entry->blocks.size())
+        {
+            if (mDecodedEntry != entry || mDecodedBlock != block)
+            {
+                decode(entry->blocks[block], mDecodedSamples.data(), PCM_CACHE_BLOCK_FRAMES);
+                mDecodedEntry = entry;
+                mDecodedBlock = block;
+            }
+            samples = mDecodedSamples.data();
+        }
+        else
+        {
+            samples = entry->pendingSamples.data();
+        }
+
+        SampleConverter::int16ToFloat(&samples[offset * PCM_CACHE_CHANNELS], &stream[read * PCM_CACHE_CHANNELS], count * PCM_CACHE_CHANNELS);
+        position += count;
+        read += count;
+    }
+
+    return read;
+}
+
+bool PcmCache::append(const Key& key, size_t position, const float* stream, size_t frames)
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+
+    auto* entry = find(key);
+    if (position == 0)
+    {
+        // Rendered again from the start, forget what was there
+        if (entry != nullptr)
+        {
+            remove(entry);
+        }
+
+        mEntries.push_front({ .key = key, .frameCount = 0, .memoryUsage = 0, .complete = false, .lastUse = 0 });
+        entry = &mEntries.front();
+        entry->pendingSamples.reserve(PCM_CACHE_BLOCK_FRAMES * PCM_CACHE_CHANNELS);
+    }
+    else if (entry == nullptr || entry->complete || position != entry->frameCount)
+    {
+        return false;
+    }
+
+    entry->lastUse = ++mUseCounter;
+    for (size_t i=0; i<frames * PCM_CACHE_CHANNELS; ++i)
+    {
+        // Same scale as SampleConverter::int16ToFloat so 16 bits samples come back unchanged
+        auto sample = std::lrint(stream[i] * 32768.0f);
+        entry->pendingSamples.push_back((int16_t) std::clamp(sample, -32768L, 32767L));
+
+        if (entry->pendingSamples.size() == PCM_CACHE_BLOCK_FRAMES * PCM_CACHE_CHANNELS)
+        {
+            entry->blocks.emplace_back();
+            encode(entry->pendingSamples.data(), PCM_CACHE_BLOCK_FRAMES, entry->blocks.back());
+            entry->pendingSamples.clear();
+        }
+    }
+
+    entry->frameCount += frames;
+    updateMemoryUsage(*entry);
+
+    if (!evict(entry))
+    {
+        // Bigger than the whole cache
+        remove(entry);
+        return false;
+    }
+
+    return true;
+}
+
+void PcmCache::setComplete(const Key& key)
+{
+    auto* entry = find(key);
+    if (entry != nullptr)
+    {
+        // Nothing will be appended anymore
+        entry->complete = true;
+        entry->pendingSamples.shrink_to_fit();
+        updateMemoryUsage(*entry);
+    }
+}
+
+uint64_t PcmCache::getHitCount() const
+{
+    return mHitCount.load(std::memory_order_relaxed);
+}
+
+uint64_t PcmCache::getMissCount() const
+{
+    return mMissCount.load(std::memory_order_relaxed);
+}
+
+size_t PcmCache::getMemoryUsage() const
+{
+    return mMemoryUsage.load(std::memory_order_relaxed);
+}
+
+PcmCache::Entry* PcmCache::find(const Key& key)
+{
+    for (auto& entry : mEntries)
+    {
+        if (entry.key == key)
+        {
+            return &entry;
+        }
+    }
+
+    return nullptr;
+}
+
+void PcmCache::remove(const Entry* entry)
+{
+    if (mDecodedEntry == entry)
+    {
+        mDecodedEntry = nullptr;
+    }
+
+    mMemoryUsage -= entry->memoryUsage;
+    mEntries.remove_if([entry](const Entry& other) { return &other == entry; });
+}
+
+void PcmCache::updateMemoryUsage(Entry& entry)
+{
+    auto memoryUsage = (size_t) PCM_CACHE_ENTRY_OVERHEAD + entry.pendingSamples.capacity() * sizeof(int16_t);
+    for (auto& block : entry.blocks)
+    {
+        memoryUsage += block.capacity();
+    }
+
+    mMemoryUsage += memoryUsage - entry.memoryUsage;
+    entry.memoryUsage = memoryUsage;
+}
+
+bool PcmCache::evict(const Entry* keep)
+{
+    while (mMemoryUsage > mMaxBytes)
+    {
+        const Entry* oldest = nullptr;
+        for (auto& entry : mEntries)
+        {
+            if (&entry != keep && (oldest == nullptr || entry.lastUse < oldest->lastUse))
+            {
+                oldest = &entry;
+            }
+        }
+
+        if (oldest == nullptr)
+        {
+            return false;
+        }
+
+        remove(oldest);
+    }
+
+    return true;
+}
+
+void PcmCache::encode(const int16_t* samples, size_t frames, std::vector<uint8_t>& output)
+{
+    // Each channel is cut in partitions coded with the fixed predictor and the Rice parameter that give the fewest bits,
+    // a partition that would not be smaller than its 16 bits samples is stored as is
+    BitWriter writer = { output, 0, 0 };
+    output.clear();
+    output.reserve(frames * PCM_CACHE_CHANNELS * sizeof(int16_t) + frames / PCM_CACHE_PARTITION_FRAMES * PCM_CACHE_CHANNELS + 2);
+
+    uint32_t residuals[PCM_CACHE_PREDICTOR_COUNT][PCM_CACHE_PARTITION_FRAMES];
+    for (auto channel=0; channel<PCM_CACHE_CHANNELS; ++channel)
+    {
+        int32_t previous[2] = { 0, 0 };
+        for (size_t start=0; start<frames; start += PCM_CACHE_PARTITION_FRAMES)
+        {
+            auto count = std::min(frames - start, (size_t) PCM_CACHE_PARTITION_FRAMES);
+            uint64_t sums[PCM_CACHE_PREDICTOR_COUNT] = { 0 };
+            for (size_t i=0; i<count; ++i)
+            {
+                auto sample = (int32_t) samples[(start + i) * PCM_CACHE_CHANNELS + channel];
+                for (auto order=0; order<PCM_CACHE_PREDICTOR_COUNT; ++order)
+                {
+                    auto value = zigzag(sample - predict(order, previous));
+                    residuals[order][i] = value;
+                    sums[order] += value;
+                }
+                previous[1] = previous[0];
+                previous[0] = sample;
+            }
+
+            // Sound often mix flat parts with sharp edges, the mean residual is a poor guess of the parameter so try them all
+            auto order = (int) (std::min_element(std::begin(sums), std::end(sums)) - std::begin(sums));
+            auto bestParameter = 0;
+            auto bestSize = std::numeric_limits<uint64_t>::max();
+            for (auto parameter=0; parameter<=PCM_CACHE_MAX_RICE_PARAMETER; ++parameter)
+            {
+                auto size = (uint64_t) 0;
+                for (size_t i=0; i<count; ++i)
+                {
+                    auto quotient = residuals[order][i] >> parameter;
+                    size += quotient < PCM_CACHE_RICE_ESCAPE ? quotient + 1 + parameter : PCM_CACHE_RICE_ESCAPE + PCM_CACHE_ESCAPED_BITS;
+                }
+
+                if (size < bestSize)
+                {
+                    bestSize = size;
+                    bestParameter = parameter;
+                }
+            }
+
+            if (bestSize >= count * 16)
+            {
+                writer.write(PCM_CACHE_VERBATIM, PCM_CACHE_HEADER_BITS);
+                for (size_t i=0; i<count; ++i)
+                {
+                    writer.write((uint16_t) samples[(start + i) * PCM_CACHE_CHANNELS + channel], 16);
+                }
+                continue;
+            }
+
+            writer.write((uint32_t) (order << 5) | bestParameter, PCM_CACHE_HEADER_BITS);
+            for (size_t i=0; i<count; ++i)
+            {
+                // A residual far from the others, like the edge of a square wave, is escaped instead of a long unary run
+                auto value = residuals[order][i];
+                auto quotient = value >> bestParameter;
+                if (quotient >= PCM_CACHE_RICE_ESCAPE)
+                {
+                    writer.write(0, PCM_CACHE_RICE_ESCAPE);
+                    writer.write(value, PCM_CACHE_ESCAPED_BITS);
+                    continue;
+                }
+
+                writer.write(1, quotient + 1);
+                writer.write(value & ((1U << bestParameter) - 1), bestParameter);
+            }
+        }
+    }
+
+    writer.flush();
+    output.shrink_to_fit();
+}
+
+void PcmCache::decode(const std::vector<uint8_t>& input, int16_t* samples, size_t frames)
+{
+    BitReader reader = { input.data(), input.size(), 0, 0, 0 };
+    for (auto channel=0; channel<PCM_CACHE_CHANNELS; ++channel)
+    {
+        int32_t previous[2] = { 0, 0 };
+        for (size_t start=0; start<frames; start += PCM_CACHE_PARTITION_FRAMES)
+        {
+            auto count = std::min(frames - start, (size_t) PCM_CACHE_PARTITION_FRAMES);
+            auto header = reader.read(PCM_CACHE_HEADER_BITS);
+            auto order = (int) (header >> 5);
+            auto parameter = (int) (header & 0x1F);
+            for (size_t i=0; i<count; ++i)
+            {
+                int32_t sample;
+                if (header == PCM_CACHE_VERBATIM)
+                {
+                    sample = (int16_t) reader.read(16);
+                }
+                else
+                {
+                    auto quotient = (uint32_t) 0;
+                    while (quotient < PCM_CACHE_RICE_ESCAPE && reader.read(1) == 0)
+                    {
+                        ++quotient;
+                    }
+
+                    auto value = quotient < PCM_CACHE_RICE_ESCAPE
+                        ? (quotient << parameter) | reader.read(parameter)
+                        : reader.read(PCM_CACHE_ESCAPED_BITS);
+                    sample = predict(order, previous) + ((int32_t) (value >> 1) ^ -(int32_t) (value & 1));
+                }
+
+                samples[(start + i) * PCM_CACHE_CHANNELS + channel] = (int16_t) sample;
+                previous[1] = previous[0];
+                previous[0] = sample;
+            }
+        }
+    }
+}
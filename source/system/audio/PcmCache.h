@@ -0,0 +1,101 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <list>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+
+/**
+ * Keep recently rendered sound in memory, so a track can be replayed or sought backward without running the emulation again.
+ * An entry hold a track from its first frame up to where it was rendered so far, split in blocks of PCM_CACHE_BLOCK_FRAMES.
+ * Samples are stored as 16 bits, then each channel is cut in partitions coded with a fixed predictor and Rice codes,
+ * lossless for plugins rendering 16 bits samples and near-lossless for the others. The least recently used entries are evicted to stay under the size limit.
+ * Interleaved float stereo in and out. Not thread safe, only the counters can be read from another thread.
+ */
+class PcmCache
+{
+public:
+    struct Key
+    {
+        uint64_t contentHash;
+        int track;
+        int sampleRate;
+        // Plugins read their settings when a file is opened, the same file rendered with other settings is another entry
+        uint32_t settingsVersion;
+
+        bool operator==(const Key& other) const;
+    };
+
+    PcmCache();
+    virtual ~PcmCache();
+
+    // Drop everything and set the size limit, 0 disable the cache
+    void setup(size_t maxBytes);
+    bool isEnabled() const;
+
+    // Number of frames cached from the start of the track, complete is set if they go up to its end
+    size_t getFrameCount(const Key& key, bool& complete);
+    // Tell if position can be served from the cache and count it as a hit or a miss
+    bool lookup(const Key& key, size_t position, bool requireComplete);
+    size_t read(const Key& key, size_t position, float* stream, size_t frames);
+    // Frames must follow what is already cached, anything written at position 0 start the entry over.
+    // Return false if the entry cannot grow, it is dropped if it would not fit in the cache anyway.
+    bool append(const Key& key, size_t position, const float* stream, size_t frames);
+    void setComplete(const Key& key);
+
+    uint64_t getHitCount() const;
+    uint64_t getMissCount() const;
+    size_t getMemoryUsage() const;
+
+private:
+    struct Entry
+    {
+        Key key;
+        std::vector<std::vector<uint8_t>> blocks;
+        // The last block is kept raw until it is full
+        std::vector<int16_t> pendingSamples;
+        size_t frameCount;
+        size_t memoryUsage;
+        bool complete;
+        uint64_t lastUse;
+    };
+
+    std::list<Entry> mEntries;
+    size_t mMaxBytes;
+    uint64_t mUseCounter;
+    std::atomic<size_t> mMemoryUsage;
+    std::atomic<uint64_t> mHitCount;
+    std::atomic<uint64_t> mMissCount;
+
+    // Last block decoded, reads usually continue in the same one
+    const Entry* mDecodedEntry;
+    size_t mDecodedBlock;
+    std::vector<int16_t> mDecodedSamples;
+
+    PcmCache(const PcmCache& copy);
+
+    Entry* find(const Key& key);
+    void remove(const Entry* entry);
+    void updateMemoryUsage(Entry& entry);
+    bool evict(const Entry* keep);
+    static void encode(const int16_t* samples, size_t frames, std::vector<uint8_t>& output);
+    static void decode(const std::vector<uint8_t>& input, int16_t* samples, size_t frames);
+};
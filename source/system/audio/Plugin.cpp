@@ -23,7 +23,23 @@
 #include <imgui/imgui.h>
 
 
-Plugin::Plugin()
+#define STATS_REFRESH_SECONDS 1.0f     // Period of the decode cost refresh in the player stats
+
+// Choices offered to the user, 0 let the plugin decide
+static const int sSampleRates[] = { 0, 22050, 32000, 44100, 48000 };
+
+
+Plugin::Plugin() :
+mDeviceSampleRate(48000),
+mSampleRate(48000),
+mDecodeNanoseconds(0),
+mDecodedFrames(0),
+mPlayedPosition(0),
+mPlayedDuration(0),
+mStatsElapsed(0),
+mStatsNanoseconds(0),
+mStatsFrames(0),
+mStatsRealtimeFactor(0)
 {
 }
 
@@ -31,15 +47,177 @@ Plugin::~Plugin()
 {
 }
 
-void Plugin::setup(Config config)
+void Plugin::setup(Config config, int deviceSampleRate)
 {
+    // Changing these settings change what is rendered, the PCM cache has to know
     mConfig = config.getGroupOrCreate(getName());
+    mConfig.mVersioned = true;
+    mDeviceSampleRate = deviceSampleRate;
+    mSampleRate = deviceSampleRate;
 }
 
 void Plugin::cleanup()
 {
 }
 
+int Plugin::getSampleRate()
+{
+    return mSampleRate;
+}
+
+void Plugin::recordDecodeTime(uint64_t nanoseconds, size_t frames)
+{
+    mDecodeTimes.record(nanoseconds / 1000);
+    mDecodeNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    mDecodedFrames.fetch_add(frames, std::memory_order_relaxed);
+}
+
+void Plugin::resetDecodeTimes()
+{
+    mDecodeTimes.reset();
+    mDecodeNanoseconds = 0;
+    mDecodedFrames = 0;
+    mStatsElapsed = 0;
+    mStatsNanoseconds = 0;
+    mStatsFrames = 0;
+    mStatsRealtimeFactor = 0;
+}
+
+const Histogram& Plugin::getDecodeTimes()
+{
+    return mDecodeTimes;
+}
+
+double Plugin::getRealtimeFactor()
+{
+    auto nanoseconds = mDecodeNanoseconds.load(std::memory_order_relaxed);
+    auto frames = mDecodedFrames.load(std::memory_order_relaxed);
+    if (nanoseconds == 0 || mSampleRate <= 0)
+    {
+        return 0;
+    }
+
+    return ((double) frames / mSampleRate) / (nanoseconds / 1000000000.0);
+}
+
+void Plugin::recordSeekTime(uint64_t nanoseconds)
+{
+    mSeekTimes.record(nanoseconds / 1000);
+}
+
+const Histogram& Plugin::getSeekTimes()
+{
+    return mSeekTimes;
+}
+
+void Plugin::setPlayedPosition(int position, int duration)
+{
+    mPlayedPosition = position;
+    mPlayedDuration = duration;
+}
+
+int Plugin::selectSampleRate(int preferredSampleRate)
+{
+    auto sampleRate = mConfig.get("sample_rate", 0);
+    if (sampleRate > 0)
+    {
+        return sampleRate;
+    }
+
+    return preferredSampleRate > 0 ? preferredSampleRate : mDeviceSampleRate;
+}
+
+void Plugin::drawSampleRateSetting(LanguageFile languageFile)
+{
+    auto sampleRate = mConfig.get("sample_rate", 0);
+    auto selected = 0;
+    for (auto i=0; i<(int) std::size(sSampleRates); ++i)
+    {
+        if (sSampleRates[i] == sampleRate)
+        {
+            selected = i;
+            break;
+        }
+    }
+
+    auto autoLabel = languageFile.getc("plugin.sample_rate_auto");
+    auto preview = selected == 0 ? std::string(autoLabel) : fmt::format("{:d} Hz", sSampleRates[selected]);
+    if (ImGui::BeginCombo(languageFile.getc("plugin.sample_rate"), preview.c_str()))
+    {
+        for (auto i=0; i<(int) std::size(sSampleRates); ++i)
+        {
+            auto label = i == 0 ? std::string(autoLabel) : fmt::format("{:d} Hz", sSampleRates[i]);
+            if (ImGui::Selectable(label.c_str(), i == selected))
+            {
+                // Applied the next time a song is opened
+                mConfig.set("sample_rate", sSampleRates[i]);
+            }
+        }
+        ImGui::EndCombo();
+    }
+}
+
+void Plugin::drawDecodeStats(LanguageFile languageFile, float deltaTime)
+{
+    // Show the cost over the last period rather than since the song started, so a heavy passage can be seen
+    mStatsElapsed += deltaTime;
+    if (mStatsElapsed >= STATS_REFRESH_SECONDS)
+    {
+        auto nanoseconds = mDecodeNanoseconds.load(std::memory_order_relaxed);
+        auto frames = mDecodedFrames.load(std::memory_order_relaxed);
+        if (nanoseconds > mStatsNanoseconds && mSampleRate > 0)
+        {
+            auto decodedSeconds = (double) (frames - mStatsFrames) / mSampleRate;
+            mStatsRealtimeFactor = decodedSeconds / ((nanoseconds - mStatsNanoseconds) / 1000000000.0);
+        }
+
+        mStatsElapsed = 0;
+        mStatsNanoseconds = nanoseconds;
+        mStatsFrames = frames;
+    }
+
+    if (mStatsRealtimeFactor > 0)
+    {
+        Plugin::drawRow(languageFile.getc("player.realtime_factor"),  fmt::format("{:.1f}x", mStatsRealtimeFactor));
+        Plugin::drawRow(languageFile.getc("player.cpu_usage"),        fmt::format("{:.2f}%", 100.0 / mStatsRealtimeFactor));
+    }
+    else
+    {
+        Plugin::drawRow(languageFile.getc("player.realtime_factor"),  "");
+        Plugin::drawRow(languageFile.getc("player.cpu_usage"),        "");
+    }
+
+    Plugin::drawRow(languageFile.getc("player.decode_time"),
+        fmt::format("{:d} / {:d} / {:d} us", mDecodeTimes.getMean(), mDecodeTimes.getPercentile(99), mDecodeTimes.getMax()));
+}
+
+void Plugin::drawPositionStats(LanguageFile languageFile)
+{
+    auto duration = mPlayedDuration / 1000;
+    auto position = mPlayedPosition / 1000;
+    if (duration > 0)
+    {
+        Plugin::drawRow(languageFile.getc("player.duration"),   fmt::format("{:d}:{:02d}",   duration / 60, duration % 60));
+    }
+    else
+    {
+        Plugin::drawRow(languageFile.getc("player.duration"),   "N/A");
+    }
+
+    Plugin::drawRow(languageFile.getc("player.position"),       fmt::format("{:d}:{:02}",    position / 60, position % 60));
+}
+
+int16_t* Plugin::getSampleBuffer(size_t frames)
+{
+    // The decode thread always ask for the same amount, so this allocate only once
+    if (mSampleBuffer.size() < frames * 2)
+    {
+        mSampleBuffer.resize(frames * 2);
+    }
+
+    return mSampleBuffer.data();
+}
+
 bool Plugin::beginTable(std::string id, bool scrollable, bool twoColumns, float firstColumnWeight)
 {
     auto tableFlags = ImGuiTableFlags_RowBg
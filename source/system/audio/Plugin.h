@@ -18,11 +18,14 @@
 
 #include <vector>
 #include <string>
+#include <atomic>
 
 #include <ECS.h>
 
 #include "../../tools/ConfigFile.h"
 #include "../../tools/LanguageFile.h"
+#include "../../tools/Histogram.h"
+#include "../file/FileBuffer.h"
 
 
 class Plugin
@@ -35,16 +38,41 @@ public:
     virtual std::string getVersion() = 0;
     virtual std::vector<std::string> getSupportedExtensions() = 0;
 
-    virtual void setup(Config config);
+    virtual void setup(Config config, int deviceSampleRate);
     virtual void cleanup();
-    virtual void open(const std::vector<uint8_t>& buffer) = 0;
+    virtual void open(const FileBuffer& buffer) = 0;
     virtual void close() = 0;
-    virtual bool decode(uint8_t* stream, size_t len) = 0;
+    // Interleaved float stereo. frames is the number of frames wanted on input and the number decoded on output.
+    // Return false at the end of the song.
+    virtual bool decode(float* stream, size_t& frames) = 0;
+
+    // Rate of the song currently opened, the AudioSystem resample it if it differ from the device one
+    int getSampleRate();
+
+    // Measured by the AudioSystem around each decode(), recording never lock nor allocate
+    void recordDecodeTime(uint64_t nanoseconds, size_t frames);
+    void resetDecodeTimes();
+    const Histogram& getDecodeTimes();
+    // Seconds of sound decoded per second spent decoding since the last reset, 0 if unknown
+    double getRealtimeFactor();
+    void recordSeekTime(uint64_t nanoseconds);
+    const Histogram& getSeekTimes();
 
     virtual int getCurrentTrack() = 0;
     virtual int getTrackCount() = 0;
     virtual void setSubSong(int subsong) = 0;
 
+    // Position and duration of the current track in milliseconds, 0 if unknown
+    virtual int getPosition() = 0;
+    virtual int getDuration() = 0;
+    // Move to a position in the current track, each engine do it its cheapest way which may still take a while
+    virtual void seek(int milliseconds) = 0;
+
+    // Position heard and duration in milliseconds, given by the AudioSystem on the main thread for the player stats
+    void setPlayedPosition(int position, int duration);
+
+    // Drawn by the main thread while the decode thread may be rendering, stats and metadata only show what the plugin
+    // published when it opened the file or changed track, never the engine state.
     virtual void drawSettings(ECS::World* world, LanguageFile languageFile, float deltaTime) = 0;
     virtual void drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime) = 0;
     virtual void drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime) = 0;
@@ -56,7 +84,37 @@ public:
 
 protected:
     Config mConfig;
+    int mDeviceSampleRate;
+    int mSampleRate;
+
+    // Sample rate set by the user for this plugin if any, otherwise the preferred one, otherwise the device one
+    int selectSampleRate(int preferredSampleRate = 0);
+    void drawSampleRateSetting(LanguageFile languageFile);
+
+    // Rows showing the decode cost, to be drawn in the player stats table
+    void drawDecodeStats(LanguageFile languageFile, float deltaTime);
+    // Duration and position rows, from what the AudioSystem gave with setPlayedPosition
+    void drawPositionStats(LanguageFile languageFile);
+
+    // Scratch buffer for plugins rendering 16 bits samples before the float conversion, only grow
+    int16_t* getSampleBuffer(size_t frames);
 
 private:
+    std::vector<int16_t> mSampleBuffer;
+
+    // Decode time of each call in microseconds, and totals to compute the cost
+    Histogram mDecodeTimes;
+    std::atomic<uint64_t> mDecodeNanoseconds;
+    std::atomic<uint64_t> mDecodedFrames;
+    Histogram mSeekTimes;
+
+    // Main thread only, the cost shown is refreshed every STATS_REFRESH_SECONDS
+    int mPlayedPosition;
+    int mPlayedDuration;
+    float mStatsElapsed;
+    uint64_t mStatsNanoseconds;
+    uint64_t mStatsFrames;
+    double mStatsRealtimeFactor;
+
     Plugin(const Plugin& copy);
 };
@@ -0,0 +1,249 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Resampler.h"
+
+#include <cmath>
+#include <numeric>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define MAX_PHASES 1024                 // Above that the ratio is approximated, the pitch error stay below 0.05%
+
+// Taps per phase, passband and Kaiser window beta for each quality preset
+static const struct
+{
+    int taps;
+    double passband;
+    double beta;
+} sQualityPresets[Resampler::QUALITY_COUNT] =
+{
+    { .taps = 8,  .passband = 0.80, .beta = 5.0 },
+    { .taps = 16, .passband = 0.90, .beta = 7.0 },
+    { .taps = 32, .passband = 0.95, .beta = 9.0 }
+};
+
+
+// Zeroth order modified Bessel function of the first kind, used by the Kaiser window
+static double besselI0(double x)
+{
+    auto sum = 1.0;
+    auto term = 1.0;
+    for (auto k=1; k<32; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+Resampler::Resampler() :
+mPassthrough(true),
+mTaps(0),
+mPhaseCount(1),
+mPhaseStep(1),
+mPhase(0),
+mInputIndex(0),
+mBufferedFrames(0)
+{
+}
+
+Resampler::~Resampler()
+{
+}
+
+void Resampler::setup(int inputSampleRate, int outputSampleRate, Quality quality, size_t maxInputFrames)
+{
+    mPassthrough = inputSampleRate == outputSampleRate;
+    if (mPassthrough)
+    {
+        mTaps = 0;
+        mCoefficients.clear();
+        mHistory[0].clear();
+        mHistory[1].clear();
+        return;
+    }
+
+    // Every output frame is at a position multiple of 1/mPhaseCount input frame, so one filter per phase is enough
+    auto divisor = std::gcd(inputSampleRate, outputSampleRate);
+    mPhaseCount = outputSampleRate / divisor;
+    mPhaseStep = inputSampleRate / divisor;
+    if (mPhaseCount > MAX_PHASES)
+    {
+        mPhaseStep = std::max((int) std::lround((double) mPhaseStep * MAX_PHASES / mPhaseCount), 1);
+        mPhaseCount = MAX_PHASES;
+    }
+
+    // When downsampling the cutoff follow the output rate, so the filter need more taps to stay as steep.
+    // Taps are kept multiple of 4 for the SIMD dot product.
+    auto& preset = sQualityPresets[quality];
+    auto ratio = std::min((double) mPhaseCount / mPhaseStep, 1.0);
+    auto cutoff = 0.5 * ratio * preset.passband;
+    mTaps = ((int) std::ceil(preset.taps / ratio) + 3) & ~3;
+
+    auto halfTaps = mTaps / 2;
+    auto windowNorm = besselI0(preset.beta);
+    mCoefficients.resize(mPhaseCount * mTaps);
+    for (auto phase=0; phase<mPhaseCount; ++phase)
+    {
+        // Tap j multiply the input frame located at (j - halfTaps + 1 - fraction) from the output position
+        auto fraction = (double) phase / mPhaseCount;
+        auto* coefficients = &mCoefficients[phase * mTaps];
+        auto sum = 0.0;
+        for (auto j=0; j<mTaps; ++j)
+        {
+            auto x = j - halfTaps + 1 - fraction;
+            auto sinc = x == 0.0 ? 1.0 : std::sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+            auto w = x / halfTaps;
+            auto window = std::abs(w) >= 1.0 ? 0.0 : besselI0(preset.beta * std::sqrt(1.0 - w * w)) / windowNorm;
+            coefficients[j] = (float) (sinc * window);
+            sum += coefficients[j];
+        }
+
+        // Unity gain for every phase
+        for (auto j=0; j<mTaps; ++j)
+        {
+            coefficients[j] = (float) (coefficients[j] / sum);
+        }
+    }
+
+    for (auto& history : mHistory)
+    {
+        history.resize(mTaps * 2 + maxInputFrames * 2);
+    }
+
+    reset();
+}
+
+void Resampler::reset()
+{
+    if (mPassthrough)
+    {
+        return;
+    }
+
+    // Prime the history with silence so the first output frame is centered on the first input frame
+    mPhase = 0;
+    mInputIndex = 0;
+    mBufferedFrames = mTaps / 2 - 1;
+    for (auto& history : mHistory)
+    {
+        std::fill_n(history.begin(), mBufferedFrames, 0.0f);
+    }
+}
+
+bool Resampler::isPassthrough() const
+{
+    return mPassthrough;
+}
+
+size_t Resampler::getInputFrames(size_t outputFrames) const
+{
+    if (outputFrames == 0)
+    {
+        return 0;
+    }
+
+    // Position of the first tap of the last output frame wanted
+    auto lastIndex = mInputIndex + (mPhase + (outputFrames - 1) * mPhaseStep) / mPhaseCount;
+    auto required = lastIndex + mTaps;
+    return required > mBufferedFrames ? required - mBufferedFrames : 0;
+}
+
+size_t Resampler::process(const float* input, size_t inputFrames, float* output, size_t outputFrames)
+{
+    auto* __restrict left = mHistory[0].data();
+    auto* __restrict right = mHistory[1].data();
+
+    // Append the input de-interleaved, anything that does not fit is lost (caller should use getInputFrames)
+    inputFrames = std::min(inputFrames, mHistory[0].size() - mBufferedFrames);
+    for (size_t i=0; i<inputFrames; ++i)
+    {
+        left[mBufferedFrames + i] = input[i*2];
+        right[mBufferedFrames + i] = input[i*2+1];
+    }
+    mBufferedFrames += inputFrames;
+
+    size_t written = 0;
+    while (written < outputFrames && mInputIndex + mTaps <= mBufferedFrames)
+    {
+        dotProduct(&mCoefficients[mPhase * mTaps], &left[mInputIndex], &right[mInputIndex], mTaps, output[written*2], output[written*2+1]);
+        written++;
+
+        mPhase += mPhaseStep;
+        mInputIndex += mPhase / mPhaseCount;
+        mPhase %= mPhaseCount;
+    }
+
+    // Drop what will never be used again
+    auto consumed = std::min(mInputIndex, mBufferedFrames);
+    memmove(left, &left[consumed], (mBufferedFrames - consumed) * sizeof(float));
+    memmove(right, &right[consumed], (mBufferedFrames - consumed) * sizeof(float));
+    mBufferedFrames -= consumed;
+    mInputIndex -= consumed;
+
+    return written;
+}
+
+void Resampler::dotProduct(const float* coefficients, const float* left, const float* right, int count, float& outLeft, float& outRight)
+{
+    // count is always a multiple of 4, coefficients are shared by both channels
+#if defined(__SSE2__)
+    auto sumLeft = _mm_setzero_ps();
+    auto sumRight = _mm_setzero_ps();
+    for (auto i=0; i<count; i+=4)
+    {
+        auto c = _mm_loadu_ps(&coefficients[i]);
+        sumLeft = _mm_add_ps(sumLeft, _mm_mul_ps(c, _mm_loadu_ps(&left[i])));
+        sumRight = _mm_add_ps(sumRight, _mm_mul_ps(c, _mm_loadu_ps(&right[i])));
+    }
+
+    // Horizontal add of both sums at once: [l0+l1, r0+r1, l2+l3, r2+r3]
+    auto low = _mm_unpacklo_ps(sumLeft, sumRight);
+    auto high = _mm_unpackhi_ps(sumLeft, sumRight);
+    auto sum = _mm_add_ps(low, high);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    outLeft = _mm_cvtss_f32(sum);
+    outRight = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    auto sumLeft = vdupq_n_f32(0.0f);
+    auto sumRight = vdupq_n_f32(0.0f);
+    for (auto i=0; i<count; i+=4)
+    {
+        auto c = vld1q_f32(&coefficients[i]);
+        sumLeft = vfmaq_f32(sumLeft, c, vld1q_f32(&left[i]));
+        sumRight = vfmaq_f32(sumRight, c, vld1q_f32(&right[i]));
+    }
+
+    outLeft = vaddvq_f32(sumLeft);
+    outRight = vaddvq_f32(sumRight);
+#else
+    outLeft = 0.0f;
+    outRight = 0.0f;
+    for (auto i=0; i<count; ++i)
+    {
+        outLeft += coefficients[i] * left[i];
+        outRight += coefficients[i] * right[i];
+    }
+#endif
+}
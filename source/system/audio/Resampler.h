@@ -0,0 +1,63 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * Polyphase windowed sinc resampler for interleaved float stereo.
+ * The filter bank is computed once by setup(), process() only do dot products (SSE2 or NEON when available).
+ * Input is kept in an internal history, ask getInputFrames() how much is needed before calling process().
+ */
+class Resampler
+{
+public:
+    enum Quality
+    {
+        LOW,
+        MEDIUM,
+        HIGH,
+        QUALITY_COUNT
+    };
+
+    Resampler();
+    virtual ~Resampler();
+
+    void setup(int inputSampleRate, int outputSampleRate, Quality quality, size_t maxInputFrames);
+    void reset();
+
+    bool isPassthrough() const;
+    size_t getInputFrames(size_t outputFrames) const;
+    size_t process(const float* input, size_t inputFrames, float* output, size_t outputFrames);
+
+private:
+    bool mPassthrough;
+    int mTaps;
+    int mPhaseCount;
+    int mPhaseStep;
+    int mPhase;
+    size_t mInputIndex;
+    size_t mBufferedFrames;
+    std::vector<float> mCoefficients;
+    std::vector<float> mHistory[2];
+
+    Resampler(const Resampler& copy);
+
+    static void dotProduct(const float* coefficients, const float* left, const float* right, int count, float& outLeft, float& outRight);
+};
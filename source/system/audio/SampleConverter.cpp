@@ -0,0 +1,56 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SampleConverter.h"
+
+#define INT16_TO_FLOAT (1.0f / 32768.0f)
+#define FLOAT_TO_INT16 32768.0f                 // Same scale both ways so int16 samples come back unchanged
+#define FLOAT_TO_INT32 2147483648.0
+#define FLOAT_ROUNDING 12582912.0f              // 1.5 * 2^23, adding it drop the fraction of any float below 2^22
+#define DOUBLE_ROUNDING 6755399441055744.0      // 1.5 * 2^52, same for doubles so the whole int32 range is rounded
+
+
+void SampleConverter::int16ToFloat(const int16_t* __restrict input, float* __restrict output, size_t count)
+{
+    for (size_t i=0; i<count; ++i)
+    {
+        output[i] = (float) input[i] * INT16_TO_FLOAT;
+    }
+}
+
+void SampleConverter::floatToInt16(const float* __restrict input, int16_t* __restrict output, size_t count)
+{
+    for (size_t i=0; i<count; ++i)
+    {
+        // Round to nearest like lrintf() before saturating, clamping first would stop gcc from vectorizing the loop
+        auto sample = (input[i] * FLOAT_TO_INT16 + FLOAT_ROUNDING) - FLOAT_ROUNDING;
+        sample = sample < INT16_MIN ? INT16_MIN : sample;
+        sample = sample > INT16_MAX ? INT16_MAX : sample;
+        output[i] = (int16_t) (int32_t) sample;
+    }
+}
+
+void SampleConverter::floatToInt32(const float* __restrict input, int32_t* __restrict output, size_t count)
+{
+    for (size_t i=0; i<count; ++i)
+    {
+        // Done in double since a float can not hold INT32_MAX
+        auto sample = ((double) input[i] * FLOAT_TO_INT32 + DOUBLE_ROUNDING) - DOUBLE_ROUNDING;
+        sample = sample < INT32_MIN ? INT32_MIN : sample;
+        sample = sample > INT32_MAX ? INT32_MAX : sample;
+        output[i] = (int32_t) sample;
+    }
+}
@@ -0,0 +1,37 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+
+/**
+ * Conversions between the float samples used by the audio pipeline and the integer formats of plugins and devices.
+ * Loops are branch free so the compiler vectorize them (SSE2 on x86_64, NEON on aarch64).
+ * Float samples are expected in [-1, 1], anything outside is saturated when converted to integers.
+ */
+class SampleConverter
+{
+public:
+    static void int16ToFloat(const int16_t* input, float* output, size_t count);
+    static void floatToInt16(const float* input, int16_t* output, size_t count);
+    static void floatToInt32(const float* input, int32_t* output, size_t count);
+
+private:
+    SampleConverter();
+};
@@ -17,13 +17,20 @@
 #include "Sc68Plugin.h"
 
 #include <stdexcept>
+#include <algorithm>
 #include <fmt/format.h>
 #include <sc68/file68.h>
 
 #include <imgui/imgui.h>
 
+#include "SampleConverter.h"
 #include "../../config.h"
 
+#define SEEK_FRAMES 4096                // Number of frames rendered at once while seeking
+#define SEEK_EXTRA_CHUNKS 16            // Chunks rendered past the expected count before a seek gives up
+
+// sc68_init/sc68_shutdown are global to the library, count instances to call them only once
+int Sc68Plugin::sInstanceCount = 0;
 
 Sc68Plugin::Sc68Plugin() :
 Plugin(),
@@ -55,17 +62,19 @@ std::vector<std::string> Sc68Plugin::getSupportedExtensions()
     };
 }
 
-void Sc68Plugin::setup(Config config)
+void Sc68Plugin::setup(Config config, int deviceSampleRate)
 {
-    Plugin::setup(config);
+    Plugin::setup(config, deviceSampleRate);
 
-    if (sc68_init(nullptr))
+    if (sInstanceCount == 0 && sc68_init(nullptr))
     {
         throw std::runtime_error("sc68_init failed");
     }
 
+    sInstanceCount++;
+
     mSC68Config = {0};
-    mSC68Config.sampling_rate = 48000;
+    mSC68Config.sampling_rate = deviceSampleRate;
     mSC68 = sc68_create(&mSC68Config);
     if (mSC68 == nullptr)
     {
@@ -78,22 +87,30 @@ void Sc68Plugin::cleanup()
     if (mSC68 != nullptr)
     {
         sc68_destroy(mSC68);
+        mSC68 = nullptr;
+    }
+
+    sInstanceCount--;
+    if (sInstanceCount == 0)
+    {
         sc68_shutdown();
     }
 
     Plugin::cleanup();
 }
 
-void Sc68Plugin::open(const std::vector<uint8_t>& buffer)
+void Sc68Plugin::open(const FileBuffer& buffer)
 {
     auto aSIDifierEnabled = mConfig.get("enable_asidifier", false);
     auto loop = mConfig.get("loop", false);
 
-    if (sc68_load_mem(mSC68, buffer.data(), buffer.size()) != 0)
+    if (sc68_load_mem(mSC68, buffer.getData(), buffer.getSize()) != 0)
     {
         throw std::runtime_error(sc68_error(mSC68));
     }
 
+    mSampleRate = selectSampleRate();
+    sc68_cntl(mSC68, SC68_SET_SPR, mSampleRate);
     sc68_cntl(mSC68, SC68_SET_ASID, aSIDifierEnabled ? SC68_ASID_ON : SC68_ASID_OFF);
     if (sc68_play(mSC68, SC68_DEF_TRACK, loop ? SC68_INF_LOOP : SC68_DEF_LOOP) < 0)
     {
@@ -105,6 +122,7 @@ void Sc68Plugin::open(const std::vector<uint8_t>& buffer)
     sc68_music_info(mSC68, &diskInfo, -1, 0);
     mTrackCount = diskInfo.tracks;
     mCurrentTrack = sc68_cntl(mSC68, SC68_GET_TRACK);
+    publishInformation();
 }
 
 int Sc68Plugin::getCurrentTrack()
@@ -148,6 +166,84 @@ void Sc68Plugin::setSubSong(int subsong)
         sc68_process(mSC68, nullptr, 0);
         mCurrentTrack = sc68_cntl(mSC68, SC68_GET_TRACK);
     }
+
+    publishInformation();
+}
+
+int Sc68Plugin::getPosition()
+{
+    if (mSC68 == nullptr)
+    {
+        return 0;
+    }
+
+    return sc68_cntl(mSC68, SC68_GET_POS);
+}
+
+int Sc68Plugin::getDuration()
+{
+    if (mSC68 == nullptr)
+    {
+        return 0;
+    }
+
+    sc68_music_info_t trackInfo;
+    if (sc68_music_info(mSC68, &trackInfo, mCurrentTrack, 0) != 0)
+    {
+        return 0;
+    }
+
+    return trackInfo.trk.time_ms;
+}
+
+void Sc68Plugin::seek(int milliseconds)
+{
+    if (mSC68 == nullptr)
+    {
+        return;
+    }
+
+    // Emulation can only go forward, start the track again to go backward
+    if (milliseconds < getPosition())
+    {
+        auto loop = mConfig.get("loop", false);
+        sc68_stop(mSC68);
+        sc68_play(mSC68, mCurrentTrack, loop ? SC68_INF_LOOP : SC68_DEF_LOOP);
+        sc68_process(mSC68, nullptr, 0);
+    }
+
+    // sc68 have no fast path, run the emulation and throw the sound away. The position restart from 0
+    // on the next track or loop, so the seek stop there and never render much more than the distance asked.
+    auto duration = getDuration();
+    if (duration > 0)
+    {
+        milliseconds = std::min(milliseconds, duration);
+    }
+
+    auto* samples = getSampleBuffer(SEEK_FRAMES);
+    auto chunks = (int64_t) (milliseconds - getPosition()) * mSampleRate / 1000 / SEEK_FRAMES + SEEK_EXTRA_CHUNKS;
+    while (getPosition() < milliseconds && chunks-- > 0)
+    {
+        auto amount = (int) SEEK_FRAMES;
+        auto retCode = sc68_process(mSC68, samples, &amount);
+        if (retCode == SC68_ERROR)
+        {
+            throw std::runtime_error(sc68_error(mSC68));
+        }
+
+        if (retCode & SC68_CHANGE)
+        {
+            // Seeked past the end, sc68 went on with the next track
+            mCurrentTrack = sc68_cntl(mSC68, SC68_GET_TRACK);
+            publishInformation();
+            break;
+        }
+
+        if (retCode & SC68_END)
+        {
+            break;
+        }
+    }
 }
 
 void Sc68Plugin::close()
@@ -160,23 +256,35 @@ void Sc68Plugin::close()
 
     mCurrentTrack = 0;
     mTrackCount = 0;
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>());
 }
 
-bool Sc68Plugin::decode(uint8_t *stream, size_t len)
+bool Sc68Plugin::decode(float* stream, size_t& frames)
 {
     if (mSC68 == nullptr)
     {
+        frames = 0;
         return false;
     }
 
-    auto amount = (int) len / 4;
-    auto retCode = sc68_process(mSC68, stream, &amount);
+    auto* samples = getSampleBuffer(frames);
+    auto amount = (int) frames;
+    auto retCode = sc68_process(mSC68, samples, &amount);
 
     if (retCode == SC68_ERROR)
     {
         throw std::runtime_error(sc68_error(mSC68));
     }
 
+    if (retCode & SC68_CHANGE)
+    {
+        // sc68 went on with the next track by itself
+        mCurrentTrack = sc68_cntl(mSC68, SC68_GET_TRACK);
+        publishInformation();
+    }
+
+    SampleConverter::int16ToFloat(samples, stream, amount * 2);
+    frames = amount;
     return !(retCode & SC68_END);
 }
 
@@ -193,66 +301,47 @@ void Sc68Plugin::drawSettings(ECS::World *world, LanguageFile languageFile, floa
     {
         mConfig.set("enable_asidifier", aSIDifierEnabled);
     }
+
+    drawSampleRateSetting(languageFile);
 }
 
 void Sc68Plugin::drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mSC68 == nullptr)
-    {
-        return;
-    }
-
-    sc68_music_info_t trackInfo;
-
-    mCurrentTrack = sc68_cntl(mSC68, SC68_GET_TRACK);
-    int trackResult = sc68_music_info(mSC68, &trackInfo, mCurrentTrack, 0);
-    auto position = sc68_cntl(mSC68, SC68_GET_POS) / 1000;
-    auto duration = trackInfo.trk.time_ms / 1000;
-
-    if (trackResult != 0)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
     if (Plugin::beginTable(languageFile.getc("player"), false))
     {
-        Plugin::drawRow(languageFile.getc("player.title"),      trackInfo.title);
-        Plugin::drawRow(languageFile.getc("player.track"),      fmt::format("{:d}/{:d}",     mCurrentTrack, mTrackCount));
-        Plugin::drawRow(languageFile.getc("player.duration"),   fmt::format("{:d}:{:02d}",   duration / 60, duration % 60));
-        Plugin::drawRow(languageFile.getc("player.position"),   fmt::format("{:d}:{:02}",    position / 60, position % 60));
+        Plugin::drawRow(languageFile.getc("player.title"),      information->title);
+        Plugin::drawRow(languageFile.getc("player.track"),      fmt::format("{:d}/{:d}",     information->track, information->trackCount));
+        Plugin::drawPositionStats(languageFile);
+        Plugin::drawDecodeStats(languageFile, deltaTime);
         Plugin::endTable();
     }
 }
 
 void Sc68Plugin::drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mSC68 == nullptr)
-    {
-        return;
-    }
-
-    sc68_music_info_t diskInfo;
-    sc68_music_info_t trackInfo;
-
-    int diskResult = sc68_music_info(mSC68, &diskInfo, -1, 0);
-    int trackResult = sc68_music_info(mSC68, &trackInfo, mCurrentTrack, 0);
-
-    if (diskResult != 0 || trackResult != 0)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
     if (Plugin::beginTable(languageFile.getc("metadata"), false))
     {
-        Plugin::drawRow(languageFile.getc("metadata.album"),        diskInfo.album);
-        Plugin::drawRow(languageFile.getc("metadata.author"),       trackInfo.artist);
-        Plugin::drawRow(languageFile.getc("metadata.genre"),        trackInfo.genre);
-        Plugin::drawRow(languageFile.getc("metadata.copyright"),    trackInfo.year);
-        Plugin::drawRow(languageFile.getc("metadata.ripper"),       diskInfo.ripper);
-        Plugin::drawRow(languageFile.getc("metadata.converter"),    diskInfo.converter);
-        Plugin::drawRow(languageFile.getc("metadata.replay"),       diskInfo.replay);
-        Plugin::drawRow(languageFile.getc("metadata.hardware"),     diskInfo.trk.hw);
-        if (diskInfo.trk.asid)
+        Plugin::drawRow(languageFile.getc("metadata.album"),        information->album);
+        Plugin::drawRow(languageFile.getc("metadata.author"),       information->artist);
+        Plugin::drawRow(languageFile.getc("metadata.genre"),        information->genre);
+        Plugin::drawRow(languageFile.getc("metadata.copyright"),    information->year);
+        Plugin::drawRow(languageFile.getc("metadata.ripper"),       information->ripper);
+        Plugin::drawRow(languageFile.getc("metadata.converter"),    information->converter);
+        Plugin::drawRow(languageFile.getc("metadata.replay"),       information->replay);
+        Plugin::drawRow(languageFile.getc("metadata.hardware"),     information->hardware);
+        if (information->asid)
         {
             auto& style = ImGui::GetStyle();
             auto textSize = ImGui::CalcTextSize("[ASID]");
@@ -263,3 +352,30 @@ void Sc68Plugin::drawMetadata(ECS::World* world, LanguageFile languageFile, floa
         Plugin::endTable();
     }
 }
+
+void Sc68Plugin::publishInformation()
+{
+    // sc68_music_info is not safe to call while sc68_process run, the main thread draw this copy instead
+    sc68_music_info_t diskInfo;
+    sc68_music_info_t trackInfo;
+    if (sc68_music_info(mSC68, &diskInfo, -1, 0) != 0 || sc68_music_info(mSC68, &trackInfo, mCurrentTrack, 0) != 0)
+    {
+        std::atomic_store(&mInformation, std::shared_ptr<const Information>());
+        return;
+    }
+
+    auto information = std::make_shared<Information>();
+    information->track = mCurrentTrack;
+    information->trackCount = mTrackCount;
+    information->title = trackInfo.title;
+    information->album = diskInfo.album;
+    information->artist = trackInfo.artist;
+    information->genre = trackInfo.genre;
+    information->year = trackInfo.year;
+    information->ripper = diskInfo.ripper;
+    information->converter = diskInfo.converter;
+    information->replay = diskInfo.replay;
+    information->hardware = diskInfo.trk.hw;
+    information->asid = diskInfo.trk.asid;
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>(information));
+}
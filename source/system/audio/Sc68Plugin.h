@@ -18,6 +18,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
 #include <sc68/sc68.h>
 #include <ECS.h>
@@ -38,25 +39,50 @@ public:
     virtual std::string getVersion() override;
     virtual std::vector<std::string> getSupportedExtensions() override;
 
-    virtual void setup(Config config) override;
+    virtual void setup(Config config, int deviceSampleRate) override;
     virtual void cleanup() override;
-    virtual void open(const std::vector<uint8_t>& buffer) override;
+    virtual void open(const FileBuffer& buffer) override;
     virtual void close() override;
-    virtual bool decode(uint8_t* stream, size_t len) override;
+    virtual bool decode(float* stream, size_t& frames) override;
 
     virtual int getCurrentTrack();
     virtual int getTrackCount();
     virtual void setSubSong(int subsong);
+    virtual int getPosition();
+    virtual int getDuration();
+    virtual void seek(int milliseconds);
 
     virtual void drawSettings(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
     virtual void drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
     virtual void drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
 
 private:
+    // What the player stats and metadata show, replaced as a whole by the thread that own the plugin
+    struct Information
+    {
+        int track;
+        int trackCount;
+        std::string title;
+        std::string album;
+        std::string artist;
+        std::string genre;
+        std::string year;
+        std::string ripper;
+        std::string converter;
+        std::string replay;
+        std::string hardware;
+        bool asid;
+    };
+
     sc68_create_t mSC68Config;
     sc68_t* mSC68;
     int mCurrentTrack;
     int mTrackCount;
+    std::shared_ptr<const Information> mInformation;
+
+    void publishInformation();
+
+    static int sInstanceCount;
 
     Sc68Plugin(const Sc68Plugin& copy);
 };
@@ -29,8 +29,12 @@
 
 #include <imgui/imgui.h>
 
+#include "SampleConverter.h"
 #include "../../config.h"
 
+#define SEEK_FRAMES 4096                // Most frames rendered at once while seeking
+#define SEEK_FAST_FORWARD_PERCENT 3200  // Fastest emulation speed allowed by sidplayfp
+
 
 SidplayfpPlugin::SidplayfpPlugin() :
 Plugin(),
@@ -38,7 +42,8 @@ mPlayer(nullptr),
 mBuilder(nullptr),
 mTune(nullptr),
 mCurrentTrack(0),
-mTrackCount(0)
+mTrackCount(0),
+mPlayedFrames(0)
 {
 }
 
@@ -64,9 +69,9 @@ std::vector<std::string> SidplayfpPlugin::getSupportedExtensions()
     };
 }
 
-void SidplayfpPlugin::setup(Config config)
+void SidplayfpPlugin::setup(Config config, int deviceSampleRate)
 {
-    Plugin::setup(config);
+    Plugin::setup(config, deviceSampleRate);
 
     mPlayer = new sidplayfp();
 
@@ -115,14 +120,16 @@ void SidplayfpPlugin::cleanup()
     Plugin::cleanup();
 }
 
-void SidplayfpPlugin::open(const std::vector<uint8_t>& buffer)
+void SidplayfpPlugin::open(const FileBuffer& buffer)
 {
     auto digiBoost = mConfig.get("enable_digiboost", false);
     auto fastSampling = mConfig.get("enable_fast_sampling", false);
     auto samplingMethod = mConfig.get("sampling_method", SidConfig::RESAMPLE_INTERPOLATE);
 
+    mSampleRate = selectSampleRate();
+
     SidConfig cfg;
-    cfg.frequency = 48000;
+    cfg.frequency = mSampleRate;
     cfg.samplingMethod = (SidConfig::sampling_method_t) samplingMethod;
     cfg.fastSampling = fastSampling;
     cfg.digiBoost = digiBoost;
@@ -134,7 +141,7 @@ void SidplayfpPlugin::open(const std::vector<uint8_t>& buffer)
         throw std::runtime_error(mPlayer->error());
     }
 
-    mTune = new SidTune(buffer.data(), buffer.size());
+    mTune = new SidTune(buffer.getData(), buffer.getSize());
     if (mTune->getStatus() == false)
     {
         throw std::runtime_error(mTune->statusString());
@@ -144,12 +151,14 @@ void SidplayfpPlugin::open(const std::vector<uint8_t>& buffer)
     auto musicInfo = mTune->getInfo();
     mTrackCount = musicInfo->songs();
 
-    mCurrentTrack = 0;
-    mTune->selectSong(mCurrentTrack);
+    mPlayedFrames = 0;
+    mTune->selectSong(0);
     if (!mPlayer->load(mTune))
     {
         throw std::runtime_error(mPlayer->error());
     }
+    mCurrentTrack = musicInfo->currentSong();
+    publishInformation();
 }
 
 int SidplayfpPlugin::getCurrentTrack()
@@ -169,6 +178,7 @@ void SidplayfpPlugin::setSubSong(int subsong)
         return;
     }
 
+    mPlayedFrames = 0;
     if (subsong < 0)
     {
         mPlayer->load(nullptr);
@@ -187,6 +197,74 @@ void SidplayfpPlugin::setSubSong(int subsong)
         mTune->selectSong(subsong);
         mPlayer->load(mTune);
     }
+
+    // 0 select the default song of the tune
+    mCurrentTrack = mTune->getInfo()->currentSong();
+    publishInformation();
+}
+
+int SidplayfpPlugin::getPosition()
+{
+    if (mPlayer == nullptr || mTune == nullptr)
+    {
+        return 0;
+    }
+
+    return (int) (mPlayedFrames * 1000 / mSampleRate);
+}
+
+int SidplayfpPlugin::getDuration()
+{
+    // Would need the HVSC song length database
+    return 0;
+}
+
+void SidplayfpPlugin::seek(int milliseconds)
+{
+    if (mPlayer == nullptr || mTune == nullptr)
+    {
+        return;
+    }
+
+    // Emulation can only go forward, start the tune again to go backward
+    if (milliseconds < getPosition())
+    {
+        mPlayedFrames = 0;
+        mPlayer->load(nullptr);
+        mTune->selectSong(mTune->getInfo()->currentSong());
+        if (!mPlayer->load(mTune))
+        {
+            throw std::runtime_error(mPlayer->error());
+        }
+    }
+
+    // Each frame rendered at the fastest speed cover SEEK_FAST_FORWARD_PERCENT / 100 frames of the tune. Chunks shrink
+    // near the target so it is not overshot, the frames that are left are rendered at normal speed.
+    auto* samples = getSampleBuffer(SEEK_FRAMES);
+    auto target = (uint64_t) milliseconds * mSampleRate / 1000;
+    auto speed = (uint64_t) SEEK_FAST_FORWARD_PERCENT / 100;
+    auto played = (uint_least32_t) 1;
+    mPlayer->fastForward(SEEK_FAST_FORWARD_PERCENT);
+    while (played > 0 && mPlayedFrames + speed <= target)
+    {
+        auto frames = std::min((target - mPlayedFrames) / speed, (uint64_t) SEEK_FRAMES);
+        played = mPlayer->play(samples, frames * 2);
+        mPlayedFrames += played / 2 * speed;
+    }
+    mPlayer->fastForward(100);
+
+    while (played > 0 && mPlayedFrames < target)
+    {
+        auto frames = std::min(target - mPlayedFrames, (uint64_t) SEEK_FRAMES);
+        played = mPlayer->play(samples, frames * 2);
+        mPlayedFrames += played / 2;
+    }
+
+    if (played == 0)
+    {
+        // The position is where the engine stopped
+        throw std::runtime_error(mPlayer->error());
+    }
 }
 
 void SidplayfpPlugin::close()
@@ -205,23 +283,30 @@ void SidplayfpPlugin::close()
 
     mCurrentTrack = 0;
     mTrackCount = 0;
+    mPlayedFrames = 0;
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>());
 }
 
-bool SidplayfpPlugin::decode(uint8_t* stream, size_t len)
+bool SidplayfpPlugin::decode(float* stream, size_t& frames)
 {
     if (mPlayer == nullptr || mTune == nullptr)
     {
+        frames = 0;
         return false;
     }
 
-    auto size = (uint_least32_t) len / 2;
-    auto played = mPlayer->play((short*) stream, size);
+    auto* samples = getSampleBuffer(frames);
+    auto size = (uint_least32_t) frames * 2;
+    auto played = mPlayer->play(samples, size);
 
     if (played < size && mPlayer->isPlaying())
     {
         throw std::runtime_error(mPlayer->error());
     }
 
+    SampleConverter::int16ToFloat(samples, stream, played);
+    frames = played / 2;
+    mPlayedFrames += frames;
     return true;
 }
 
@@ -244,47 +329,44 @@ void SidplayfpPlugin::drawSettings(ECS::World* world, LanguageFile languageFile,
     {
         mConfig.set("sampling_method", samplingMethod);
     }
+
+    drawSampleRateSetting(languageFile);
 }
 
 void SidplayfpPlugin::drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mTune == nullptr)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
-    auto musicInfo = mTune->getInfo();
-    auto title = musicInfo->infoString(0);
-    mCurrentTrack = musicInfo->currentSong(); // Never change while playing ?
-
     if (Plugin::beginTable(languageFile.getc("player"), false))
     {
-        Plugin::drawRow(languageFile.getc("player.title"),    title);
-        Plugin::drawRow(languageFile.getc("player.track"),    fmt::format("{:d}/{:d}", mCurrentTrack, mTrackCount));
-        Plugin::drawRow(languageFile.getc("player.duration"),   "N/A");
-        Plugin::drawRow(languageFile.getc("player.position"),   "N/A");
+        Plugin::drawRow(languageFile.getc("player.title"),    information->title);
+        Plugin::drawRow(languageFile.getc("player.track"),    fmt::format("{:d}/{:d}", information->track, information->trackCount));
+        Plugin::drawPositionStats(languageFile);
+        Plugin::drawDecodeStats(languageFile, deltaTime);
         Plugin::endTable();
     }
 }
 
 void SidplayfpPlugin::drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime)
 {
-    if (mTune == nullptr)
+    auto information = std::atomic_load(&mInformation);
+    if (information == nullptr)
     {
         return;
     }
 
-    auto musicInfo = mTune->getInfo();
-    auto author = musicInfo->infoString(1);
-    auto copyright =  musicInfo->infoString(2);
-    auto sidModel = musicInfo->sidModel(0);
-    auto clockSpeed = musicInfo->clockSpeed();
-    auto compatibility = musicInfo->compatibility();
+    auto sidModel = information->sidModel;
+    auto clockSpeed = information->clockSpeed;
+    auto compatibility = information->compatibility;
 
     if (Plugin::beginTable(languageFile.getc("metadata"), false))
     {
-        Plugin::drawRow(languageFile.getc("metadata.author"),               author);
-        Plugin::drawRow(languageFile.getc("metadata.copyright"),            copyright);
+        Plugin::drawRow(languageFile.getc("metadata.author"),               information->author);
+        Plugin::drawRow(languageFile.getc("metadata.copyright"),            information->copyright);
 
         ImGui::TableNextColumn(); ImGui::Text("%s", languageFile.getc("metadata.sid_model"));
         ImGui::TableNextColumn();
@@ -310,8 +392,7 @@ void SidplayfpPlugin::drawMetadata(ECS::World* world, LanguageFile languageFile,
         Plugin::endTable();
     }
 
-    auto commentCount = musicInfo->numberOfCommentStrings();
-    if (commentCount > 0)
+    if (!information->comments.empty())
     {
         ImGui::Spacing();
         if (Plugin::beginTable(languageFile.getc("metadata.comments"), true, false))
@@ -319,9 +400,9 @@ void SidplayfpPlugin::drawMetadata(ECS::World* world, LanguageFile languageFile,
             auto& io = ImGui::GetIO();
             ImGui::PushFont(io.Fonts->Fonts[1]);
             ImGui::TableNextColumn();
-            for (unsigned int i=0; i<commentCount; ++i)
+            for (auto& comment : information->comments)
             {
-                ImGui::Text("%s\n", musicInfo->commentString(i));
+                ImGui::Text("%s\n", comment.c_str());
             }
             ImGui::PopFont();
             Plugin::endTable();
@@ -329,6 +410,27 @@ void SidplayfpPlugin::drawMetadata(ECS::World* world, LanguageFile languageFile,
     }
 }
 
+void SidplayfpPlugin::publishInformation()
+{
+    // selectSong() rewrite the tune info from the decode thread, the main thread only draw this copy
+    auto musicInfo = mTune->getInfo();
+    auto information = std::make_shared<Information>();
+    information->track = mCurrentTrack;
+    information->trackCount = mTrackCount;
+    information->title = musicInfo->infoString(0);
+    information->author = musicInfo->infoString(1);
+    information->copyright = musicInfo->infoString(2);
+    information->sidModel = musicInfo->sidModel(0);
+    information->clockSpeed = musicInfo->clockSpeed();
+    information->compatibility = musicInfo->compatibility();
+    for (unsigned int i=0; i<musicInfo->numberOfCommentStrings(); ++i)
+    {
+        information->comments.push_back(musicInfo->commentString(i));
+    }
+
+    std::atomic_store(&mInformation, std::shared_ptr<const Information>(information));
+}
+
 std::vector<uint8_t> SidplayfpPlugin::loadRom(const std::string path)
 {
     if (!std::filesystem::exists(path) || !std::filesystem::is_regular_file(path))
@@ -18,10 +18,12 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
 #include <sidplayfp/sidplayfp.h>
 #include <sidplayfp/sidbuilder.h>
 #include <sidplayfp/SidTune.h>
+#include <sidplayfp/SidTuneInfo.h>
 #include <ECS.h>
 
 #include "Plugin.h"
@@ -40,21 +42,38 @@ public:
     virtual std::string getVersion() override;
     virtual std::vector<std::string> getSupportedExtensions() override;
 
-    virtual void setup(Config config) override;
+    virtual void setup(Config config, int deviceSampleRate) override;
     virtual void cleanup() override;
-    virtual void open(const std::vector<uint8_t>& buffer) override;
+    virtual void open(const FileBuffer& buffer) override;
     virtual void close() override;
-    virtual bool decode(uint8_t* stream, size_t len) override;
+    virtual bool decode(float* stream, size_t& frames) override;
 
     virtual int getCurrentTrack();
     virtual int getTrackCount();
     virtual void setSubSong(int subsong);
+    virtual int getPosition();
+    virtual int getDuration();
+    virtual void seek(int milliseconds);
 
     virtual void drawSettings(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
     virtual void drawPlayerStats(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
     virtual void drawMetadata(ECS::World* world, LanguageFile languageFile, float deltaTime) override;
 
 private:
+    // What the player stats and metadata show, replaced as a whole by the thread that own the plugin
+    struct Information
+    {
+        int track;
+        int trackCount;
+        std::string title;
+        std::string author;
+        std::string copyright;
+        SidTuneInfo::model_t sidModel;
+        SidTuneInfo::clock_t clockSpeed;
+        SidTuneInfo::compatibility_t compatibility;
+        std::vector<std::string> comments;
+    };
+
     std::vector<uint8_t> mKernalRom;
     std::vector<uint8_t> mBasicRom;
     std::vector<uint8_t> mChargenRom;
@@ -64,8 +83,13 @@ private:
     SidTune* mTune;
     int mCurrentTrack;
     int mTrackCount;
+    // sidplayfp only count whole seconds
+    uint64_t mPlayedFrames;
+    std::shared_ptr<const Information> mInformation;
 
     SidplayfpPlugin(const SidplayfpPlugin& copy);
 
+    void publishInformation();
+
     static std::vector<uint8_t> loadRom(const std::string path);
 };
@@ -0,0 +1,332 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Decompressor.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <zlib.h>
+#include <lzma.h>
+#include <zstd.h>
+
+#define INPUT_CHUNK_SIZE 65536          // Compressed bytes given to the decoder at once, cancellation is checked in between
+#define DEFAULT_OUTPUT_SIZE 262144      // First output size when the wrapper does not tell it
+#define XZ_MEMORY_LIMIT 67108864        // Max memory used by the xz decoder itself
+#define MAX_HINT_RATIO 64               // Size hints bigger than this many times the input are not trusted
+
+
+Decompressor::Format Decompressor::detect(const uint8_t* data, size_t size)
+{
+    static const uint8_t gzipMagic[] = { 0x1f, 0x8b, 0x08 };
+    static const uint8_t xzMagic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+    static const uint8_t zstdMagic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+    if (size >= sizeof(gzipMagic) && memcmp(data, gzipMagic, sizeof(gzipMagic)) == 0)
+    {
+        return GZIP;
+    }
+    else if (size >= sizeof(xzMagic) && memcmp(data, xzMagic, sizeof(xzMagic)) == 0)
+    {
+        return XZ;
+    }
+    else if (size >= sizeof(zstdMagic) && memcmp(data, zstdMagic, sizeof(zstdMagic)) == 0)
+    {
+        return ZSTD;
+    }
+
+    return NONE;
+}
+
+size_t Decompressor::getSizeHint(Format format, const uint8_t* data, size_t size)
+{
+    switch (format)
+    {
+        case GZIP:
+            // Size modulo 2^32 of the last member, good enough as a hint
+            if (size >= 18)
+            {
+                auto* trailer = data + size - 4;
+                return trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((size_t) trailer[3] << 24);
+            }
+        break;
+
+        case XZ:
+        {
+            // The index at the end of the stream hold the size of every block
+            if (size < 2 * LZMA_STREAM_HEADER_SIZE)
+            {
+                break;
+            }
+
+            lzma_stream_flags footer;
+            if (lzma_stream_footer_decode(&footer, data + size - LZMA_STREAM_HEADER_SIZE) != LZMA_OK
+                || footer.backward_size > size - 2 * LZMA_STREAM_HEADER_SIZE)
+            {
+                break;
+            }
+
+            lzma_index* index = nullptr;
+            auto memoryLimit = (uint64_t) XZ_MEMORY_LIMIT;
+            auto position = (size_t) 0;
+            auto* indexData = data + size - LZMA_STREAM_HEADER_SIZE - footer.backward_size;
+            if (lzma_index_buffer_decode(&index, &memoryLimit, nullptr, indexData, &position, footer.backward_size) != LZMA_OK)
+            {
+                break;
+            }
+
+            auto uncompressedSize = lzma_index_uncompressed_size(index);
+            lzma_index_end(index, nullptr);
+            return uncompressedSize;
+        }
+
+        case ZSTD:
+        {
+            auto contentSize = ZSTD_getFrameContentSize(data, size);
+            if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN && contentSize != ZSTD_CONTENTSIZE_ERROR)
+            {
+                return contentSize;
+            }
+        }
+        break;
+
+        case NONE:
+        break;
+    }
+
+    return 0;
+}
+
+std::string Decompressor::getInnerName(const std::string& name)
+{
+    auto dot = name.rfind('.');
+    if (dot == std::string::npos || dot == 0)
+    {
+        return name;
+    }
+
+    auto extension = name.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == ".gz" || extension == ".xz" || extension == ".zst" || extension == ".zstd")
+    {
+        return name.substr(0, dot);
+    }
+
+    return name;
+}
+
+void Decompressor::decompress(Format format, const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize,
+    const std::atomic<bool>& canceled)
+{
+    // A wrong hint only cost a reallocation, a corrupted one must not allocate maxSize for nothing
+    auto sizeHint = std::min(getSizeHint(format, data, size), maxSize);
+    if (sizeHint / MAX_HINT_RATIO > size)
+    {
+        sizeHint = 0;
+    }
+
+    output.resize(sizeHint > 0 ? sizeHint : std::min((size_t) DEFAULT_OUTPUT_SIZE, maxSize));
+
+    switch (format)
+    {
+        case GZIP:
+            decompressGzip(data, size, output, maxSize, canceled);
+        break;
+        case XZ:
+            decompressXz(data, size, output, maxSize, canceled);
+        break;
+        case ZSTD:
+            decompressZstd(data, size, output, maxSize, canceled);
+        break;
+        case NONE:
+            output.resize(0);
+            output.append(data, size);
+        break;
+    }
+}
+
+size_t Decompressor::growOutput(FileBuffer& output, size_t used, size_t maxSize)
+{
+    if (used >= maxSize)
+    {
+        throw std::runtime_error("The decompressed file is too big");
+    }
+
+    output.resize(std::min(std::max(used * 2, (size_t) DEFAULT_OUTPUT_SIZE), maxSize));
+    return output.getSize();
+}
+
+void Decompressor::decompressGzip(const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize, const std::atomic<bool>& canceled)
+{
+    // 32 more window bits to read the gzip header
+    z_stream stream = {};
+    if (inflateInit2(&stream, MAX_WBITS + 32) != Z_OK)
+    {
+        throw std::runtime_error("Failed to initialize the decompressor");
+    }
+
+    auto used = (size_t) 0;
+    auto capacity = output.getSize();
+    auto consumed = (size_t) 0;
+    auto status = Z_OK;
+    while (status != Z_STREAM_END && !canceled)
+    {
+        if (stream.avail_in == 0 && consumed < size)
+        {
+            auto inputSize = std::min(size - consumed, (size_t) INPUT_CHUNK_SIZE);
+            stream.next_in = (Bytef*) data + consumed;
+            stream.avail_in = inputSize;
+            consumed += inputSize;
+        }
+
+        if (used == capacity)
+        {
+            try
+            {
+                capacity = growOutput(output, used, maxSize);
+            }
+            catch(...)
+            {
+                inflateEnd(&stream);
+                throw;
+            }
+        }
+
+        stream.next_out = output.getWritableData() + used;
+        stream.avail_out = std::min(capacity - used, (size_t) UINT32_MAX);
+        auto outputSize = stream.avail_out;
+        status = inflate(&stream, Z_NO_FLUSH);
+        used += outputSize - stream.avail_out;
+        if (status == Z_BUF_ERROR && stream.avail_in == 0 && consumed == size && used < capacity)
+        {
+            // Room left for the output and nothing more to give
+            inflateEnd(&stream);
+            throw std::runtime_error("The compressed file is truncated");
+        }
+        else if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+        {
+            inflateEnd(&stream);
+            throw std::runtime_error("The compressed file is corrupted");
+        }
+    }
+
+    inflateEnd(&stream);
+    output.resize(used);
+}
+
+void Decompressor::decompressXz(const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize, const std::atomic<bool>& canceled)
+{
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&stream, XZ_MEMORY_LIMIT, 0) != LZMA_OK)
+    {
+        throw std::runtime_error("Failed to initialize the decompressor");
+    }
+
+    auto used = (size_t) 0;
+    auto capacity = output.getSize();
+    auto consumed = (size_t) 0;
+    auto status = LZMA_OK;
+    while (status != LZMA_STREAM_END && !canceled)
+    {
+        if (stream.avail_in == 0 && consumed < size)
+        {
+            auto inputSize = std::min(size - consumed, (size_t) INPUT_CHUNK_SIZE);
+            stream.next_in = data + consumed;
+            stream.avail_in = inputSize;
+            consumed += inputSize;
+        }
+
+        if (used == capacity)
+        {
+            try
+            {
+                capacity = growOutput(output, used, maxSize);
+            }
+            catch(...)
+            {
+                lzma_end(&stream);
+                throw;
+            }
+        }
+
+        stream.next_out = output.getWritableData() + used;
+        stream.avail_out = capacity - used;
+        status = lzma_code(&stream, consumed == size ? LZMA_FINISH : LZMA_RUN);
+        used = capacity - stream.avail_out;
+        if (status != LZMA_OK && status != LZMA_STREAM_END)
+        {
+            lzma_end(&stream);
+            throw std::runtime_error(status == LZMA_MEMLIMIT_ERROR
+                ? "The compressed file need too much memory"
+                : "The compressed file is corrupted");
+        }
+    }
+
+    lzma_end(&stream);
+    output.resize(used);
+}
+
+void Decompressor::decompressZstd(const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize, const std::atomic<bool>& canceled)
+{
+    auto* stream = ZSTD_createDStream();
+    if (stream == nullptr)
+    {
+        throw std::runtime_error("Failed to initialize the decompressor");
+    }
+    ZSTD_initDStream(stream);
+
+    auto used = (size_t) 0;
+    auto capacity = output.getSize();
+    auto consumed = (size_t) 0;
+    auto remaining = (size_t) 1;
+    while (remaining != 0 && !canceled)
+    {
+        if (used == capacity)
+        {
+            try
+            {
+                capacity = growOutput(output, used, maxSize);
+            }
+            catch(...)
+            {
+                ZSTD_freeDStream(stream);
+                throw;
+            }
+        }
+        else if (consumed == size)
+        {
+            // Room left for the output and nothing more to give
+            ZSTD_freeDStream(stream);
+            throw std::runtime_error("The compressed file is truncated");
+        }
+
+        // Returns 0 once a frame is complete, anything else tells more data is expected
+        auto input = (ZSTD_inBuffer) { .src = data + consumed, .size = std::min(size - consumed, (size_t) INPUT_CHUNK_SIZE), .pos = 0 };
+        auto buffer = (ZSTD_outBuffer) { .dst = output.getWritableData(), .size = capacity, .pos = used };
+        remaining = ZSTD_decompressStream(stream, &buffer, &input);
+        if (ZSTD_isError(remaining))
+        {
+            ZSTD_freeDStream(stream);
+            throw std::runtime_error("The compressed file is corrupted");
+        }
+
+        consumed += input.pos;
+        used = buffer.pos;
+    }
+
+    ZSTD_freeDStream(stream);
+    output.resize(used);
+}
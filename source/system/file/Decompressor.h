@@ -0,0 +1,58 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "FileBuffer.h"
+
+
+/**
+ * Single file compression wrappers (gzip, xz and zstd), recognized by their magic bytes.
+ * The output is reserved from the size stored in the wrapper when there is one, then decoded in place.
+ */
+class Decompressor
+{
+public:
+    enum Format
+    {
+        NONE,
+        GZIP,
+        XZ,
+        ZSTD
+    };
+
+    static Format detect(const uint8_t* data, size_t size);
+    // Decompressed size told by the wrapper, 0 if unknown
+    static size_t getSizeHint(Format format, const uint8_t* data, size_t size);
+    // Drop the wrapper extension if any, "song.mod.gz" become "song.mod"
+    static std::string getInnerName(const std::string& name);
+    // Throw if the data is corrupted or would not fit in maxSize bytes, stop early if canceled
+    static void decompress(Format format, const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize,
+        const std::atomic<bool>& canceled);
+
+private:
+    Decompressor();
+
+    static void decompressGzip(const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize, const std::atomic<bool>& canceled);
+    static void decompressXz(const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize, const std::atomic<bool>& canceled);
+    static void decompressZstd(const uint8_t* data, size_t size, FileBuffer& output, size_t maxSize, const std::atomic<bool>& canceled);
+    static size_t growOutput(FileBuffer& output, size_t used, size_t maxSize);
+};
@@ -0,0 +1,134 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "DirectoryListing.h"
+
+#include <algorithm>
+
+
+DirectoryListing::DirectoryListing() :
+mNameOffsets({ 0 }),
+mKeyOffsets({ 0 })
+{
+}
+
+DirectoryListing::~DirectoryListing()
+{
+}
+
+void DirectoryListing::clear()
+{
+    mNames.clear();
+    mNameOffsets.assign(1, 0);
+    mKeys.clear();
+    mKeyOffsets.assign(1, 0);
+    mExtensionOffsets.clear();
+    mSizes.clear();
+    mFlags.clear();
+    mOrder.clear();
+}
+
+void DirectoryListing::reserve(size_t count, size_t nameBytes)
+{
+    mNames.reserve(nameBytes);
+    mNameOffsets.reserve(count + 1);
+    mKeys.reserve(nameBytes);
+    mKeyOffsets.reserve(count + 1);
+    mExtensionOffsets.reserve(count);
+    mSizes.reserve(count);
+    mFlags.reserve(count);
+    mOrder.reserve(count);
+}
+
+void DirectoryListing::add(const std::string& name, bool isFolder, uintmax_t size, bool isPlayable)
+{
+    mOrder.push_back(mFlags.size());
+    mFlags.push_back((isFolder ? FOLDER : 0) | (isPlayable ? PLAYABLE : 0) | (name == ".." ? PARENT : 0));
+    mSizes.push_back(size);
+
+    mNames.insert(mNames.end(), name.c_str(), name.c_str() + name.size() + 1);
+    mNameOffsets.push_back(mNames.size());
+
+    auto extensionOffset = DirectorySort::makeKey(name, mKeys);
+    mExtensionOffsets.push_back((uint16_t) std::min(extensionOffset, (size_t) UINT16_MAX));
+    mKeyOffsets.push_back(mKeys.size());
+}
+
+void DirectoryListing::append(const DirectoryListing& listing, DirectorySort::Order order)
+{
+    auto indexBase = (uint32_t) mFlags.size();
+    auto nameBase = (uint32_t) mNames.size();
+    auto keyBase = (uint32_t) mKeys.size();
+    auto middle = mOrder.size();
+
+    mNames.insert(mNames.end(), listing.mNames.begin(), listing.mNames.end());
+    mKeys.insert(mKeys.end(), listing.mKeys.begin(), listing.mKeys.end());
+    for (size_t i=1; i<listing.mNameOffsets.size(); ++i)
+    {
+        mNameOffsets.push_back(nameBase + listing.mNameOffsets[i]);
+        mKeyOffsets.push_back(keyBase + listing.mKeyOffsets[i]);
+    }
+
+    mExtensionOffsets.insert(mExtensionOffsets.end(), listing.mExtensionOffsets.begin(), listing.mExtensionOffsets.end());
+    mSizes.insert(mSizes.end(), listing.mSizes.begin(), listing.mSizes.end());
+    mFlags.insert(mFlags.end(), listing.mFlags.begin(), listing.mFlags.end());
+    for (auto index : listing.mOrder)
+    {
+        mOrder.push_back(indexBase + index);
+    }
+
+    if (order != DirectorySort::NAME)
+    {
+        DirectorySort::sort(*this, mOrder.data() + middle, mOrder.data() + mOrder.size(), order);
+    }
+
+    DirectorySort::merge(*this, mOrder.data(), mOrder.data() + middle, mOrder.data() + mOrder.size(), order);
+}
+
+void DirectoryListing::sort(DirectorySort::Order order)
+{
+    DirectorySort::sort(*this, mOrder.data(), mOrder.data() + mOrder.size(), order);
+}
+
+size_t DirectoryListing::getCount() const
+{
+    return mOrder.size();
+}
+
+const char* DirectoryListing::getName(size_t row) const
+{
+    return &mNames[mNameOffsets[mOrder[row]]];
+}
+
+uintmax_t DirectoryListing::getSize(size_t row) const
+{
+    return mSizes[mOrder[row]];
+}
+
+bool DirectoryListing::isFolder(size_t row) const
+{
+    return mFlags[mOrder[row]] & FOLDER;
+}
+
+bool DirectoryListing::isPlayable(size_t row) const
+{
+    return mFlags[mOrder[row]] & PLAYABLE;
+}
+
+bool DirectoryListing::isParent(size_t row) const
+{
+    return mFlags[mOrder[row]] & PARENT;
+}
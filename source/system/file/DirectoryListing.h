@@ -0,0 +1,74 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include "DirectorySort.h"
+
+
+/**
+ * Entries of a directory stored column by column: names and collation keys packed in two arenas,
+ * sizes and flags in their own arrays, and the sorted order as indexes into them.
+ * Built by the FileSystem worker then handed over to the UI as it is, rows are read in sorted order.
+ */
+class DirectoryListing
+{
+public:
+    DirectoryListing();
+    virtual ~DirectoryListing();
+
+    void clear();
+    void reserve(size_t count, size_t nameBytes);
+    // Entries are added at the end of the sorted order, call sort() once done
+    void add(const std::string& name, bool isFolder, uintmax_t size, bool isPlayable);
+    // Add every entry of listing, sorted by name, and merge them with the current ones sorted by order
+    void append(const DirectoryListing& listing, DirectorySort::Order order);
+    void sort(DirectorySort::Order order);
+
+    size_t getCount() const;
+    const char* getName(size_t row) const;
+    uintmax_t getSize(size_t row) const;
+    bool isFolder(size_t row) const;
+    bool isPlayable(size_t row) const;
+    bool isParent(size_t row) const;
+
+private:
+    friend class DirectorySort;
+
+    enum Flag
+    {
+        FOLDER = 1 << 0,
+        PLAYABLE = 1 << 1,
+        PARENT = 1 << 2
+    };
+
+    // Names are null terminated, offsets have one more element marking the end of the last entry
+    std::vector<char> mNames;
+    std::vector<uint32_t> mNameOffsets;
+    std::vector<char> mKeys;
+    std::vector<uint32_t> mKeyOffsets;
+    std::vector<uint16_t> mExtensionOffsets;
+    std::vector<uint64_t> mSizes;
+    std::vector<uint8_t> mFlags;
+    std::vector<uint32_t> mOrder;
+
+    DirectoryListing(const DirectoryListing& copy);
+};
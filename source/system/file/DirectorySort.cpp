@@ -0,0 +1,181 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "DirectorySort.h"
+
+#include <algorithm>
+#include <string_view>
+#include <SDL2/SDL.h>
+
+#include "DirectoryListing.h"
+
+#define PARALLEL_SORT_MIN_ITEMS 16384   // Smaller listings are sorted on the calling thread
+#define PARALLEL_SORT_MAX_THREADS 8     // Max number of threads sorting a listing
+
+
+size_t DirectorySort::makeKey(const std::string& name, std::vector<char>& keys)
+{
+    auto keyStart = keys.size();
+    auto extensionOffset = (size_t) 0;
+
+    for (size_t i=0; i<name.size();)
+    {
+        auto c = (unsigned char) name[i];
+        if (c >= '0' && c <= '9')
+        {
+            // Leading zeros do not count, the length byte make shorter numbers come first
+            auto start = i;
+            while (i < name.size() && name[i] >= '0' && name[i] <= '9')
+            {
+                ++i;
+            }
+
+            auto firstDigit = start;
+            while (firstDigit < i - 1 && name[firstDigit] == '0')
+            {
+                ++firstDigit;
+            }
+
+            keys.push_back('0');
+            keys.push_back((char) std::min(i - firstDigit, (size_t) 255));
+            keys.insert(keys.end(), name.begin() + firstDigit, name.begin() + i);
+            continue;
+        }
+
+        if (c == '.')
+        {
+            extensionOffset = keys.size() - keyStart + 1;
+        }
+
+        keys.push_back((c >= 'A' && c <= 'Z') ? (char) (c - 'A' + 'a') : (char) c);
+        ++i;
+    }
+
+    return extensionOffset == 0 ? keys.size() - keyStart : extensionOffset;
+}
+
+bool DirectorySort::compare(const DirectoryListing& listing, uint32_t a, uint32_t b, Order order)
+{
+    auto aFlags = listing.mFlags[a];
+    auto bFlags = listing.mFlags[b];
+    if ((aFlags & DirectoryListing::PARENT) != (bFlags & DirectoryListing::PARENT))
+    {
+        return aFlags & DirectoryListing::PARENT;
+    }
+
+    if ((aFlags & DirectoryListing::FOLDER) != (bFlags & DirectoryListing::FOLDER))
+    {
+        return aFlags & DirectoryListing::FOLDER;
+    }
+
+    auto& keys = listing.mKeys;
+    auto aKey = std::string_view(keys.data() + listing.mKeyOffsets[a], listing.mKeyOffsets[a + 1] - listing.mKeyOffsets[a]);
+    auto bKey = std::string_view(keys.data() + listing.mKeyOffsets[b], listing.mKeyOffsets[b + 1] - listing.mKeyOffsets[b]);
+    if (!(aFlags & DirectoryListing::FOLDER))
+    {
+        switch (order)
+        {
+            case SIZE:
+                if (listing.mSizes[a] != listing.mSizes[b])
+                {
+                    return listing.mSizes[a] < listing.mSizes[b];
+                }
+            break;
+
+            case EXTENSION:
+            {
+                auto result = aKey.substr(listing.mExtensionOffsets[a]).compare(bKey.substr(listing.mExtensionOffsets[b]));
+                if (result != 0)
+                {
+                    return result < 0;
+                }
+            }
+            break;
+
+            default:
+            break;
+        }
+    }
+
+    return aKey < bKey;
+}
+
+void DirectorySort::sort(const DirectoryListing& listing, uint32_t* begin, uint32_t* end, Order order)
+{
+    auto comparator = [&listing, order](uint32_t a, uint32_t b) { return compare(listing, a, b, order); };
+    auto count = (size_t) (end - begin);
+    auto threadCount = std::clamp(SDL_GetCPUCount(), 1, PARALLEL_SORT_MAX_THREADS);
+    if (count < PARALLEL_SORT_MIN_ITEMS || threadCount == 1)
+    {
+        std::sort(begin, end, comparator);
+        return;
+    }
+
+    // Sort one slice per core, the calling thread take the last one
+    auto bounds = std::vector<uint32_t*>();
+    for (auto i=0; i<=threadCount; ++i)
+    {
+        bounds.push_back(begin + count * i / threadCount);
+    }
+
+    auto tasks = std::vector<SortTask>(threadCount);
+    auto threads = std::vector<SDL_Thread*>(threadCount, nullptr);
+    for (auto i=0; i<threadCount; ++i)
+    {
+        tasks[i] = { .listing = &listing, .begin = bounds[i], .end = bounds[i + 1], .order = order };
+        if (i < threadCount - 1)
+        {
+            threads[i] = SDL_CreateThread(sortThreadFunc, "OSPSORT", &tasks[i]);
+        }
+
+        if (threads[i] == nullptr)
+        {
+            sortThreadFunc(&tasks[i]);
+        }
+    }
+
+    for (auto* thread : threads)
+    {
+        if (thread != nullptr)
+        {
+            SDL_WaitThread(thread, nullptr);
+        }
+    }
+
+    // Merge neighbour slices until only one is left
+    for (auto width=1; width<threadCount; width*=2)
+    {
+        for (auto i=0; i+width<threadCount; i+=width*2)
+        {
+            auto last = std::min(i + width * 2, threadCount);
+            std::inplace_merge(bounds[i], bounds[i + width], bounds[last], comparator);
+        }
+    }
+}
+
+void DirectorySort::merge(const DirectoryListing& listing, uint32_t* begin, uint32_t* middle, uint32_t* end, Order order)
+{
+    std::inplace_merge(begin, middle, end, [&listing, order](uint32_t a, uint32_t b) { return compare(listing, a, b, order); });
+}
+
+int DirectorySort::sortThreadFunc(void* task)
+{
+    auto* sortTask = (SortTask*) task;
+    auto* listing = sortTask->listing;
+    auto order = sortTask->order;
+    std::sort(sortTask->begin, sortTask->end, [listing, order](uint32_t a, uint32_t b) { return compare(*listing, a, b, order); });
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+class DirectoryListing;
+
+
+/**
+ * Sort directory listings. Each entry get a collation key once when it is listed: the name case folded, with every run
+ * of digits prefixed by its length so numbers compare by value ("track2" < "track10"). Comparing two entries is then a
+ * plain byte comparison, whatever the order. ".." always come first then folders, sorted by name in every order.
+ */
+class DirectorySort
+{
+public:
+    enum Order
+    {
+        NAME,
+        SIZE,
+        EXTENSION,
+        ORDER_COUNT
+    };
+
+    // Append the key of name, return where its extension start in the key
+    static size_t makeKey(const std::string& name, std::vector<char>& keys);
+    static bool compare(const DirectoryListing& listing, uint32_t a, uint32_t b, Order order);
+    // Sort indexes of listing entries, big ranges are split and sorted on every core then merged
+    static void sort(const DirectoryListing& listing, uint32_t* begin, uint32_t* end, Order order);
+    // Merge two sorted ranges, [begin, middle) and [middle, end)
+    static void merge(const DirectoryListing& listing, uint32_t* begin, uint32_t* middle, uint32_t* end, Order order);
+
+private:
+    struct SortTask
+    {
+        const DirectoryListing* listing;
+        uint32_t* begin;
+        uint32_t* end;
+        Order order;
+    };
+
+    static int sortThreadFunc(void* task);
+};
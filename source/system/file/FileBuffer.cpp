@@ -0,0 +1,84 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FileBuffer.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+
+FileBuffer::FileBuffer() :
+mHash(0)
+{
+}
+
+FileBuffer::~FileBuffer()
+{
+}
+
+MappedFile& FileBuffer::getMappedFile()
+{
+    return mMappedFile;
+}
+
+void FileBuffer::reserve(size_t size)
+{
+    mData.reserve(size);
+}
+
+void FileBuffer::append(const uint8_t* data, size_t size)
+{
+    mData.insert(mData.end(), data, data + size);
+}
+
+void FileBuffer::resize(size_t size)
+{
+    mData.resize(size);
+}
+
+uint8_t* FileBuffer::getWritableData()
+{
+    return mData.data();
+}
+
+void FileBuffer::updateHash()
+{
+    auto* data = getData();
+    auto size = getSize();
+    auto hash = (uint64_t) FNV_OFFSET_BASIS;
+    for (size_t i=0; i<size; ++i)
+    {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+
+    mHash = hash;
+}
+
+const uint8_t* FileBuffer::getData() const
+{
+    return mMappedFile.getData() != nullptr ? mMappedFile.getData() : mData.data();
+}
+
+size_t FileBuffer::getSize() const
+{
+    return mMappedFile.getData() != nullptr ? mMappedFile.getSize() : mData.size();
+}
+
+uint64_t FileBuffer::getHash() const
+{
+    return mHash;
+}
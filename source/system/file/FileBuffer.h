@@ -0,0 +1,58 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "MappedFile.h"
+
+
+/**
+ * Content of a loaded file, either mapped in memory or read in a vector.
+ * Filled once by the FileSystem then shared as a std::shared_ptr<const FileBuffer> through the events,
+ * so the bytes are never copied on the way to the plugins. It is freed when the last event or cache entry holding it is gone.
+ */
+class FileBuffer
+{
+public:
+    FileBuffer();
+    virtual ~FileBuffer();
+
+    // Loader side, before the buffer is shared
+    MappedFile& getMappedFile();
+    void reserve(size_t size);
+    void append(const uint8_t* data, size_t size);
+    // Direct access for the decoders writing in place, resize keep what was written
+    void resize(size_t size);
+    uint8_t* getWritableData();
+    // FNV-1a of the content, done by the loader once the buffer is filled since it read the whole file
+    void updateHash();
+
+    const uint8_t* getData() const;
+    size_t getSize() const;
+    // Identify the content whatever the path it was loaded from
+    uint64_t getHash() const;
+
+private:
+    MappedFile mMappedFile;
+    std::vector<uint8_t> mData;
+    uint64_t mHash;
+
+    FileBuffer(const FileBuffer& copy);
+};
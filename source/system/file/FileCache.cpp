@@ -0,0 +1,132 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FileCache.h"
+
+#include <algorithm>
+
+
+FileCache::FileCache() :
+mMutex(SDL_CreateMutex()),
+mMaxBytes(0),
+mMemoryUsage(0),
+mHitCount(0),
+mMissCount(0)
+{
+}
+
+FileCache::~FileCache()
+{
+    SDL_DestroyMutex(mMutex);
+}
+
+void FileCache::setup(size_t maxBytes)
+{
+    SDL_LockMutex(mMutex);
+    mEntries.clear();
+    mMaxBytes = maxBytes;
+    mMemoryUsage = 0;
+    mHitCount = 0;
+    mMissCount = 0;
+    SDL_UnlockMutex(mMutex);
+}
+
+void FileCache::clear()
+{
+    SDL_LockMutex(mMutex);
+    mEntries.clear();
+    mMemoryUsage = 0;
+    SDL_UnlockMutex(mMutex);
+}
+
+bool FileCache::isEnabled() const
+{
+    return mMaxBytes > 0;
+}
+
+bool FileCache::contains(const std::string& path)
+{
+    SDL_LockMutex(mMutex);
+    auto isFound = find(path) != mEntries.end();
+    SDL_UnlockMutex(mMutex);
+
+    return isFound;
+}
+
+std::shared_ptr<const FileBuffer> FileCache::lookup(const std::string& path)
+{
+    SDL_LockMutex(mMutex);
+    auto buffer = std::shared_ptr<const FileBuffer>();
+    auto entry = find(path);
+    if (entry != mEntries.end())
+    {
+        mEntries.splice(mEntries.begin(), mEntries, entry);
+        buffer = entry->buffer;
+        ++mHitCount;
+    }
+    else
+    {
+        ++mMissCount;
+    }
+    SDL_UnlockMutex(mMutex);
+
+    return buffer;
+}
+
+void FileCache::insert(const std::string& path, std::shared_ptr<const FileBuffer> buffer)
+{
+    if (buffer->getSize() > mMaxBytes)
+    {
+        return;
+    }
+
+    SDL_LockMutex(mMutex);
+    auto entry = find(path);
+    if (entry != mEntries.end())
+    {
+        mMemoryUsage -= entry->buffer->getSize();
+        mEntries.erase(entry);
+    }
+
+    mEntries.push_front({ .path = path, .buffer = buffer });
+    mMemoryUsage += buffer->getSize();
+    while (mMemoryUsage > mMaxBytes)
+    {
+        mMemoryUsage -= mEntries.back().buffer->getSize();
+        mEntries.pop_back();
+    }
+    SDL_UnlockMutex(mMutex);
+}
+
+uint64_t FileCache::getHitCount() const
+{
+    return mHitCount;
+}
+
+uint64_t FileCache::getMissCount() const
+{
+    return mMissCount;
+}
+
+size_t FileCache::getMemoryUsage() const
+{
+    return mMemoryUsage;
+}
+
+std::list<FileCache::Entry>::iterator FileCache::find(const std::string& path)
+{
+    return std::find_if(mEntries.begin(), mEntries.end(), [&path](const Entry& entry) { return entry.path == path; });
+}
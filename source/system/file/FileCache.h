@@ -0,0 +1,74 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+#include <SDL2/SDL.h>
+
+#include "FileBuffer.h"
+
+
+/**
+ * Files kept in memory by path, mostly the next playlist items read ahead of time by the FileSystem.
+ * The least recently used entries are dropped to stay under the size limit, a mapped file counts for its size too.
+ * Thread safe, the workers fill it while the main thread serve files from it.
+ */
+class FileCache
+{
+public:
+    FileCache();
+    virtual ~FileCache();
+
+    // Drop everything and set the size limit, 0 disable the cache
+    void setup(size_t maxBytes);
+    void clear();
+    bool isEnabled() const;
+
+    bool contains(const std::string& path);
+    // Return nullptr if the file is not cached, count it as a hit or a miss
+    std::shared_ptr<const FileBuffer> lookup(const std::string& path);
+    // A file bigger than the whole cache is not kept
+    void insert(const std::string& path, std::shared_ptr<const FileBuffer> buffer);
+
+    uint64_t getHitCount() const;
+    uint64_t getMissCount() const;
+    size_t getMemoryUsage() const;
+
+private:
+    struct Entry
+    {
+        std::string path;
+        std::shared_ptr<const FileBuffer> buffer;
+    };
+
+    SDL_mutex* mMutex;
+    // Most recently used first
+    std::list<Entry> mEntries;
+    size_t mMaxBytes;
+    size_t mMemoryUsage;
+    uint64_t mHitCount;
+    uint64_t mMissCount;
+
+    FileCache(const FileCache& copy);
+
+    std::list<Entry>::iterator find(const std::string& path);
+};
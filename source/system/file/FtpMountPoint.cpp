@@ -0,0 +1,541 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "FtpMountPoint.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <stdexcept>
+#include <algorithm>
+#include <fmt/format.h>
+
+#include "../../config.h"
+
+#define SOCKET_TIMEOUT_SECONDS 15       // Time without answer before a connection is considered lost
+#define MAX_IDLE_CONNECTIONS 3          // Logged in connections kept for later, one per worker is enough
+#define LISTING_CACHE_SECONDS 600       // Time a listing is served from the cache before the server is asked again
+#define LISTING_CACHE_SIZE 256          // Listings kept in the cache, the oldest is dropped
+#define LISTING_CHUNK_SIZE 16384        // Size of the read buffer for listings
+
+
+FtpMountPoint::FtpMountPoint(std::string name, std::string scheme, std::string host, uint16_t port, std::string root,
+    std::string user, std::string password) :
+MountPoint(name, scheme),
+mHost(host),
+mPort(port),
+mRoot(root),
+mUser(user),
+mPassword(password),
+mMutex(SDL_CreateMutex())
+{
+}
+
+FtpMountPoint::~FtpMountPoint()
+{
+    SDL_DestroyMutex(mMutex);
+}
+
+void FtpMountPoint::setup()
+{
+    // Nothing is connected before the first use, the network may not even be there
+}
+
+void FtpMountPoint::cleanup()
+{
+    SDL_LockMutex(mMutex);
+    for (auto& connection : mIdleConnections)
+    {
+        try
+        {
+            connection->control.send("QUIT\r\n");
+        }
+        catch(...)
+        {
+            // Closed anyway
+        }
+    }
+
+    mIdleConnections.clear();
+    mListings.clear();
+    SDL_UnlockMutex(mMutex);
+}
+
+void FtpMountPoint::navigate(std::filesystem::path path, ItemListener itemListener)
+{
+    auto remotePath = getRemotePath(path);
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Going back to a directory seen recently does not ask the server
+    SDL_LockMutex(mMutex);
+    auto cached = mListings.find(remotePath);
+    if (cached != mListings.end() && startTime - cached->second.time < std::chrono::seconds(LISTING_CACHE_SECONDS))
+    {
+        auto entries = cached->second.entries;
+        SDL_UnlockMutex(mMutex);
+
+        TRACE("Listing of {:s} served from the cache, {:d} entries.", remotePath, entries.size());
+        for (auto& entry : entries)
+        {
+            if (!itemListener(entry.name, entry.isFolder, entry.size))
+            {
+                return; // Listener tell us to stop
+            }
+        }
+        return;
+    }
+    SDL_UnlockMutex(mMutex);
+
+    auto connection = std::unique_ptr<Connection>();
+    auto data = Socket();
+    auto message = std::string();
+    if (!openTransfer(connection, true, remotePath, data, message))
+    {
+        TRACE("{:s}", message);
+        releaseConnection(std::move(connection));
+        throw std::runtime_error("Failed to open the requested directory");
+    }
+
+    // Entries are given as soon as their line is complete
+    auto firstByteTime = std::chrono::steady_clock::time_point();
+    auto isMlsd = connection->hasMlsd;
+    auto isComplete = true;
+    auto entries = std::vector<Entry>();
+    auto pending = std::string();
+    auto readBuffer = std::vector<char>(LISTING_CHUNK_SIZE);
+    while (isComplete)
+    {
+        auto readCount = data.receive((uint8_t*) readBuffer.data(), readBuffer.size());
+        if (firstByteTime == std::chrono::steady_clock::time_point())
+        {
+            // The 150 reply only tell the server accepted, the listing may still take a while to come
+            firstByteTime = std::chrono::steady_clock::now();
+        }
+
+        if (readCount == 0)
+        {
+            break;
+        }
+
+        pending.append(readBuffer.data(), readCount);
+        auto lineStart = (size_t) 0;
+        auto lineEnd = pending.find('\n');
+        while (lineEnd != std::string::npos)
+        {
+            auto line = pending.substr(lineStart, lineEnd - lineStart);
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+
+            auto entry = Entry();
+            if (parseListLine(line, isMlsd, entry))
+            {
+                entries.push_back(entry);
+                if (!itemListener(entry.name, entry.isFolder, entry.size))
+                {
+                    isComplete = false; // Listener tell us to stop
+                    break;
+                }
+            }
+
+            lineStart = lineEnd + 1;
+            lineEnd = pending.find('\n', lineStart);
+        }
+        pending.erase(0, lineStart);
+    }
+
+    closeTransfer(std::move(connection), data, isComplete);
+    if (!isComplete)
+    {
+        return;
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    recordTransferTime(firstByteTime - startTime, endTime - startTime);
+    TRACE("Listed {:s}: {:d} entries in {:.1f} ms, first byte after {:.1f} ms.", remotePath, entries.size(),
+        std::chrono::duration<double, std::milli>(endTime - startTime).count(),
+        std::chrono::duration<double, std::milli>(firstByteTime - startTime).count());
+
+    SDL_LockMutex(mMutex);
+    if (mListings.size() >= LISTING_CACHE_SIZE && mListings.find(remotePath) == mListings.end())
+    {
+        auto oldest = std::min_element(mListings.begin(), mListings.end(),
+            [](const auto& a, const auto& b) { return a.second.time < b.second.time; });
+        mListings.erase(oldest);
+    }
+
+    mListings[remotePath] = (Listing) {
+        .entries = std::move(entries),
+        .time = endTime
+    };
+    SDL_UnlockMutex(mMutex);
+}
+
+void FtpMountPoint::getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener)
+{
+    auto remotePath = getRemotePath(path);
+    auto startTime = std::chrono::steady_clock::now();
+
+    auto connection = std::unique_ptr<Connection>();
+    auto data = Socket();
+    auto message = std::string();
+    if (!openTransfer(connection, false, remotePath, data, message))
+    {
+        TRACE("{:s}", message);
+        releaseConnection(std::move(connection));
+        throw std::runtime_error("Failed to open the requested file");
+    }
+
+    // Chunks are filled entirely like the ones read from the other mount points
+    auto firstByteTime = std::chrono::steady_clock::time_point();
+    auto isComplete = true;
+    auto isEnd = false;
+    auto totalCount = (size_t) 0;
+    auto readBuffer = std::vector<uint8_t>();
+    while (!isEnd)
+    {
+        readBuffer.resize(chunkBufferSize);
+        auto readCount = (size_t) 0;
+        while (readCount < chunkBufferSize)
+        {
+            auto count = data.receive(readBuffer.data() + readCount, chunkBufferSize - readCount);
+            if (firstByteTime == std::chrono::steady_clock::time_point())
+            {
+                firstByteTime = std::chrono::steady_clock::now();
+            }
+
+            if (count == 0)
+            {
+                isEnd = true;
+                break;
+            }
+
+            readCount += count;
+        }
+
+        if (readCount == 0)
+        {
+            break;
+        }
+
+        readBuffer.resize(readCount);
+        totalCount += readCount;
+        if (!fileListener(readBuffer))
+        {
+            isComplete = false; // Listener tells us to stop
+            break;
+        }
+    }
+
+    closeTransfer(std::move(connection), data, isComplete);
+
+    auto endTime = std::chrono::steady_clock::now();
+    if (isComplete)
+    {
+        recordTransferTime(firstByteTime - startTime, endTime - startTime);
+    }
+
+    TRACE("Transfer of {:s} {:s}: {:d} KB in {:.1f} ms, first byte after {:.1f} ms.", remotePath,
+        isComplete ? "done" : "stopped", totalCount / 1024,
+        std::chrono::duration<double, std::milli>(endTime - startTime).count(),
+        std::chrono::duration<double, std::milli>(firstByteTime - startTime).count());
+}
+
+std::unique_ptr<FtpMountPoint::Connection> FtpMountPoint::acquireConnection()
+{
+    SDL_LockMutex(mMutex);
+    if (!mIdleConnections.empty())
+    {
+        auto connection = std::move(mIdleConnections.back());
+        mIdleConnections.pop_back();
+        SDL_UnlockMutex(mMutex);
+        return connection;
+    }
+    SDL_UnlockMutex(mMutex);
+
+    return connect();
+}
+
+void FtpMountPoint::releaseConnection(std::unique_ptr<Connection> connection)
+{
+    connection->isReused = true;
+
+    SDL_LockMutex(mMutex);
+    if (mIdleConnections.size() < MAX_IDLE_CONNECTIONS)
+    {
+        mIdleConnections.push_back(std::move(connection));
+    }
+    SDL_UnlockMutex(mMutex);
+}
+
+std::unique_ptr<FtpMountPoint::Connection> FtpMountPoint::connect()
+{
+    auto startTime = std::chrono::steady_clock::now();
+    auto connection = std::make_unique<Connection>();
+    connection->isReused = false;
+    connection->hasMlsd = false;
+
+    auto& control = connection->control;
+    auto message = std::string();
+    control.connect(mHost, mPort, SOCKET_TIMEOUT_SECONDS);
+    if (readReply(control, message) != 220)
+    {
+        throw std::runtime_error(fmt::format("The FTP server refused the connection: {:s}", message));
+    }
+
+    auto code = sendCommand(control, "USER " + mUser, message);
+    if (code == 331)
+    {
+        code = sendCommand(control, "PASS " + mPassword, message);
+    }
+
+    if (code != 230)
+    {
+        throw std::runtime_error(fmt::format("Failed to log in the FTP server: {:s}", message));
+    }
+
+    // Neither reply is needed to send the other command
+    control.send("TYPE I\r\nFEAT\r\n");
+    if (readReply(control, message) != 200)
+    {
+        throw std::runtime_error(fmt::format("The FTP server refused binary transfers: {:s}", message));
+    }
+
+    // MLSD come with MLST, its listing is not left to the server's taste
+    auto featureCode = readReply(control, message);
+    std::transform(message.begin(), message.end(), message.begin(), ::toupper);
+    connection->hasMlsd = featureCode == 211 && message.find("\n MLST") != std::string::npos;
+
+    auto connectTime = std::chrono::steady_clock::now() - startTime;
+    recordConnectTime(connectTime);
+    TRACE("Connected to {:s}:{:d} in {:.1f} ms, {:s} listings.", mHost, mPort,
+        std::chrono::duration<double, std::milli>(connectTime).count(),
+        connection->hasMlsd ? "MLSD" : "LIST");
+    return connection;
+}
+
+int FtpMountPoint::readReply(Socket& socket, std::string& message)
+{
+    auto line = socket.receiveLine();
+    if (line.size() < 3 || !isdigit(line[0]) || !isdigit(line[1]) || !isdigit(line[2]))
+    {
+        throw std::runtime_error("Unexpected reply from the FTP server");
+    }
+
+    // Multiline replies end with the same code followed by a space
+    message = line;
+    if (line.size() > 3 && line[3] == '-')
+    {
+        auto lastLineStart = line.substr(0, 3) + " ";
+        do
+        {
+            line = socket.receiveLine();
+            message += "\n" + line;
+        }
+        while (line.compare(0, lastLineStart.size(), lastLineStart) != 0);
+    }
+
+    return atoi(line.substr(0, 3).c_str());
+}
+
+int FtpMountPoint::sendCommand(Socket& socket, const std::string& command, std::string& message)
+{
+    socket.send(command + "\r\n");
+    return readReply(socket, message);
+}
+
+bool FtpMountPoint::openTransfer(std::unique_ptr<Connection>& connection, bool isListing, const std::string& remotePath,
+    Socket& data, std::string& message)
+{
+    connection = acquireConnection();
+    try
+    {
+        return requestTransfer(*connection, isListing, remotePath, data, message);
+    }
+    catch(const std::exception& e)
+    {
+        // The server may have closed a connection left idle for too long, a new one get a second chance
+        if (!connection->isReused)
+        {
+            throw;
+        }
+
+        TRACE("Reused connection lost ({:s}), connecting again.", e.what());
+        data.close();
+        connection = connect();
+        return requestTransfer(*connection, isListing, remotePath, data, message);
+    }
+}
+
+bool FtpMountPoint::requestTransfer(Connection& connection, bool isListing, const std::string& remotePath, Socket& data,
+    std::string& message)
+{
+    // The command is sent with PASV, the server hold it until the data connection is made
+    auto command = isListing ? (connection.hasMlsd ? "MLSD " : "LIST ") : "RETR ";
+    connection.control.send(fmt::format("PASV\r\n{:s}{:s}\r\n", command, remotePath));
+    if (readReply(connection.control, message) != 227)
+    {
+        // Read what the server said about the command too
+        auto passiveMessage = message;
+        readReply(connection.control, message);
+        message = passiveMessage;
+        return false;
+    }
+
+    // Only the port is used, the address given can be a private one of a server behind NAT
+    unsigned int address[4], port[2];
+    auto numbers = message.find_first_of("0123456789", 4);
+    if (numbers == std::string::npos
+        || sscanf(message.c_str() + numbers, "%u,%u,%u,%u,%u,%u", &address[0], &address[1], &address[2], &address[3],
+            &port[0], &port[1]) != 6)
+    {
+        throw std::runtime_error("Unexpected passive mode reply from the FTP server");
+    }
+
+    data.connect(connection.control.getPeerAddress(), (uint16_t) ((port[0] << 8) | port[1]), SOCKET_TIMEOUT_SECONDS);
+    auto code = readReply(connection.control, message);
+    if (code != 125 && code != 150)
+    {
+        data.close();
+        return false;
+    }
+
+    return true;
+}
+
+void FtpMountPoint::closeTransfer(std::unique_ptr<Connection> connection, Socket& data, bool isComplete)
+{
+    // A transfer stopped early is answered 426, or 226 if the server already sent everything
+    data.close();
+
+    auto message = std::string();
+    auto code = readReply(connection->control, message);
+    releaseConnection(std::move(connection));
+
+    if (isComplete && code / 100 != 2)
+    {
+        throw std::runtime_error(fmt::format("FTP transfer failed: {:s}", message));
+    }
+}
+
+std::string FtpMountPoint::getRemotePath(const std::filesystem::path& path)
+{
+    auto remotePath = std::filesystem::path(mRoot);
+    auto relativePath = path.lexically_relative(getScheme());
+    if (!relativePath.empty() && relativePath != ".")
+    {
+        remotePath /= relativePath;
+    }
+
+    // Anything after a line break would be taken as another command
+    auto result = remotePath.generic_string();
+    if (result.find_first_of("\r\n") != std::string::npos)
+    {
+        throw std::runtime_error("Invalid path");
+    }
+
+    return result;
+}
+
+bool FtpMountPoint::parseListLine(const std::string& line, bool isMlsd, Entry& entry)
+{
+    if (isMlsd)
+    {
+        // "type=file;size=1234;modify=20200101000000; name", facts are in any order and case
+        auto space = line.find(' ');
+        if (space == std::string::npos)
+        {
+            return false;
+        }
+
+        auto facts = line.substr(0, space);
+        std::transform(facts.begin(), facts.end(), facts.begin(), ::tolower);
+        entry.name = line.substr(space + 1);
+        entry.isFolder = false;
+        entry.size = 0;
+
+        auto type = std::string();
+        auto factStart = (size_t) 0;
+        while (factStart < facts.size())
+        {
+            auto factEnd = facts.find(';', factStart);
+            if (factEnd == std::string::npos)
+            {
+                factEnd = facts.size();
+            }
+
+            auto fact = facts.substr(factStart, factEnd - factStart);
+            if (fact.compare(0, 5, "type=") == 0)
+            {
+                type = fact.substr(5);
+            }
+            else if (fact.compare(0, 5, "size=") == 0)
+            {
+                entry.size = strtoull(fact.c_str() + 5, nullptr, 10);
+            }
+
+            factStart = factEnd + 1;
+        }
+
+        // cdir, pdir and links of unknown type are left out
+        if (type != "file" && type != "dir")
+        {
+            return false;
+        }
+
+        entry.isFolder = type == "dir";
+    }
+    else
+    {
+        // "drwxr-xr-x 2 owner group 4096 Jan 01 2020 name", links are left out as their type is unknown
+        if (line.empty() || (line[0] != 'd' && line[0] != '-'))
+        {
+            return false;
+        }
+
+        auto position = (size_t) 0;
+        for (auto field=0; field<8; ++field)
+        {
+            position = line.find(' ', position);
+            if (position == std::string::npos)
+            {
+                return false;
+            }
+
+            position = line.find_first_not_of(' ', position);
+            if (position == std::string::npos)
+            {
+                return false;
+            }
+
+            if (field == 3)
+            {
+                entry.size = strtoull(line.c_str() + position, nullptr, 10);
+            }
+        }
+
+        entry.name = line.substr(position);
+        entry.isFolder = line[0] == 'd';
+        if (entry.isFolder)
+        {
+            entry.size = 0;
+        }
+    }
+
+    // Hide hidden file like the local file system
+    return !entry.name.empty() && entry.name[0] != '.';
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include <SDL2/SDL.h>
+
+#include "MountPoint.h"
+#include "../../tools/Socket.h"
+
+
+/**
+ * Browse a FTP server like a directory, paths are relative to the root given to the constructor.
+ * Logged in control connections are kept open and reused, so a listing or a transfer usually cost a single
+ * round trip before the data comes: the passive data connection request and the command using it are sent at once.
+ * Listings are cached for a while so going back up the tree does not ask the server again.
+ * Thread safe, each worker use its own control connection.
+ */
+class FtpMountPoint :
+public MountPoint
+{
+public:
+    FtpMountPoint(std::string name, std::string scheme, std::string host, uint16_t port, std::string root,
+        std::string user, std::string password);
+    virtual ~FtpMountPoint();
+
+    virtual void setup() override;
+    virtual void cleanup() override;
+    virtual void navigate(std::filesystem::path path, ItemListener itemListener) override;
+    virtual void getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener) override;
+
+private:
+    struct Connection
+    {
+        Socket control;
+        bool isReused;
+        // Learned from the FEAT reply, LIST is parsed otherwise
+        bool hasMlsd;
+    };
+
+    struct Entry
+    {
+        std::string name;
+        bool isFolder;
+        uintmax_t size;
+    };
+
+    struct Listing
+    {
+        std::vector<Entry> entries;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    std::string mHost;
+    uint16_t mPort;
+    std::string mRoot;
+    std::string mUser;
+    std::string mPassword;
+
+    // Guard everything below
+    SDL_mutex* mMutex;
+    std::vector<std::unique_ptr<Connection>> mIdleConnections;
+    // Remote path to its content
+    std::map<std::string, Listing> mListings;
+
+    FtpMountPoint(const FtpMountPoint& copy);
+
+    std::unique_ptr<Connection> acquireConnection();
+    void releaseConnection(std::unique_ptr<Connection> connection);
+    std::unique_ptr<Connection> connect();
+    // Return the code of the reply, multiline replies are read entirely
+    static int readReply(Socket& socket, std::string& message);
+    static int sendCommand(Socket& socket, const std::string& command, std::string& message);
+    // Take a connection and open a data connection listing or sending remotePath,
+    // return false with the reply if the server refused it, the connection can be released then
+    bool openTransfer(std::unique_ptr<Connection>& connection, bool isListing, const std::string& remotePath, Socket& data,
+        std::string& message);
+    bool requestTransfer(Connection& connection, bool isListing, const std::string& remotePath, Socket& data,
+        std::string& message);
+    // Read the reply ending a transfer and release the connection, it is dropped if it is not usable anymore
+    void closeTransfer(std::unique_ptr<Connection> connection, Socket& data, bool isComplete);
+    std::string getRemotePath(const std::filesystem::path& path);
+    static bool parseListLine(const std::string& line, bool isMlsd, Entry& entry);
+};
@@ -0,0 +1,720 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "HttpMountPoint.h"
+
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+#include <algorithm>
+#include <jansson.h>
+#include <fmt/format.h>
+
+#include "../../config.h"
+
+#define SOCKET_TIMEOUT_SECONDS 15       // Time without answer before a connection is considered lost
+#define MAX_IDLE_CONNECTIONS 6          // Kept alive connections kept for later, enough for a file and a listing at once
+#define FIRST_RANGE_SIZE 262144         // First bytes asked for a file, smaller files come in this single request
+#define PARALLEL_RANGE_SIZE 1048576     // Least bytes worth another connection when the rest of a file is downloaded
+#define MAX_PARALLEL_RANGES 4           // Connections downloading the rest of a file at once
+#define MAX_LISTING_SIZE 16777216       // Bigger directory pages are refused
+#define BODY_CHUNK_SIZE 16384           // Size of the read buffer for response bodies
+#define RANGE_POLL_MS 50                // Time between two checks that a file is still wanted while its ranges download
+
+
+HttpMountPoint::HttpMountPoint(std::string name, std::string scheme, std::string host, uint16_t port, std::string root) :
+MountPoint(name, scheme),
+mHost(host),
+mPort(port),
+mRoot(root),
+mMutex(SDL_CreateMutex()),
+mRangeThreadCount(0)
+{
+}
+
+HttpMountPoint::~HttpMountPoint()
+{
+    SDL_DestroyMutex(mMutex);
+}
+
+bool HttpMountPoint::parseUrl(const std::string& url, std::string& host, uint16_t& port, std::string& root)
+{
+    auto prefix = std::string("http://");
+    if (url.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+
+    auto pathStart = std::min(url.find('/', prefix.size()), url.size());
+    auto hostAndPort = url.substr(prefix.size(), pathStart - prefix.size());
+    auto colon = hostAndPort.rfind(':');
+    host = hostAndPort.substr(0, colon);
+    port = colon != std::string::npos ? (uint16_t) atoi(hostAndPort.c_str() + colon + 1) : 80;
+    root = pathStart < url.size() ? decodePath(url.substr(pathStart)) : "/";
+    return !host.empty() && port != 0;
+}
+
+void HttpMountPoint::setup()
+{
+    // Nothing is connected before the first use, the network may not even be there
+}
+
+void HttpMountPoint::cleanup()
+{
+    // Ranges of canceled reads stop at their next receive, or when the socket time out
+    while (mRangeThreadCount > 0)
+    {
+        SDL_Delay(10);
+    }
+
+    SDL_LockMutex(mMutex);
+    mIdleConnections.clear();
+    SDL_UnlockMutex(mMutex);
+}
+
+void HttpMountPoint::navigate(std::filesystem::path path, ItemListener itemListener)
+{
+    auto remotePath = getRemotePath(path);
+    if (remotePath.back() != '/')
+    {
+        remotePath += '/';
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    auto connection = std::unique_ptr<Connection>();
+    auto response = Response();
+    openRequest(connection, remotePath, 0, -1, response);
+    if (response.status != 200)
+    {
+        TRACE("{:s} answered {:d}.", remotePath, response.status);
+        readBody(std::move(connection), response, [](const uint8_t*, size_t) { return true; });
+        throw std::runtime_error("Failed to open the requested directory");
+    }
+
+    // Headers are the first bytes of the response
+    auto firstByteTime = std::chrono::steady_clock::now();
+    auto body = std::string();
+    readBody(
+        std::move(connection),
+        response,
+        [&body](const uint8_t* data, size_t size)
+        {
+            if (body.size() + size > MAX_LISTING_SIZE)
+            {
+                throw std::runtime_error("The directory listing is too big");
+            }
+
+            body.append((const char*) data, size);
+            return true;
+        });
+
+    auto endTime = std::chrono::steady_clock::now();
+    recordTransferTime(firstByteTime - startTime, endTime - startTime);
+    TRACE("Listed {:s}: {:d} KB in {:.1f} ms.", remotePath, body.size() / 1024,
+        std::chrono::duration<double, std::milli>(endTime - startTime).count());
+
+    if (response.contentType.find("json") != std::string::npos)
+    {
+        parseJsonListing(body, itemListener);
+    }
+    else
+    {
+        parseHtmlListing(body, itemListener);
+    }
+}
+
+void HttpMountPoint::getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener)
+{
+    auto remotePath = getRemotePath(path);
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Chunks are filled entirely like the ones read from the other mount points
+    auto chunkBuffer = std::vector<uint8_t>();
+    chunkBuffer.reserve(chunkBufferSize);
+    auto totalCount = (size_t) 0;
+    auto bodyListener = [&](const uint8_t* data, size_t size)
+    {
+        totalCount += size;
+        while (size > 0)
+        {
+            auto count = std::min(size, chunkBufferSize - chunkBuffer.size());
+            chunkBuffer.insert(chunkBuffer.end(), data, data + count);
+            data += count;
+            size -= count;
+            if (chunkBuffer.size() == chunkBufferSize)
+            {
+                if (!fileListener(chunkBuffer))
+                {
+                    return false; // Listener tells us to stop
+                }
+
+                chunkBuffer.clear();
+            }
+        }
+
+        return true;
+    };
+
+    // The first range tells the size of the file, a server ignoring ranges send the whole file
+    auto connection = std::unique_ptr<Connection>();
+    auto response = Response();
+    openRequest(connection, remotePath, 0, FIRST_RANGE_SIZE - 1, response);
+    if ((response.status != 200 && response.status != 206) || (response.status == 206 && response.rangeStart != 0))
+    {
+        TRACE("{:s} answered {:d}.", remotePath, response.status);
+        readBody(std::move(connection), response, [](const uint8_t*, size_t) { return true; });
+        throw std::runtime_error("Failed to open the requested file");
+    }
+
+    auto firstByteTime = std::chrono::steady_clock::now();
+    auto isPartial = response.status == 206
+        && (response.totalSize > FIRST_RANGE_SIZE || (response.totalSize < 0 && response.contentLength == FIRST_RANGE_SIZE));
+    auto isComplete = readBody(std::move(connection), response, bodyListener);
+    if (isComplete && isPartial)
+    {
+        isComplete = readRanges(remotePath, FIRST_RANGE_SIZE, response.totalSize - 1, bodyListener,
+            [&fileListener]() { return fileListener(std::vector<uint8_t>()); });
+    }
+
+    if (isComplete && !chunkBuffer.empty())
+    {
+        fileListener(chunkBuffer);
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    if (isComplete)
+    {
+        recordTransferTime(firstByteTime - startTime, endTime - startTime);
+    }
+
+    TRACE("Transfer of {:s} {:s}: {:d} KB in {:.1f} ms, first byte after {:.1f} ms.", remotePath,
+        isComplete ? "done" : "stopped", totalCount / 1024,
+        std::chrono::duration<double, std::milli>(endTime - startTime).count(),
+        std::chrono::duration<double, std::milli>(firstByteTime - startTime).count());
+}
+
+std::unique_ptr<HttpMountPoint::Connection> HttpMountPoint::acquireConnection()
+{
+    SDL_LockMutex(mMutex);
+    if (!mIdleConnections.empty())
+    {
+        auto connection = std::move(mIdleConnections.back());
+        mIdleConnections.pop_back();
+        SDL_UnlockMutex(mMutex);
+        return connection;
+    }
+    SDL_UnlockMutex(mMutex);
+
+    return connect();
+}
+
+void HttpMountPoint::releaseConnection(std::unique_ptr<Connection> connection)
+{
+    connection->isReused = true;
+
+    SDL_LockMutex(mMutex);
+    if (mIdleConnections.size() < MAX_IDLE_CONNECTIONS)
+    {
+        mIdleConnections.push_back(std::move(connection));
+    }
+    SDL_UnlockMutex(mMutex);
+}
+
+std::unique_ptr<HttpMountPoint::Connection> HttpMountPoint::connect()
+{
+    auto startTime = std::chrono::steady_clock::now();
+    auto connection = std::make_unique<Connection>();
+    connection->isReused = false;
+    connection->socket.connect(mHost, mPort, SOCKET_TIMEOUT_SECONDS);
+    recordConnectTime(std::chrono::steady_clock::now() - startTime);
+    return connection;
+}
+
+void HttpMountPoint::openRequest(std::unique_ptr<Connection>& connection, const std::string& remotePath, int64_t start,
+    int64_t end, Response& response)
+{
+    connection = acquireConnection();
+    try
+    {
+        sendRequest(*connection, remotePath, start, end, response);
+    }
+    catch(const std::exception& e)
+    {
+        // The server may have closed a connection left idle for too long, a new one get a second chance
+        if (!connection->isReused)
+        {
+            throw;
+        }
+
+        TRACE("Reused connection lost ({:s}), connecting again.", e.what());
+        connection = connect();
+        sendRequest(*connection, remotePath, start, end, response);
+    }
+}
+
+void HttpMountPoint::sendRequest(Connection& connection, const std::string& remotePath, int64_t start, int64_t end,
+    Response& response)
+{
+    auto request = fmt::format("GET {:s} HTTP/1.1\r\nHost: {:s}\r\nUser-Agent: OSP\r\nAccept-Encoding: identity\r\n",
+        remotePath, mPort == 80 ? mHost : fmt::format("{:s}:{:d}", mHost, mPort));
+
+    if (start > 0 || end >= 0)
+    {
+        request += fmt::format("Range: bytes={:d}-{:s}\r\n", start, end >= 0 ? std::to_string(end) : "");
+    }
+
+    request += "\r\n";
+    connection.socket.send(request);
+
+    // "HTTP/1.1 206 Partial Content"
+    auto statusLine = connection.socket.receiveLine();
+    auto space = statusLine.find(' ');
+    if (statusLine.compare(0, 5, "HTTP/") != 0 || space == std::string::npos)
+    {
+        throw std::runtime_error("Unexpected reply from the HTTP server");
+    }
+
+    response.status = atoi(statusLine.c_str() + space + 1);
+    response.contentType.clear();
+    response.contentLength = response.status == 204 || response.status == 304 ? 0 : -1;
+    response.totalSize = -1;
+    response.rangeStart = 0;
+    response.isChunked = false;
+    response.isKeepAlive = statusLine.compare(0, 8, "HTTP/1.1") == 0;
+
+    while (true)
+    {
+        auto line = connection.socket.receiveLine();
+        if (line.empty())
+        {
+            break;
+        }
+
+        auto colon = line.find(':');
+        if (colon == std::string::npos)
+        {
+            continue;
+        }
+
+        auto name = line.substr(0, colon);
+        auto value = line.substr(std::min(line.find_first_not_of(' ', colon + 1), line.size()));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        if (name == "content-length")
+        {
+            response.contentLength = strtoll(value.c_str(), nullptr, 10);
+        }
+        else if (name == "content-type")
+        {
+            response.contentType = value;
+        }
+        else if (name == "transfer-encoding")
+        {
+            response.isChunked = value.find("chunked") != std::string::npos;
+        }
+        else if (name == "connection")
+        {
+            response.isKeepAlive = value.find("close") == std::string::npos
+                && (response.isKeepAlive || value.find("keep-alive") != std::string::npos);
+        }
+        else if (name == "content-range")
+        {
+            // "bytes 0-262143/1048576", the size can be "*"
+            auto slash = value.find('/');
+            response.rangeStart = strtoll(value.c_str() + std::min(value.find_first_of("0123456789"), value.size()), nullptr, 10);
+            response.totalSize = slash != std::string::npos && isdigit(value[slash + 1]) ? strtoll(value.c_str() + slash + 1, nullptr, 10) : -1;
+        }
+    }
+}
+
+bool HttpMountPoint::readBody(std::unique_ptr<Connection> connection, const Response& response, BodyListener bodyListener)
+{
+    auto& socket = connection->socket;
+    auto readBuffer = std::vector<uint8_t>(BODY_CHUNK_SIZE);
+    auto readBytes = [&](uint64_t size)
+    {
+        while (size > 0)
+        {
+            auto count = socket.receive(readBuffer.data(), std::min(size, (uint64_t) readBuffer.size()));
+            if (count == 0)
+            {
+                throw std::runtime_error("Connection lost while receiving");
+            }
+
+            size -= count;
+            if (!bodyListener(readBuffer.data(), count))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    if (response.isChunked)
+    {
+        // Each chunk start with its size in hexadecimal, the last one is empty and may be followed by trailers
+        while (true)
+        {
+            auto chunkSize = strtoull(socket.receiveLine().c_str(), nullptr, 16);
+            if (chunkSize == 0)
+            {
+                while (!socket.receiveLine().empty());
+                break;
+            }
+
+            if (!readBytes(chunkSize))
+            {
+                return false;
+            }
+
+            socket.receiveLine();
+        }
+    }
+    else if (response.contentLength >= 0)
+    {
+        if (!readBytes(response.contentLength))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // The body end with the connection, which can not be reused
+        while (true)
+        {
+            auto count = socket.receive(readBuffer.data(), readBuffer.size());
+            if (count == 0)
+            {
+                return true;
+            }
+
+            if (!bodyListener(readBuffer.data(), count))
+            {
+                return false;
+            }
+        }
+    }
+
+    if (response.isKeepAlive)
+    {
+        releaseConnection(std::move(connection));
+    }
+
+    return true;
+}
+
+bool HttpMountPoint::readRanges(const std::string& remotePath, int64_t start, int64_t end, BodyListener bodyListener,
+    std::function<bool ()> isWanted)
+{
+    // Other connections download the following ranges in memory while this one is given as it comes
+    auto rangeCount = end < 0 ? 1 : (int) std::clamp((end + 1 - start) / PARALLEL_RANGE_SIZE, (int64_t) 1, (int64_t) MAX_PARALLEL_RANGES);
+    auto rangeSize = end < 0 ? 0 : (end + 1 - start + rangeCount - 1) / rangeCount;
+    auto stopped = std::make_shared<std::atomic<bool>>(false);
+    auto tasks = std::vector<std::shared_ptr<RangeTask>>(rangeCount);
+    auto threads = std::vector<SDL_Thread*>(rangeCount, nullptr);
+    for (auto i=0; i<rangeCount; ++i)
+    {
+        tasks[i] = std::shared_ptr<RangeTask>(
+            new RangeTask(),
+            [](RangeTask* task)
+            {
+                SDL_DestroySemaphore(task->finished);
+                delete task;
+            });
+
+        tasks[i]->mountPoint = this;
+        tasks[i]->remotePath = remotePath;
+        tasks[i]->start = start + i * rangeSize;
+        tasks[i]->end = end < 0 ? -1 : std::min(tasks[i]->start + rangeSize - 1, end);
+        tasks[i]->stopped = stopped;
+        tasks[i]->finished = SDL_CreateSemaphore(0);
+        if (i > 0)
+        {
+            // The thread own a reference, so the task outlive this function if it is left behind
+            auto* threadTask = new std::shared_ptr<RangeTask>(tasks[i]);
+            ++mRangeThreadCount;
+            threads[i] = SDL_CreateThread(rangeThreadFunc, "OSPHTTP", threadTask);
+            if (threads[i] == nullptr)
+            {
+                --mRangeThreadCount;
+                delete threadTask;
+            }
+        }
+    }
+
+    auto isComplete = true;
+    auto error = std::string();
+    try
+    {
+        auto connection = std::unique_ptr<Connection>();
+        auto response = Response();
+        openRequest(connection, remotePath, tasks[0]->start, tasks[0]->end, response);
+        if (response.status == 416 && end < 0)
+        {
+            // The file of unknown size ended with the previous range, there is no other range then
+            readBody(std::move(connection), response, [](const uint8_t*, size_t) { return true; });
+        }
+        else if (response.status != 206 || response.rangeStart != tasks[0]->start)
+        {
+            throw std::runtime_error("The HTTP server did not send the requested range");
+        }
+        else
+        {
+            isComplete = readBody(std::move(connection), response, bodyListener);
+        }
+    }
+    catch(const std::exception& e)
+    {
+        error = e.what();
+    }
+
+    for (auto i=1; i<rangeCount; ++i)
+    {
+        *stopped = *stopped || !isComplete || !error.empty();
+        if (threads[i] != nullptr)
+        {
+            // A canceled read does not wait for the rest of the file, it may be stuck on a slow server
+            while (!*stopped && SDL_SemWaitTimeout(tasks[i]->finished, RANGE_POLL_MS) != 0)
+            {
+                if (!isWanted())
+                {
+                    *stopped = true;
+                    isComplete = false;
+                }
+            }
+
+            if (*stopped)
+            {
+                // The thread stop at its next receive and release the task by itself
+                SDL_DetachThread(threads[i]);
+                continue;
+            }
+
+            SDL_WaitThread(threads[i], nullptr);
+        }
+        else if (!*stopped)
+        {
+            readRange(*tasks[i]);
+        }
+
+        if (*stopped)
+        {
+            continue;
+        }
+
+        if (!tasks[i]->error.empty() || (int64_t) tasks[i]->data.size() != tasks[i]->end + 1 - tasks[i]->start)
+        {
+            error = tasks[i]->error.empty() ? "The HTTP server sent an incomplete range" : tasks[i]->error;
+            continue;
+        }
+
+        isComplete = bodyListener(tasks[i]->data.data(), tasks[i]->data.size());
+        std::vector<uint8_t>().swap(tasks[i]->data);
+    }
+
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+
+    return isComplete;
+}
+
+void HttpMountPoint::readRange(RangeTask& task)
+{
+    try
+    {
+        auto connection = std::unique_ptr<Connection>();
+        auto response = Response();
+        openRequest(connection, task.remotePath, task.start, task.end, response);
+        if (response.status != 206 || response.rangeStart != task.start)
+        {
+            throw std::runtime_error("The HTTP server did not send the requested range");
+        }
+
+        task.data.reserve(task.end + 1 - task.start);
+        readBody(
+            std::move(connection),
+            response,
+            [&task](const uint8_t* data, size_t size)
+            {
+                task.data.insert(task.data.end(), data, data + size);
+                return !*task.stopped;
+            });
+    }
+    catch(const std::exception& e)
+    {
+        task.error = e.what();
+    }
+}
+
+int HttpMountPoint::rangeThreadFunc(void* task)
+{
+    auto* rangeTask = (std::shared_ptr<RangeTask>*) task;
+    auto* mountPoint = (*rangeTask)->mountPoint;
+    mountPoint->readRange(**rangeTask);
+    SDL_SemPost((*rangeTask)->finished);
+    delete rangeTask;
+
+    // The mount point may be deleted as soon as this is done
+    --mountPoint->mRangeThreadCount;
+    return 0;
+}
+
+std::string HttpMountPoint::getRemotePath(const std::filesystem::path& path)
+{
+    auto remotePath = std::filesystem::path(mRoot);
+    auto relativePath = path.lexically_relative(getScheme());
+    if (!relativePath.empty() && relativePath != ".")
+    {
+        remotePath /= relativePath;
+    }
+
+    return encodePath(remotePath.generic_string());
+}
+
+void HttpMountPoint::parseJsonListing(const std::string& body, ItemListener itemListener)
+{
+    json_error_t error;
+    auto* root = json_loadb(body.data(), body.size(), 0, &error);
+    if (!json_is_array(root))
+    {
+        json_decref(root);
+        throw std::runtime_error("Invalid JSON directory listing");
+    }
+
+    size_t index;
+    json_t* item;
+    json_array_foreach(root, index, item)
+    {
+        auto* name = json_object_get(item, "name");
+        auto* type = json_object_get(item, "type");
+        auto* size = json_object_get(item, "size");
+        if (!json_is_string(name) || !json_is_string(type))
+        {
+            continue;
+        }
+
+        // Hide hidden file like the local file system, links and such are left out
+        auto itemName = std::string(json_string_value(name));
+        auto itemType = std::string(json_string_value(type));
+        if (itemName.empty() || itemName[0] == '.' || (itemType != "file" && itemType != "directory"))
+        {
+            continue;
+        }
+
+        auto isFolder = itemType == "directory";
+        auto itemSize = !isFolder && json_is_integer(size) ? (uintmax_t) json_integer_value(size) : 0;
+        if (!itemListener(itemName, isFolder, itemSize))
+        {
+            break; // Listener tell us to stop
+        }
+    }
+
+    json_decref(root);
+}
+
+void HttpMountPoint::parseHtmlListing(const std::string& body, ItemListener itemListener)
+{
+    // Every relative link to a direct child is an entry, folders end with a slash
+    auto lowerBody = body;
+    std::transform(lowerBody.begin(), lowerBody.end(), lowerBody.begin(), ::tolower);
+    auto position = lowerBody.find("href=\"");
+    while (position != std::string::npos)
+    {
+        auto start = position + 6;
+        auto end = body.find('"', start);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+
+        auto link = body.substr(start, end - start);
+        position = lowerBody.find("href=\"", end);
+
+        // Sorting links, parent and absolute links are not entries
+        if (link.empty() || link[0] == '?' || link[0] == '#' || link[0] == '/' || link.find("://") != std::string::npos)
+        {
+            continue;
+        }
+
+        for (auto ampersand = link.find("&amp;"); ampersand != std::string::npos; ampersand = link.find("&amp;", ampersand + 1))
+        {
+            link.erase(ampersand + 1, 4);
+        }
+
+        if (link.compare(0, 2, "./") == 0)
+        {
+            link.erase(0, 2);
+        }
+
+        auto isFolder = !link.empty() && link.back() == '/';
+        if (isFolder)
+        {
+            link.pop_back();
+        }
+
+        auto name = decodePath(link);
+        if (name.empty() || name[0] == '.' || name.find('/') != std::string::npos || link.find('?') != std::string::npos)
+        {
+            continue;
+        }
+
+        if (!itemListener(name, isFolder, 0))
+        {
+            break; // Listener tell us to stop
+        }
+    }
+}
+
+std::string HttpMountPoint::encodePath(const std::string& path)
+{
+    auto encoded = std::string();
+    for (auto c : path)
+    {
+        if (isalnum((unsigned char) c) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~')
+        {
+            encoded += c;
+        }
+        else
+        {
+            encoded += fmt::format("%{:02X}", (uint8_t) c);
+        }
+    }
+
+    return encoded;
+}
+
+std::string HttpMountPoint::decodePath(const std::string& path)
+{
+    auto decoded = std::string();
+    for (auto i=(size_t) 0; i<path.size(); ++i)
+    {
+        if (path[i] == '%' && i + 2 < path.size() && isxdigit((unsigned char) path[i + 1]) && isxdigit((unsigned char) path[i + 2]))
+        {
+            decoded += (char) strtol(path.substr(i + 1, 2).c_str(), nullptr, 16);
+            i += 2;
+        }
+        else
+        {
+            decoded += path[i];
+        }
+    }
+
+    return decoded;
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <filesystem>
+
+#include <SDL2/SDL.h>
+
+#include "MountPoint.h"
+#include "../../tools/Socket.h"
+
+
+/**
+ * Browse a HTTP file index like a directory, paths are relative to the root given to the constructor.
+ * Directories are read from the page served for them, either an autoindex HTML page or a JSON listing like the one of
+ * nginx (an array of objects with name, type "file" or "directory" and size).
+ * Connections are kept alive and reused. Files are asked by ranges: the first one also tells the size, small files
+ * come in that single request, the rest of big files is downloaded by several connections at once.
+ * Thread safe, each worker use its own connections.
+ */
+class HttpMountPoint :
+public MountPoint
+{
+public:
+    HttpMountPoint(std::string name, std::string scheme, std::string host, uint16_t port, std::string root);
+    virtual ~HttpMountPoint();
+
+    // Split a "http://host[:port]/path" url, return false if it is not one
+    static bool parseUrl(const std::string& url, std::string& host, uint16_t& port, std::string& root);
+
+    virtual void setup() override;
+    virtual void cleanup() override;
+    virtual void navigate(std::filesystem::path path, ItemListener itemListener) override;
+    virtual void getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener) override;
+
+private:
+    // Return false to stop reading, the connection is not reused then
+    typedef std::function<bool (const uint8_t*, size_t)> BodyListener;
+
+    struct Connection
+    {
+        Socket socket;
+        bool isReused;
+    };
+
+    struct Response
+    {
+        int status;
+        std::string contentType;
+        // -1 when the body end with the connection
+        int64_t contentLength;
+        // Size of the whole file for a range, -1 if unknown
+        int64_t totalSize;
+        int64_t rangeStart;
+        bool isChunked;
+        bool isKeepAlive;
+    };
+
+    struct RangeTask
+    {
+        HttpMountPoint* mountPoint;
+        std::string remotePath;
+        int64_t start;
+        int64_t end;
+        std::vector<uint8_t> data;
+        std::string error;
+        // Shared by the ranges of a file, set when the file is not wanted anymore
+        std::shared_ptr<std::atomic<bool>> stopped;
+        // Posted when the download ended. A stopped range is not waited for, its thread release it.
+        SDL_sem* finished;
+    };
+
+    std::string mHost;
+    uint16_t mPort;
+    std::string mRoot;
+
+    // Guard mIdleConnections
+    SDL_mutex* mMutex;
+    std::vector<std::unique_ptr<Connection>> mIdleConnections;
+    // Range threads still running, cleanup() wait for the ones left behind by a stopped read
+    std::atomic<int> mRangeThreadCount;
+
+    HttpMountPoint(const HttpMountPoint& copy);
+
+    std::unique_ptr<Connection> acquireConnection();
+    void releaseConnection(std::unique_ptr<Connection> connection);
+    std::unique_ptr<Connection> connect();
+    // Take a connection, send the request and read the response headers, end < 0 ask for the whole file
+    void openRequest(std::unique_ptr<Connection>& connection, const std::string& remotePath, int64_t start, int64_t end,
+        Response& response);
+    void sendRequest(Connection& connection, const std::string& remotePath, int64_t start, int64_t end,
+        Response& response);
+    // Return true if the whole body was read, the connection is released if it can be reused
+    bool readBody(std::unique_ptr<Connection> connection, const Response& response, BodyListener bodyListener);
+    // Download from start to the end of the file, end is the last byte or -1 if the size is unknown.
+    // isWanted is polled while waiting for the other connections, they are stopped when it return false.
+    bool readRanges(const std::string& remotePath, int64_t start, int64_t end, BodyListener bodyListener,
+        std::function<bool ()> isWanted);
+    // Download a range into memory, on another thread or in place
+    void readRange(RangeTask& task);
+    static int rangeThreadFunc(void* task);
+    std::string getRemotePath(const std::filesystem::path& path);
+    static void parseJsonListing(const std::string& body, ItemListener itemListener);
+    static void parseHtmlListing(const std::string& body, ItemListener itemListener);
+    static std::string encodePath(const std::string& path);
+    static std::string decodePath(const std::string& path);
+};
@@ -19,6 +19,16 @@
 #include <filesystem>
 #include <fstream>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+#define DIRENT_BUFFER_SIZE 65536 // Size of the buffer receiving directory entries from getdents64
+
 
 LocalMountPoint::LocalMountPoint(std::string name, std::string root) :
 MountPoint(name, root)
@@ -39,6 +49,80 @@ void LocalMountPoint::cleanup()
 
 void LocalMountPoint::navigate(std::filesystem::path path, ItemListener itemListener)
 {
+#ifdef __linux__
+    // Entries come in big batches with their type, only regular files cost an extra statx for their size
+    auto directory = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (directory == -1)
+    {
+        throw std::runtime_error("Failed to open the requested directory");
+    }
+
+    // The listener may throw too, the directory is closed on every way out
+    try
+    {
+        auto buffer = std::vector<uint64_t>(DIRENT_BUFFER_SIZE / sizeof(uint64_t));
+        while (true)
+        {
+            auto readCount = syscall(SYS_getdents64, directory, buffer.data(), DIRENT_BUFFER_SIZE);
+            if (readCount < 0)
+            {
+                throw std::runtime_error("Failed to read the requested directory");
+            }
+
+            if (readCount == 0)
+            {
+                break;
+            }
+
+            for (auto offset=0L; offset<readCount;)
+            {
+                auto* entry = (struct dirent64*) ((uint8_t*) buffer.data() + offset);
+                offset += entry->d_reclen;
+
+                // Hide hidden file, maybe an user option
+                if (entry->d_name[0] == '.')
+                {
+                    continue;
+                }
+
+                auto isDirectory = entry->d_type == DT_DIR;
+                auto isFile = entry->d_type == DT_REG;
+                auto size = (uintmax_t) 0;
+                if (!isDirectory)
+                {
+                    // d_type does not tell where a link point to and some file systems leave it unknown
+                    struct statx fileStat;
+                    auto mask = isFile ? STATX_SIZE : STATX_TYPE | STATX_SIZE;
+                    if (statx(directory, entry->d_name, AT_STATX_DONT_SYNC, mask, &fileStat) != 0)
+                    {
+                        continue;
+                    }
+
+                    isDirectory = !isFile && S_ISDIR(fileStat.stx_mode);
+                    isFile = isFile || S_ISREG(fileStat.stx_mode);
+                    size = isFile ? fileStat.stx_size : 0;
+                }
+
+                if (isFile || isDirectory)
+                {
+                    auto doContinue = itemListener(entry->d_name, isDirectory, size);
+                    if (!doContinue)
+                    {
+                        close(directory);
+                        return; // Listener tell us to stop
+                    }
+                }
+            }
+        }
+    }
+    catch(...)
+    {
+        close(directory);
+        throw;
+    }
+
+    close(directory);
+#else
     if (!std::filesystem::exists(path) || !std::filesystem::is_directory(path))
     {
         throw std::runtime_error("Failed to open the requested directory");
@@ -63,6 +147,7 @@ void LocalMountPoint::navigate(std::filesystem::path path, ItemListener itemList
             }
         }
     }
+#endif
 }
 
 void LocalMountPoint::getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener)
@@ -99,3 +184,8 @@ void LocalMountPoint::getFile(std::filesystem::path path, size_t chunkBufferSize
     }
     ifs.close();
 }
+
+bool LocalMountPoint::mapFile(std::filesystem::path path, MappedFile& mappedFile)
+{
+    return mappedFile.open(path);
+}
@@ -33,6 +33,7 @@ public:
     virtual void cleanup() override;
     virtual void navigate(std::filesystem::path path, ItemListener itemListener) override;
     virtual void getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener) override;
+    virtual bool mapFile(std::filesystem::path path, MappedFile& mappedFile) override;
 
 private:
     std::string mDrive;
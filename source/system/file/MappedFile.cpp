@@ -0,0 +1,125 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MappedFile.h"
+
+#ifndef __SWITCH__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+MappedFile::MappedFile() :
+mMapping(nullptr),
+mMappingSize(0),
+mData(nullptr),
+mSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(std::filesystem::path path, Access access)
+{
+    return open(path, 0, 0, access);
+}
+
+bool MappedFile::open(std::filesystem::path path, uint64_t offset, size_t size, Access access)
+{
+    close();
+
+#ifdef __SWITCH__
+    // No mmap on the Switch
+    return false;
+#else
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    // A size of 0 map the whole file
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || offset >= (uint64_t) fileStat.st_size)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    size = size == 0 ? (size_t) (fileStat.st_size - offset) : size;
+    if (offset + size > (uint64_t) fileStat.st_size)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping has to start on a page
+    auto pageOffset = (size_t) (offset % sysconf(_SC_PAGESIZE));
+    auto mappingSize = size + pageOffset;
+    auto* mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, offset - pageOffset);
+    ::close(fd); // The mapping keep its own reference to the file
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (access == SEQUENTIAL)
+    {
+        madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+        madvise(mapping, mappingSize, MADV_WILLNEED);
+    }
+    else
+    {
+        madvise(mapping, mappingSize, MADV_RANDOM);
+    }
+
+    mMapping = mapping;
+    mMappingSize = mappingSize;
+    mData = (uint8_t*) mapping + pageOffset;
+    mSize = size;
+    return true;
+#endif
+}
+
+void MappedFile::close()
+{
+#ifndef __SWITCH__
+    if (mMapping != nullptr)
+    {
+        munmap(mMapping, mMappingSize);
+    }
+#endif
+
+    mMapping = nullptr;
+    mMappingSize = 0;
+    mData = nullptr;
+    mSize = 0;
+}
+
+const uint8_t* MappedFile::getData() const
+{
+    return mData;
+}
+
+size_t MappedFile::getSize() const
+{
+    return mSize;
+}
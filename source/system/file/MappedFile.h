@@ -0,0 +1,55 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+
+
+/**
+ * Read-only memory mapping of a whole file or a part of it, unmapped when destroyed.
+ * Not available on every platform, open() return false when the file cannot be mapped so the caller can read it instead.
+ */
+class MappedFile
+{
+public:
+    enum Access
+    {
+        SEQUENTIAL, // Read once from start to end, the kernel read ahead and drop pages behind
+        RANDOM      // Looked up here and there, only the pages touched are read
+    };
+
+    MappedFile();
+    virtual ~MappedFile();
+
+    bool open(std::filesystem::path path, Access access = SEQUENTIAL);
+    // Map size bytes from offset, the offset does not need to be aligned on a page
+    bool open(std::filesystem::path path, uint64_t offset, size_t size, Access access = SEQUENTIAL);
+    void close();
+
+    const uint8_t* getData() const;
+    size_t getSize() const;
+
+private:
+    void* mMapping;
+    size_t mMappingSize;
+    uint8_t* mData;
+    size_t mSize;
+
+    MappedFile(const MappedFile& copy);
+};
@@ -36,3 +36,34 @@ std::string MountPoint::getScheme()
 {
     return mScheme;
 }
+
+bool MountPoint::mapFile(std::filesystem::path path, MappedFile& mappedFile)
+{
+    return false;
+}
+
+void MountPoint::recordConnectTime(std::chrono::steady_clock::duration duration)
+{
+    mConnectTimes.record(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+void MountPoint::recordTransferTime(std::chrono::steady_clock::duration firstByte, std::chrono::steady_clock::duration total)
+{
+    mFirstByteTimes.record(std::chrono::duration_cast<std::chrono::microseconds>(firstByte).count());
+    mTransferTimes.record(std::chrono::duration_cast<std::chrono::microseconds>(total).count());
+}
+
+const Histogram& MountPoint::getConnectTimes()
+{
+    return mConnectTimes;
+}
+
+const Histogram& MountPoint::getFirstByteTimes()
+{
+    return mFirstByteTimes;
+}
+
+const Histogram& MountPoint::getTransferTimes()
+{
+    return mTransferTimes;
+}
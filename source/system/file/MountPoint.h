@@ -16,16 +16,21 @@
  */
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <functional>
 #include <filesystem>
 #include <vector>
 
+#include "MappedFile.h"
+#include "../../tools/Histogram.h"
+
 
 class MountPoint
 {
 public:
     // Return false from those function will stop the iteration where they are used.
+    // A FileListener may be given an empty chunk while a read wait, to ask if it should go on.
     typedef std::function<bool (std::string, bool, uintmax_t)> ItemListener;
     typedef std::function<bool (const std::vector<uint8_t>&)> FileListener;
 
@@ -39,10 +44,23 @@ public:
     virtual void cleanup() = 0;
     virtual void navigate(std::filesystem::path path, ItemListener itemListener) = 0;
     virtual void getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener) = 0;
+    // Map the file in memory instead of reading it chunk by chunk, return false if it is not possible (default)
+    virtual bool mapFile(std::filesystem::path path, MappedFile& mappedFile);
+
+    // Network cost measured by the remote mount points, in microseconds. Recording never lock nor allocate
+    // so any worker can do it. A transfer is a listing or a file, its first byte include the request round trip.
+    void recordConnectTime(std::chrono::steady_clock::duration duration);
+    void recordTransferTime(std::chrono::steady_clock::duration firstByte, std::chrono::steady_clock::duration total);
+    const Histogram& getConnectTimes();
+    const Histogram& getFirstByteTimes();
+    const Histogram& getTransferTimes();
 
 private:
     std::string mName;
     std::string mScheme;
+    Histogram mConnectTimes;
+    Histogram mFirstByteTimes;
+    Histogram mTransferTimes;
 
     MountPoint(const MountPoint& copy);
 };
@@ -0,0 +1,67 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <cstdint>
+
+#define PACK_MAGIC "OSPPACK"            // Null terminated, 8 bytes
+#define PACK_VERSION 1
+#define PACK_ENTRY_FOLDER 0x0001
+#define PACK_ROOT_ENTRY 0               // The root folder, it has no name
+#define PACK_DEFAULT_ALIGNMENT 512      // Payloads start on a sector, the packing tool can change it
+
+
+/**
+ * OSP pack, a whole library in one file so browsing slow storage cost one open instead of one per file.
+ * Little endian, laid out as the header, the entries, the names, the metadata then the aligned payloads.
+ * Everything before the payloads is the index, it is used in place when the pack is mapped in memory.
+ * Children of a folder are contiguous entries sorted by name (byte order), so a path is resolved with one
+ * binary search per element. Metadata is an optional blob of "key=value\n" text per file, empty when absent.
+ */
+struct PackHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t alignment;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t entriesOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t metadataOffset;
+    uint64_t metadataSize;
+};
+
+struct PackEntry
+{
+    // Offset from the start of the names
+    uint32_t nameOffset;
+    uint16_t nameLength;
+    uint16_t flags;
+    // Folders only, index of the first child entry
+    uint32_t firstChild;
+    uint32_t childCount;
+    // Files only, offset of the payload from the start of the pack
+    uint64_t offset;
+    uint64_t size;
+    // Offset from the start of the metadata
+    uint32_t metadataOffset;
+    uint32_t metadataLength;
+};
+
+static_assert(sizeof(PackHeader) == 64, "PackHeader is part of the file format");
+static_assert(sizeof(PackEntry) == 40, "PackEntry is part of the file format");
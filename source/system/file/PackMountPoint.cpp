@@ -0,0 +1,265 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PackMountPoint.h"
+
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#define MAP_MIN_SIZE 262144 // Smaller files are copied from the pack mapping, cheaper than a mapping of their own
+
+
+PackMountPoint::PackMountPoint(std::string name, std::string packPath) :
+MountPoint(name, packPath),
+mPackPath(packPath),
+mEntries(nullptr),
+mEntryCount(0),
+mNames(nullptr)
+{
+}
+
+PackMountPoint::~PackMountPoint()
+{
+}
+
+void PackMountPoint::setup()
+{
+    cleanup();
+
+    auto header = PackHeader();
+    auto packSize = (uint64_t) 0;
+    if (mMappedFile.open(mPackPath, MappedFile::RANDOM))
+    {
+        // The index is used where it is, only the pages the lookups touch are read
+        if (mMappedFile.getSize() < sizeof(PackHeader))
+        {
+            throw std::runtime_error("The pack is truncated");
+        }
+
+        packSize = mMappedFile.getSize();
+        memcpy(&header, mMappedFile.getData(), sizeof(PackHeader));
+        checkIndex(header, packSize, packSize);
+        mEntries = (const PackEntry*) (mMappedFile.getData() + header.entriesOffset);
+        mNames = (const char*) mMappedFile.getData() + header.namesOffset;
+    }
+    else
+    {
+        // Everything before the metadata is read at once
+        std::ifstream ifs(mPackPath, std::ios::in | std::ios::binary);
+        if (!ifs.good())
+        {
+            throw std::runtime_error("The pack is not readable");
+        }
+
+        ifs.seekg(0, std::ios::end);
+        packSize = (uint64_t) ifs.tellg();
+        ifs.seekg(0);
+        ifs.read((char*) &header, sizeof(PackHeader));
+        if ((size_t) ifs.gcount() != sizeof(PackHeader))
+        {
+            throw std::runtime_error("The pack is truncated");
+        }
+
+        // A sum that wrapped around end before the names and is refused by checkIndex()
+        auto indexSize = header.namesOffset + header.namesSize;
+        checkIndex(header, indexSize, packSize);
+        mIndex.resize(indexSize);
+        ifs.seekg(0);
+        ifs.read((char*) mIndex.data(), indexSize);
+        if ((uint64_t) ifs.gcount() != indexSize)
+        {
+            throw std::runtime_error("The pack is truncated");
+        }
+
+        mEntries = (const PackEntry*) (mIndex.data() + header.entriesOffset);
+        mNames = (const char*) mIndex.data() + header.namesOffset;
+    }
+
+    mEntryCount = header.entryCount;
+    for (auto i=(uint32_t) 0; i<mEntryCount; ++i)
+    {
+        // Checked once so the lookups can trust the index
+        auto& entry = mEntries[i];
+        auto isFolder = (entry.flags & PACK_ENTRY_FOLDER) != 0;
+        if ((uint64_t) entry.nameOffset + entry.nameLength > header.namesSize
+            || (isFolder && (uint64_t) entry.firstChild + entry.childCount > mEntryCount)
+            || (!isFolder && (entry.size > packSize || entry.offset > packSize - entry.size)))
+        {
+            cleanup();
+            throw std::runtime_error("The pack index is corrupted");
+        }
+    }
+
+    if (mEntryCount == 0 || (mEntries[PACK_ROOT_ENTRY].flags & PACK_ENTRY_FOLDER) == 0)
+    {
+        cleanup();
+        throw std::runtime_error("The pack index is corrupted");
+    }
+}
+
+void PackMountPoint::cleanup()
+{
+    mMappedFile.close();
+    mIndex.clear();
+    mIndex.shrink_to_fit();
+    mEntries = nullptr;
+    mEntryCount = 0;
+    mNames = nullptr;
+}
+
+void PackMountPoint::checkIndex(const PackHeader& header, uint64_t indexSize, uint64_t packSize)
+{
+    if (memcmp(header.magic, PACK_MAGIC, sizeof(header.magic)) != 0 || header.version != PACK_VERSION)
+    {
+        throw std::runtime_error("The file is not a supported OSP pack");
+    }
+
+    // The header is not trusted, the sizes are compared to what is left so nothing can wrap around
+    auto indexEnd = std::min(indexSize, packSize);
+    if (header.entriesOffset % alignof(PackEntry) != 0
+        || header.entriesOffset > header.namesOffset
+        || (uint64_t) header.entryCount * sizeof(PackEntry) > header.namesOffset - header.entriesOffset
+        || header.namesOffset > indexEnd
+        || header.namesSize > indexEnd - header.namesOffset)
+    {
+        throw std::runtime_error("The pack index is corrupted");
+    }
+}
+
+std::string_view PackMountPoint::getEntryName(const PackEntry& entry) const
+{
+    return std::string_view(mNames + entry.nameOffset, entry.nameLength);
+}
+
+const PackEntry* PackMountPoint::find(const std::filesystem::path& path) const
+{
+    if (mEntries == nullptr)
+    {
+        return nullptr;
+    }
+
+    auto* entry = &mEntries[PACK_ROOT_ENTRY];
+    for (auto& element : path)
+    {
+        auto name = element.string();
+        if (name.empty() || name == "." || name == "/")
+        {
+            continue;
+        }
+
+        if ((entry->flags & PACK_ENTRY_FOLDER) == 0)
+        {
+            return nullptr;
+        }
+
+        // Children are sorted by name
+        auto* first = &mEntries[entry->firstChild];
+        auto* last = first + entry->childCount;
+        auto* child = std::lower_bound(first, last, name,
+            [this](const PackEntry& child, const std::string& name) { return getEntryName(child) < name; });
+
+        if (child == last || getEntryName(*child) != name)
+        {
+            return nullptr;
+        }
+
+        entry = child;
+    }
+
+    return entry;
+}
+
+void PackMountPoint::navigate(std::filesystem::path path, ItemListener itemListener)
+{
+    auto* folder = find(path);
+    if (folder == nullptr || (folder->flags & PACK_ENTRY_FOLDER) == 0)
+    {
+        throw std::runtime_error("Failed to open the requested directory");
+    }
+
+    for (auto i=folder->firstChild; i<folder->firstChild + folder->childCount; ++i)
+    {
+        auto& entry = mEntries[i];
+        auto isFolder = (entry.flags & PACK_ENTRY_FOLDER) != 0;
+        auto doContinue = itemListener(std::string(getEntryName(entry)), isFolder, isFolder ? 0 : entry.size);
+        if (!doContinue)
+        {
+            return; // Listener tell us to stop
+        }
+    }
+}
+
+void PackMountPoint::getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener)
+{
+    auto* file = find(path);
+    if (file == nullptr || (file->flags & PACK_ENTRY_FOLDER) != 0)
+    {
+        throw std::runtime_error("Failed to open the requested file");
+    }
+
+    auto readBuffer = std::vector<uint8_t>(chunkBufferSize, 0);
+    if (mMappedFile.getData() != nullptr)
+    {
+        // Straight from the mapping
+        for (auto offset=(uint64_t) 0; offset<file->size; offset += chunkBufferSize)
+        {
+            auto count = (size_t) std::min((uint64_t) chunkBufferSize, file->size - offset);
+            readBuffer.assign(mMappedFile.getData() + file->offset + offset, mMappedFile.getData() + file->offset + offset + count);
+            if (!fileListener(readBuffer))
+            {
+                return; // Listener tells us to stop
+            }
+        }
+        return;
+    }
+
+    std::ifstream ifs(mPackPath, std::ios::in | std::ios::binary);
+    if (!ifs.good())
+    {
+        throw std::runtime_error("The pack is not readable");
+    }
+
+    ifs.seekg(file->offset);
+    for (auto offset=(uint64_t) 0; offset<file->size; offset += chunkBufferSize)
+    {
+        auto count = (size_t) std::min((uint64_t) chunkBufferSize, file->size - offset);
+        readBuffer.resize(count);
+        ifs.read((char*) readBuffer.data(), count);
+        if ((size_t) ifs.gcount() != count)
+        {
+            throw std::runtime_error("The pack is truncated");
+        }
+
+        if (!fileListener(readBuffer))
+        {
+            return; // Listener tells us to stop
+        }
+    }
+}
+
+bool PackMountPoint::mapFile(std::filesystem::path path, MappedFile& mappedFile)
+{
+    // Only worth it for big files when the pack itself could be mapped, each file get its own mapping so it can outlive the pack
+    auto* file = find(path);
+    if (mMappedFile.getData() == nullptr || file == nullptr || (file->flags & PACK_ENTRY_FOLDER) != 0 || file->size < MAP_MIN_SIZE)
+    {
+        return false;
+    }
+
+    return mappedFile.open(mPackPath, file->offset, file->size);
+}
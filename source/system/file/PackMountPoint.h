@@ -0,0 +1,62 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+#include "MountPoint.h"
+#include "MappedFile.h"
+#include "PackFormat.h"
+
+
+/**
+ * Browse an OSP pack (see PackFormat.h) like a directory, paths are relative to the pack root.
+ * The pack is mapped in memory by setup() when possible, the index is then used in place and files are
+ * mapped on their own. Otherwise the index is read once and files are read from the pack.
+ */
+class PackMountPoint :
+public MountPoint
+{
+public:
+    PackMountPoint(std::string name, std::string packPath);
+    virtual ~PackMountPoint();
+
+    virtual void setup() override;
+    virtual void cleanup() override;
+    virtual void navigate(std::filesystem::path path, ItemListener itemListener) override;
+    virtual void getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener) override;
+    virtual bool mapFile(std::filesystem::path path, MappedFile& mappedFile) override;
+
+private:
+    std::string mPackPath;
+    MappedFile mMappedFile;
+    // Copy of the index when the pack cannot be mapped
+    std::vector<uint8_t> mIndex;
+    const PackEntry* mEntries;
+    uint32_t mEntryCount;
+    const char* mNames;
+
+    PackMountPoint(const PackMountPoint& copy);
+
+    void checkIndex(const PackHeader& header, uint64_t indexSize, uint64_t packSize);
+    std::string_view getEntryName(const PackEntry& entry) const;
+    const PackEntry* find(const std::filesystem::path& path) const;
+};
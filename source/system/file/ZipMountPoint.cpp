@@ -0,0 +1,450 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ZipMountPoint.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <zlib.h>
+
+#define EOCD_SIGNATURE 0x06054b50           // End of central directory record
+#define EOCD_SIZE 22                        // Size of the end of central directory record without its comment
+#define EOCD_MAX_COMMENT 65535              // The record is somewhere in the last EOCD_SIZE + EOCD_MAX_COMMENT bytes
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50  // Zip64 end of central directory locator, right before the record
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_EOCD_SIGNATURE 0x06064b50     // Zip64 end of central directory record
+#define ZIP64_EOCD_SIZE 56
+#define ZIP64_EXTRA_ID 0x0001               // Extra field holding the 64 bits sizes and offset
+#define CENTRAL_HEADER_SIGNATURE 0x02014b50 // Central directory file header
+#define CENTRAL_HEADER_SIZE 46
+#define LOCAL_HEADER_SIGNATURE 0x04034b50   // Local file header
+#define LOCAL_HEADER_SIZE 30
+#define METHOD_STORED 0
+#define METHOD_DEFLATED 8
+#define FLAG_ENCRYPTED 0x0001
+
+
+static uint16_t read16(const uint8_t* data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t read32(const uint8_t* data)
+{
+    return read16(data) | ((uint32_t) read16(data + 2) << 16);
+}
+
+static uint64_t read64(const uint8_t* data)
+{
+    return read32(data) | ((uint64_t) read32(data + 4) << 32);
+}
+
+static void readAt(std::ifstream& ifs, uint64_t offset, uint8_t* data, size_t size)
+{
+    ifs.seekg(offset);
+    ifs.read((char*) data, size);
+    if ((size_t) ifs.gcount() != size)
+    {
+        throw std::runtime_error("The archive is truncated");
+    }
+}
+
+ZipMountPoint::ZipMountPoint(std::string name, std::string archivePath) :
+MountPoint(name, archivePath),
+mArchivePath(archivePath)
+{
+}
+
+ZipMountPoint::~ZipMountPoint()
+{
+}
+
+void ZipMountPoint::setup()
+{
+    std::ifstream ifs(mArchivePath, std::ios::in | std::ios::binary);
+    if (!ifs.good())
+    {
+        throw std::runtime_error("The archive is not readable");
+    }
+
+    readCentralDirectory(ifs);
+}
+
+void ZipMountPoint::cleanup()
+{
+    mEntries.clear();
+    mDirectories.clear();
+    mFiles.clear();
+}
+
+void ZipMountPoint::readCentralDirectory(std::ifstream& ifs)
+{
+    // Find the end of central directory record, it is followed by a comment of unknown size
+    ifs.seekg(0, std::ios::end);
+    auto archiveSize = (uint64_t) ifs.tellg();
+    if (archiveSize < EOCD_SIZE)
+    {
+        throw std::runtime_error("The archive is not a zip file");
+    }
+
+    auto tailSize = std::min(archiveSize, (uint64_t) EOCD_SIZE + EOCD_MAX_COMMENT);
+    auto tail = std::vector<uint8_t>(tailSize);
+    readAt(ifs, archiveSize - tailSize, tail.data(), tailSize);
+
+    auto eocd = (int64_t) tailSize - EOCD_SIZE;
+    while (eocd >= 0 && read32(&tail[eocd]) != EOCD_SIGNATURE)
+    {
+        --eocd;
+    }
+
+    if (eocd < 0)
+    {
+        throw std::runtime_error("The archive is not a zip file");
+    }
+
+    uint64_t entryCount = read16(&tail[eocd + 10]);
+    uint64_t directorySize = read32(&tail[eocd + 12]);
+    uint64_t directoryOffset = read32(&tail[eocd + 16]);
+    auto eocdOffset = archiveSize - tailSize + eocd;
+    if ((entryCount == 0xffff || directorySize == 0xffffffff || directoryOffset == 0xffffffff)
+        && eocdOffset >= ZIP64_LOCATOR_SIZE)
+    {
+        // Too big for the classic record, the real values are in the zip64 one
+        uint8_t locator[ZIP64_LOCATOR_SIZE];
+        readAt(ifs, eocdOffset - ZIP64_LOCATOR_SIZE, locator, ZIP64_LOCATOR_SIZE);
+        if (read32(locator) == ZIP64_LOCATOR_SIGNATURE)
+        {
+            uint8_t record[ZIP64_EOCD_SIZE];
+            readAt(ifs, read64(locator + 8), record, ZIP64_EOCD_SIZE);
+            if (read32(record) != ZIP64_EOCD_SIGNATURE)
+            {
+                throw std::runtime_error("The archive zip64 directory is corrupted");
+            }
+
+            entryCount = read64(record + 32);
+            directorySize = read64(record + 40);
+            directoryOffset = read64(record + 48);
+        }
+    }
+
+    if (directoryOffset + directorySize > archiveSize)
+    {
+        throw std::runtime_error("The archive directory is corrupted");
+    }
+
+    // Read the whole central directory at once and index it
+    auto directory = std::vector<uint8_t>(directorySize);
+    readAt(ifs, directoryOffset, directory.data(), directorySize);
+
+    mEntries.clear();
+    mDirectories.clear();
+    mFiles.clear();
+    mEntries.reserve(std::min(entryCount, directorySize / CENTRAL_HEADER_SIZE));
+    mDirectories[""];
+
+    for (auto offset=(size_t) 0; offset + CENTRAL_HEADER_SIZE <= directory.size();)
+    {
+        auto* header = &directory[offset];
+        if (read32(header) != CENTRAL_HEADER_SIGNATURE)
+        {
+            throw std::runtime_error("The archive directory is corrupted");
+        }
+
+        auto nameLength = read16(header + 28);
+        auto extraLength = read16(header + 30);
+        auto commentLength = read16(header + 32);
+        auto headerSize = (size_t) CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+        if (offset + headerSize > directory.size())
+        {
+            throw std::runtime_error("The archive directory is corrupted");
+        }
+        offset += headerSize;
+
+        auto entry =
+        (Entry) {
+            .name = "",
+            .isFolder = false,
+            .method = read16(header + 10),
+            .crc = read32(header + 16),
+            .size = read32(header + 24),
+            .compressedSize = read32(header + 20),
+            .localHeaderOffset = read32(header + 42)
+        };
+
+        // Values too big for 32 bits are in the zip64 extra field, in this order
+        auto* extra = header + CENTRAL_HEADER_SIZE + nameLength;
+        for (auto extraOffset=0; extraOffset + 4 <= extraLength;)
+        {
+            auto id = read16(extra + extraOffset);
+            auto size = read16(extra + extraOffset + 2);
+            auto* value = extra + extraOffset + 4;
+            auto* valueEnd = value + std::min(size, (uint16_t) (extraLength - extraOffset - 4));
+            extraOffset += 4 + size;
+            if (id != ZIP64_EXTRA_ID)
+            {
+                continue;
+            }
+
+            for (auto* field : { &entry.size, &entry.compressedSize, &entry.localHeaderOffset })
+            {
+                if (*field == 0xffffffff && value + 8 <= valueEnd)
+                {
+                    *field = read64(value);
+                    value += 8;
+                }
+            }
+        }
+
+        auto path = std::string((const char*) header + CENTRAL_HEADER_SIZE, nameLength);
+        std::replace(path.begin(), path.end(), '\\', '/');
+        if ((read16(header + 8) & FLAG_ENCRYPTED) != 0 || (entry.method != METHOD_STORED && entry.method != METHOD_DEFLATED))
+        {
+            // Nothing we can read
+            continue;
+        }
+
+        addEntry(path, entry);
+    }
+}
+
+void ZipMountPoint::addEntry(const std::string& path, Entry entry)
+{
+    // Split the member path, hidden and unsafe elements drop the whole entry like the local mount point does
+    auto elements = std::vector<std::string>();
+    for (auto start=(size_t) 0; start < path.size();)
+    {
+        auto end = path.find('/', start);
+        end = end == std::string::npos ? path.size() : end;
+        if (end > start)
+        {
+            auto element = path.substr(start, end - start);
+            if (element[0] == '.' || element == "__MACOSX")
+            {
+                return;
+            }
+
+            elements.push_back(element);
+        }
+        start = end + 1;
+    }
+
+    if (elements.empty())
+    {
+        return;
+    }
+
+    auto parent = std::string();
+    for (auto i=0; i<(int) elements.size() - 1; ++i)
+    {
+        parent += (parent.empty() ? "" : "/") + elements[i];
+        addDirectory(parent);
+    }
+
+    auto key = parent + (parent.empty() ? "" : "/") + elements.back();
+    if (path.back() == '/')
+    {
+        // Folders may be listed or not, they are created on the way anyway
+        addDirectory(key);
+        return;
+    }
+
+    if (mFiles.count(key) > 0)
+    {
+        // The last one wins like when extracting
+        mEntries[mFiles[key]] = entry;
+        mEntries[mFiles[key]].name = elements.back();
+        return;
+    }
+
+    entry.name = elements.back();
+    mFiles[key] = mEntries.size();
+    mDirectories[parent].push_back(mEntries.size());
+    mEntries.push_back(entry);
+}
+
+void ZipMountPoint::addDirectory(const std::string& path)
+{
+    if (mDirectories.count(path) > 0)
+    {
+        return;
+    }
+
+    auto slash = path.rfind('/');
+    auto parent = slash == std::string::npos ? std::string() : path.substr(0, slash);
+    mDirectories[path];
+    mDirectories[parent].push_back(mEntries.size());
+    mEntries.push_back(
+    (Entry) {
+        .name = slash == std::string::npos ? path : path.substr(slash + 1),
+        .isFolder = true,
+        .method = METHOD_STORED,
+        .crc = 0,
+        .size = 0,
+        .compressedSize = 0,
+        .localHeaderOffset = 0
+    });
+}
+
+std::string ZipMountPoint::getKey(const std::filesystem::path& path)
+{
+    auto key = std::string();
+    for (auto& element : path)
+    {
+        auto name = element.string();
+        if (name.empty() || name == "." || name == "/")
+        {
+            continue;
+        }
+
+        key += (key.empty() ? "" : "/") + name;
+    }
+
+    return key;
+}
+
+void ZipMountPoint::navigate(std::filesystem::path path, ItemListener itemListener)
+{
+    auto directory = mDirectories.find(getKey(path));
+    if (directory == mDirectories.end())
+    {
+        throw std::runtime_error("Failed to open the requested directory");
+    }
+
+    for (auto index : directory->second)
+    {
+        auto& entry = mEntries[index];
+        auto doContinue = itemListener(entry.name, entry.isFolder, entry.size);
+        if (!doContinue)
+        {
+            return; // Listener tell us to stop
+        }
+    }
+}
+
+void ZipMountPoint::getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener)
+{
+    auto file = mFiles.find(getKey(path));
+    if (file == mFiles.end())
+    {
+        throw std::runtime_error("Failed to open the requested file");
+    }
+
+    std::ifstream ifs(mArchivePath, std::ios::in | std::ios::binary);
+    if (!ifs.good())
+    {
+        throw std::runtime_error("The archive is not readable");
+    }
+
+    // The local header may have another extra field than the central one
+    auto& entry = mEntries[file->second];
+    uint8_t localHeader[LOCAL_HEADER_SIZE];
+    readAt(ifs, entry.localHeaderOffset, localHeader, LOCAL_HEADER_SIZE);
+    if (read32(localHeader) != LOCAL_HEADER_SIGNATURE)
+    {
+        throw std::runtime_error("The archive member is corrupted");
+    }
+    ifs.seekg(entry.localHeaderOffset + LOCAL_HEADER_SIZE + read16(localHeader + 26) + read16(localHeader + 28));
+
+    auto inputBuffer = std::vector<uint8_t>(chunkBufferSize);
+    auto outputBuffer = std::vector<uint8_t>(chunkBufferSize);
+    auto remaining = entry.compressedSize;
+    auto crc = crc32(0L, Z_NULL, 0);
+
+    if (entry.method == METHOD_STORED)
+    {
+        while (remaining > 0)
+        {
+            auto readCount = (size_t) std::min(remaining, (uint64_t) chunkBufferSize);
+            ifs.read((char*) outputBuffer.data(), readCount);
+            if ((size_t) ifs.gcount() != readCount)
+            {
+                throw std::runtime_error("The archive is truncated");
+            }
+
+            remaining -= readCount;
+            outputBuffer.resize(readCount);
+            crc = crc32(crc, outputBuffer.data(), readCount);
+            if (!fileListener(outputBuffer))
+            {
+                return; // Listener tells us to stop
+            }
+        }
+    }
+    else
+    {
+        // Raw deflate stream, no zlib header
+        z_stream stream = {};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        {
+            throw std::runtime_error("Failed to initialize the decompressor");
+        }
+
+        auto status = Z_OK;
+        while (status != Z_STREAM_END)
+        {
+            // Once the input is consumed zlib may still hold output, keep calling it until it stops progressing
+            if (stream.avail_in == 0 && remaining > 0)
+            {
+                auto readCount = (size_t) std::min(remaining, (uint64_t) chunkBufferSize);
+                ifs.read((char*) inputBuffer.data(), readCount);
+                if ((size_t) ifs.gcount() != readCount)
+                {
+                    inflateEnd(&stream);
+                    throw std::runtime_error("The archive is truncated");
+                }
+
+                remaining -= readCount;
+                stream.next_in = inputBuffer.data();
+                stream.avail_in = readCount;
+            }
+
+            outputBuffer.resize(chunkBufferSize);
+            stream.next_out = outputBuffer.data();
+            stream.avail_out = chunkBufferSize;
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status == Z_BUF_ERROR)
+            {
+                // No progress with a whole output buffer free, the input ended before the stream
+                inflateEnd(&stream);
+                throw std::runtime_error("The archive member is truncated");
+            }
+            else if (status != Z_OK && status != Z_STREAM_END)
+            {
+                inflateEnd(&stream);
+                throw std::runtime_error("The archive member is corrupted");
+            }
+
+            auto outputCount = chunkBufferSize - stream.avail_out;
+            if (outputCount > 0)
+            {
+                outputBuffer.resize(outputCount);
+                crc = crc32(crc, outputBuffer.data(), outputCount);
+                if (!fileListener(outputBuffer))
+                {
+                    inflateEnd(&stream);
+                    return; // Listener tells us to stop
+                }
+            }
+        }
+        inflateEnd(&stream);
+    }
+
+    if (crc != entry.crc)
+    {
+        throw std::runtime_error("The archive member is corrupted");
+    }
+}
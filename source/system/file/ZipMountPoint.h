@@ -0,0 +1,71 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+
+#include "MountPoint.h"
+
+
+/**
+ * Browse a zip archive stored on the local file system like a directory, paths are relative to the archive root.
+ * The central directory is read once by setup() into an index, navigate() never read the archive again and
+ * getFile() inflate a single member chunk by chunk. Stored and deflated members are supported, zip64 too.
+ * Each call open its own stream, so several workers can read from the same archive at once.
+ */
+class ZipMountPoint :
+public MountPoint
+{
+public:
+    ZipMountPoint(std::string name, std::string archivePath);
+    virtual ~ZipMountPoint();
+
+    virtual void setup() override;
+    virtual void cleanup() override;
+    virtual void navigate(std::filesystem::path path, ItemListener itemListener) override;
+    virtual void getFile(std::filesystem::path path, size_t chunkBufferSize, FileListener fileListener) override;
+
+private:
+    struct Entry
+    {
+        std::string name;
+        bool isFolder;
+        uint16_t method;
+        uint32_t crc;
+        uint64_t size;
+        uint64_t compressedSize;
+        uint64_t localHeaderOffset;
+    };
+
+    std::string mArchivePath;
+    std::vector<Entry> mEntries;
+    // Directory path without trailing slash, "" for the root, to the entries it contains
+    std::unordered_map<std::string, std::vector<uint32_t>> mDirectories;
+    std::unordered_map<std::string, uint32_t> mFiles;
+
+    ZipMountPoint(const ZipMountPoint& copy);
+
+    void readCentralDirectory(std::ifstream& ifs);
+    void addEntry(const std::string& path, Entry entry);
+    void addDirectory(const std::string& path);
+    static std::string getKey(const std::filesystem::path& path);
+};
@@ -18,14 +18,18 @@
 
 #include <stdexcept>
 
+std::atomic<uint32_t> Config::sVersion(0);
+
 
 Config::Config() :
-mSetting(nullptr)
+mSetting(nullptr),
+mVersioned(false)
 {
 }
 
 Config::Config(libconfig::Setting* setting) :
-mSetting(setting)
+mSetting(setting),
+mVersioned(false)
 {
 }
 
@@ -40,12 +44,12 @@ Config Config::getGroupOrCreate(std::string key)
         throw std::runtime_error("Invalid Config object");
     }
 
-    if (!mSetting->exists(key))
-    {
-        return Config(&mSetting->add(key, libconfig::Setting::Type::TypeGroup));
-    }
+    auto group = !mSetting->exists(key)
+        ? Config(&mSetting->add(key, libconfig::Setting::Type::TypeGroup))
+        : Config(&mSetting->lookup(key));
 
-    return Config(&mSetting->lookup(key));
+    group.mVersioned = mVersioned;
+    return group;
 }
 
 int Config::get(std::string key, int defaultValue) const {
@@ -103,6 +107,10 @@ void Config::set(std::string key, int value) const {
 
     auto& setting = mSetting->lookup(key);
     setting = value;
+    if (mVersioned)
+    {
+        ++sVersion;
+    }
 }
 
 void Config::set(std::string key, bool value) const {
@@ -118,6 +126,10 @@ void Config::set(std::string key, bool value) const {
 
     auto& setting = mSetting->lookup(key);
     setting = value;
+    if (mVersioned)
+    {
+        ++sVersion;
+    }
 }
 
 void Config::set(std::string key, std::string value) const {
@@ -133,6 +145,15 @@ void Config::set(std::string key, std::string value) const {
 
     auto& setting = mSetting->lookup(key);
     setting = value;
+    if (mVersioned)
+    {
+        ++sVersion;
+    }
+}
+
+uint32_t Config::getVersion()
+{
+    return sVersion.load();
 }
 
 ConfigFile::ConfigFile()
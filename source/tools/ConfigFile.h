@@ -17,6 +17,8 @@
 #pragma once
 
 #include <string>
+#include <atomic>
+#include <cstdint>
 #include <libconfig.h++>
 
 
@@ -34,11 +36,18 @@ public:
     void set(std::string key, bool value) const;
     void set(std::string key, std::string value) const;
 
+    // Bumped by set() on the plugin settings only, tell if the way files are rendered changed since a value was read
+    static uint32_t getVersion();
+
 private:
     friend class ConfigFile;
     friend class Plugin;
 
+    static std::atomic<uint32_t> sVersion;
+
     libconfig::Setting* mSetting;
+    // Set by Plugin on its own group, inherited by the groups inside
+    bool mVersioned;
 
     Config();
     Config(libconfig::Setting* setting);
@@ -0,0 +1,119 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Histogram.h"
+
+#include <algorithm>
+
+
+Histogram::Histogram()
+{
+    reset();
+}
+
+Histogram::~Histogram()
+{
+}
+
+void Histogram::record(uint64_t value)
+{
+    // Index of the highest bit set, plus one
+    auto bucket = 0;
+    for (auto remaining = value; remaining != 0 && bucket < BUCKET_COUNT - 1; remaining >>= 1)
+    {
+        ++bucket;
+    }
+
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(value, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+
+    auto max = mMax.load(std::memory_order_relaxed);
+    while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Histogram::reset()
+{
+    for (auto& bucket : mBuckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+
+    mCount.store(0, std::memory_order_relaxed);
+    mSum.store(0, std::memory_order_relaxed);
+    mMax.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getCount() const
+{
+    return mCount.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getSum() const
+{
+    return mSum.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getMax() const
+{
+    return mMax.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getMean() const
+{
+    auto count = getCount();
+    return count > 0 ? getSum() / count : 0;
+}
+
+uint64_t Histogram::getBucketCount(int bucket) const
+{
+    return mBuckets[bucket].load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::getPercentile(double percentile) const
+{
+    // Sum the buckets instead of using mCount, they may not agree while something is recorded
+    auto count = (uint64_t) 0;
+    for (auto& bucket : mBuckets)
+    {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    auto wanted = (uint64_t) (count * percentile / 100.0);
+    auto seen = (uint64_t) 0;
+    for (auto i=0; i<BUCKET_COUNT; ++i)
+    {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen > wanted)
+        {
+            return std::min(getBucketLimit(i), getMax());
+        }
+    }
+
+    return getMax();
+}
+
+uint64_t Histogram::getBucketLimit(int bucket)
+{
+    return bucket == 0 ? 0 : ((uint64_t) 1 << bucket) - 1;
+}
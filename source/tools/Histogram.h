@@ -0,0 +1,56 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free histogram with power of two buckets, bucket 0 count the zeros and bucket n the values in [2^(n-1), 2^n[.
+ * record() can be called from any thread, including the audio one: it never allocate nor lock.
+ * Readers get a consistent enough view for statistics, not an exact snapshot.
+ */
+class Histogram
+{
+public:
+    static const int BUCKET_COUNT = 40;
+
+    Histogram();
+    virtual ~Histogram();
+
+    void record(uint64_t value);
+    // Values recorded at the same time may be partially lost
+    void reset();
+
+    uint64_t getCount() const;
+    uint64_t getSum() const;
+    uint64_t getMax() const;
+    uint64_t getMean() const;
+    uint64_t getBucketCount(int bucket) const;
+    // Upper limit of the bucket containing the given percentile (0-100)
+    uint64_t getPercentile(double percentile) const;
+
+    static uint64_t getBucketLimit(int bucket);
+
+private:
+    std::atomic<uint64_t> mBuckets[BUCKET_COUNT];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMax;
+
+    Histogram(const Histogram& copy);
+};
@@ -0,0 +1,164 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+/**
+ * Single producer / single consumer lock-free ring buffer.
+ * Only one thread may call write() and discard() and only one (other) thread may call read().
+ * Indexes are never wrapped, only masked when accessing the storage, so capacity must be a power of two.
+ */
+template<typename T>
+class RingBuffer
+{
+public:
+    RingBuffer();
+    virtual ~RingBuffer();
+
+    // Not thread safe, call it before any producer or consumer is running
+    void resize(size_t minimumCapacity);
+
+    size_t getCapacity() const;
+    size_t getReadAvailable() const;
+    size_t getWriteAvailable() const;
+
+    // Total count of elements read or written since the last resize()
+    size_t getReadPosition() const;
+    size_t getWritePosition() const;
+
+    // Producer side
+    size_t write(const T* data, size_t count);
+    void discard();
+
+    // Consumer side
+    size_t read(T* data, size_t count);
+
+private:
+    std::vector<T> mBuffer;
+    size_t mMask;
+
+    // Everything before mDiscardIndex is considered consumed, even if the consumer did not read it yet
+    std::atomic<size_t> mReadIndex;
+    std::atomic<size_t> mWriteIndex;
+    std::atomic<size_t> mDiscardIndex;
+
+    RingBuffer(const RingBuffer& copy);
+};
+
+template<typename T>
+RingBuffer<T>::RingBuffer() :
+mMask(0),
+mReadIndex(0),
+mWriteIndex(0),
+mDiscardIndex(0)
+{
+}
+
+template<typename T>
+RingBuffer<T>::~RingBuffer()
+{
+}
+
+template<typename T>
+void RingBuffer<T>::resize(size_t minimumCapacity)
+{
+    auto capacity = (size_t) 1;
+    while (capacity < minimumCapacity)
+    {
+        capacity <<= 1;
+    }
+
+    mBuffer.assign(capacity, T());
+    mMask = capacity - 1;
+    mReadIndex = 0;
+    mWriteIndex = 0;
+    mDiscardIndex = 0;
+}
+
+template<typename T>
+size_t RingBuffer<T>::getCapacity() const
+{
+    return mBuffer.size();
+}
+
+template<typename T>
+size_t RingBuffer<T>::getReadAvailable() const
+{
+    auto readIndex = std::max(mReadIndex.load(std::memory_order_acquire), mDiscardIndex.load(std::memory_order_acquire));
+    return mWriteIndex.load(std::memory_order_acquire) - readIndex;
+}
+
+template<typename T>
+size_t RingBuffer<T>::getWriteAvailable() const
+{
+    auto readIndex = std::max(mReadIndex.load(std::memory_order_acquire), mDiscardIndex.load(std::memory_order_relaxed));
+    return mBuffer.size() - (mWriteIndex.load(std::memory_order_relaxed) - readIndex);
+}
+
+template<typename T>
+size_t RingBuffer<T>::getReadPosition() const
+{
+    return std::max(mReadIndex.load(std::memory_order_acquire), mDiscardIndex.load(std::memory_order_acquire));
+}
+
+template<typename T>
+size_t RingBuffer<T>::getWritePosition() const
+{
+    return mWriteIndex.load(std::memory_order_acquire);
+}
+
+template<typename T>
+size_t RingBuffer<T>::write(const T* data, size_t count)
+{
+    count = std::min(count, getWriteAvailable());
+    auto writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+    auto offset = writeIndex & mMask;
+    auto firstPart = std::min(count, mBuffer.size() - offset);
+
+    memcpy(&mBuffer[offset], data, firstPart * sizeof(T));
+    memcpy(&mBuffer[0], data + firstPart, (count - firstPart) * sizeof(T));
+
+    mWriteIndex.store(writeIndex + count, std::memory_order_release);
+    return count;
+}
+
+template<typename T>
+void RingBuffer<T>::discard()
+{
+    // The consumer will skip everything written so far on its next read
+    mDiscardIndex.store(mWriteIndex.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+template<typename T>
+size_t RingBuffer<T>::read(T* data, size_t count)
+{
+    auto readIndex = std::max(mReadIndex.load(std::memory_order_relaxed), mDiscardIndex.load(std::memory_order_acquire));
+    count = std::min(count, mWriteIndex.load(std::memory_order_acquire) - readIndex);
+    auto offset = readIndex & mMask;
+    auto firstPart = std::min(count, mBuffer.size() - offset);
+
+    memcpy(data, &mBuffer[offset], firstPart * sizeof(T));
+    memcpy(data + firstPart, &mBuffer[0], (count - firstPart) * sizeof(T));
+
+    mReadIndex.store(readIndex + count, std::memory_order_release);
+    return count;
+}
@@ -0,0 +1,207 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Socket.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <fmt/format.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define RECEIVE_CHUNK_SIZE 4096 // Bytes read at once by receiveLine()
+#define MAX_LINE_LENGTH 65536   // A longer line means the other end is not talking the expected protocol
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+
+Socket::Socket() :
+mSocket(-1)
+{
+}
+
+Socket::~Socket()
+{
+    close();
+}
+
+void Socket::connect(const std::string& host, uint16_t port, int timeoutSeconds)
+{
+    close();
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* addresses = nullptr;
+    auto service = std::to_string(port);
+    if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0 || addresses == nullptr)
+    {
+        throw std::runtime_error(fmt::format("Unable to resolve {:s}", host));
+    }
+
+    for (auto* address = addresses; address != nullptr && mSocket == -1; address = address->ai_next)
+    {
+        mSocket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (mSocket == -1)
+        {
+            continue;
+        }
+
+        // Connect without blocking so an unreachable host only cost the timeout
+        auto flags = fcntl(mSocket, F_GETFL, 0);
+        fcntl(mSocket, F_SETFL, flags | O_NONBLOCK);
+        auto result = ::connect(mSocket, address->ai_addr, address->ai_addrlen);
+        if (result != 0 && errno == EINPROGRESS)
+        {
+            struct pollfd pollFd = { .fd = mSocket, .events = POLLOUT, .revents = 0 };
+            auto error = 0;
+            auto errorSize = (socklen_t) sizeof(error);
+            if (poll(&pollFd, 1, timeoutSeconds * 1000) == 1
+                && getsockopt(mSocket, SOL_SOCKET, SO_ERROR, &error, &errorSize) == 0 && error == 0)
+            {
+                result = 0;
+            }
+        }
+
+        if (result != 0)
+        {
+            ::close(mSocket);
+            mSocket = -1;
+            continue;
+        }
+
+        fcntl(mSocket, F_SETFL, flags);
+    }
+    freeaddrinfo(addresses);
+
+    if (mSocket == -1)
+    {
+        throw std::runtime_error(fmt::format("Unable to connect to {:s}:{:d}", host, port));
+    }
+
+    // Small commands are sent right away
+    struct timeval timeout = { .tv_sec = timeoutSeconds, .tv_usec = 0 };
+    auto noDelay = 1;
+    setsockopt(mSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(mSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(mSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+}
+
+void Socket::close()
+{
+    if (mSocket != -1)
+    {
+        ::close(mSocket);
+        mSocket = -1;
+    }
+
+    mPending.clear();
+}
+
+bool Socket::isConnected() const
+{
+    return mSocket != -1;
+}
+
+std::string Socket::getPeerAddress() const
+{
+    struct sockaddr_in address;
+    auto addressSize = (socklen_t) sizeof(address);
+    char buffer[INET_ADDRSTRLEN];
+    if (getpeername(mSocket, (struct sockaddr*) &address, &addressSize) != 0
+        || inet_ntop(AF_INET, &address.sin_addr, buffer, sizeof(buffer)) == nullptr)
+    {
+        throw std::runtime_error("Unable to get the peer address");
+    }
+
+    return buffer;
+}
+
+void Socket::send(const std::string& data)
+{
+    auto sent = (size_t) 0;
+    while (sent < data.size())
+    {
+        auto count = ::send(mSocket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0)
+        {
+            throw std::runtime_error("Connection lost while sending");
+        }
+
+        sent += count;
+    }
+}
+
+size_t Socket::receive(uint8_t* data, size_t size)
+{
+    // Bytes read ahead by receiveLine() come first
+    if (!mPending.empty())
+    {
+        auto count = std::min(size, mPending.size());
+        memcpy(data, mPending.data(), count);
+        mPending.erase(0, count);
+        return count;
+    }
+
+    auto count = recv(mSocket, data, size, 0);
+    if (count < 0)
+    {
+        throw std::runtime_error("Connection lost while receiving");
+    }
+
+    return count;
+}
+
+std::string Socket::receiveLine()
+{
+    auto end = mPending.find('\n');
+    while (end == std::string::npos)
+    {
+        if (mPending.size() > MAX_LINE_LENGTH)
+        {
+            throw std::runtime_error("Received line is too long");
+        }
+
+        char buffer[RECEIVE_CHUNK_SIZE];
+        auto count = recv(mSocket, buffer, sizeof(buffer), 0);
+        if (count <= 0)
+        {
+            throw std::runtime_error("Connection lost while receiving");
+        }
+
+        auto searchFrom = mPending.size();
+        mPending.append(buffer, count);
+        end = mPending.find('\n', searchFrom);
+    }
+
+    auto line = mPending.substr(0, end > 0 && mPending[end - 1] == '\r' ? end - 1 : end);
+    mPending.erase(0, end + 1);
+    return line;
+}
@@ -0,0 +1,52 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+
+/**
+ * Blocking TCP client socket with timeouts, enough for the network mount points.
+ * Every failure throw a std::runtime_error, the socket is closed by the destructor.
+ */
+class Socket
+{
+public:
+    Socket();
+    virtual ~Socket();
+
+    void connect(const std::string& host, uint16_t port, int timeoutSeconds);
+    void close();
+    bool isConnected() const;
+    // Numeric address of the other end, used to reach passive FTP data ports behind NAT
+    std::string getPeerAddress() const;
+
+    void send(const std::string& data);
+    // Return 0 once the other end closed the connection
+    size_t receive(uint8_t* data, size_t size);
+    // Line without its CRLF, throw if the connection is closed before a full line came
+    std::string receiveLine();
+
+private:
+    int mSocket;
+    // What receiveLine() read past the end of the line
+    std::string mPending;
+
+    Socket(const Socket& copy);
+};
@@ -0,0 +1,195 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+#define MAX_RELEASED_WORKERS 4      // Threads still stuck in a canceled task, no more replacement past that
+
+
+WorkerPool::WorkerPool() :
+mMutex(SDL_CreateMutex()),
+mTaskQueued(SDL_CreateCond()),
+mIsRunning(false)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    cleanup();
+    SDL_DestroyCond(mTaskQueued);
+    SDL_DestroyMutex(mMutex);
+}
+
+void WorkerPool::setup(int interactiveThreads, int backgroundThreads)
+{
+    mIsRunning = true;
+    for (auto i=0; i<interactiveThreads + backgroundThreads; ++i)
+    {
+        startWorker(i < interactiveThreads ? INTERACTIVE : BACKGROUND);
+    }
+}
+
+void WorkerPool::cleanup()
+{
+    SDL_LockMutex(mMutex);
+    mIsRunning = false;
+    for (auto& queue : mQueues)
+    {
+        queue.clear();
+    }
+
+    for (auto& worker : mWorkers)
+    {
+        if (worker->task != nullptr)
+        {
+            *worker->task = true;
+        }
+    }
+    SDL_CondBroadcast(mTaskQueued);
+    SDL_UnlockMutex(mMutex);
+
+    for (auto& worker : mWorkers)
+    {
+        SDL_WaitThread(worker->thread, nullptr);
+    }
+    mWorkers.clear();
+}
+
+WorkerPool::CancelToken WorkerPool::push(Lane lane, Task task)
+{
+    auto token = std::make_shared<std::atomic<bool>>(false);
+
+    SDL_LockMutex(mMutex);
+    mQueues[lane].push_back({ .task = task, .token = token });
+    SDL_CondBroadcast(mTaskQueued);
+    SDL_UnlockMutex(mMutex);
+
+    return token;
+}
+
+void WorkerPool::cancel(const CancelToken& token)
+{
+    SDL_LockMutex(mMutex);
+    *token = true;
+    for (auto& queue : mQueues)
+    {
+        queue.erase(std::remove_if(queue.begin(), queue.end(),
+            [&token](const QueuedTask& queuedTask) { return queuedTask.token == token; }), queue.end());
+    }
+
+    // Released workers that came back are only waiting to be joined, they set finished just before returning
+    for (auto& worker : mWorkers)
+    {
+        if (worker->finished)
+        {
+            SDL_WaitThread(worker->thread, nullptr);
+        }
+    }
+    mWorkers.erase(std::remove_if(mWorkers.begin(), mWorkers.end(),
+        [](const std::unique_ptr<Worker>& worker) { return worker->finished; }), mWorkers.end());
+
+    // A task may not check its token for a while, blocked on slow media or a dead connection.
+    // Its lane get a new thread right away and the stuck one exit when the task finally return.
+    auto releasedCount = (int) std::count_if(mWorkers.begin(), mWorkers.end(),
+        [](const std::unique_ptr<Worker>& worker) { return worker->released; });
+    for (size_t i=0; i<mWorkers.size() && releasedCount < MAX_RELEASED_WORKERS; ++i)
+    {
+        auto* worker = mWorkers[i].get();
+        if (worker->task == token && !worker->released)
+        {
+            worker->released = true;
+            releasedCount++;
+            startWorker(worker->lane);
+        }
+    }
+    SDL_UnlockMutex(mMutex);
+}
+
+void WorkerPool::startWorker(Lane lane)
+{
+    mWorkers.push_back(std::make_unique<Worker>(Worker
+    {
+        .pool = this,
+        .lane = lane,
+        .thread = nullptr,
+        .task = nullptr,
+        .released = false,
+        .finished = false
+    }));
+
+    mWorkers.back()->thread = SDL_CreateThread(workerThreadFunc, lane == INTERACTIVE ? "OSPIO" : "OSPIOBG", mWorkers.back().get());
+    if (mWorkers.back()->thread == nullptr)
+    {
+        mWorkers.pop_back();
+    }
+}
+
+int WorkerPool::workerThreadFunc(void* worker)
+{
+    // Reading files should not steal time from the audio
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+    auto* self = (Worker*) worker;
+    auto* pool = self->pool;
+
+    SDL_LockMutex(pool->mMutex);
+    while (pool->mIsRunning)
+    {
+        auto& interactiveQueue = pool->mQueues[INTERACTIVE];
+        auto& backgroundQueue = pool->mQueues[BACKGROUND];
+        auto* queue = (std::deque<QueuedTask>*) nullptr;
+        if (self->lane == BACKGROUND && !backgroundQueue.empty())
+        {
+            queue = &backgroundQueue;
+        }
+        else if (!interactiveQueue.empty())
+        {
+            queue = &interactiveQueue;
+        }
+
+        if (queue == nullptr)
+        {
+            SDL_CondWait(pool->mTaskQueued, pool->mMutex);
+            continue;
+        }
+
+        auto queuedTask = queue->front();
+        queue->pop_front();
+        if (*queuedTask.token)
+        {
+            continue;
+        }
+
+        self->task = queuedTask.token;
+        SDL_UnlockMutex(pool->mMutex);
+
+        queuedTask.task(*queuedTask.token);
+
+        SDL_LockMutex(pool->mMutex);
+        self->task.reset();
+        if (self->released)
+        {
+            // Another thread took our place while the task was stuck
+            break;
+        }
+    }
+    self->finished = true;
+    SDL_UnlockMutex(pool->mMutex);
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include <SDL2/SDL.h>
+
+
+/**
+ * Persistent threads running tasks from two lanes. Interactive threads only take interactive tasks so a slow
+ * background task can never delay what the user asked for, background threads take both, background ones first.
+ * Each task get a cancellation token it should check between two steps of its work. Tasks must not throw.
+ * A task canceled while stuck in a blocking call give its place to a new thread, so it never hold up the tasks after it.
+ */
+class WorkerPool
+{
+public:
+    enum Lane
+    {
+        INTERACTIVE,
+        BACKGROUND,
+        LANE_COUNT
+    };
+
+    // Store true to cancel the task, a task canceled before it started is never run
+    typedef std::shared_ptr<std::atomic<bool>> CancelToken;
+    typedef std::function<void (const std::atomic<bool>& canceled)> Task;
+
+    WorkerPool();
+    virtual ~WorkerPool();
+
+    void setup(int interactiveThreads, int backgroundThreads);
+    // Cancel every task and wait for the threads to exit
+    void cleanup();
+
+    CancelToken push(Lane lane, Task task);
+    // Never block, a running task stop whenever it checks its token, a queued one is dropped
+    void cancel(const CancelToken& token);
+
+private:
+    struct QueuedTask
+    {
+        Task task;
+        CancelToken token;
+    };
+
+    struct Worker
+    {
+        WorkerPool* pool;
+        Lane lane;
+        SDL_Thread* thread;
+        // Token of the task being run if any. A released worker was replaced while running a canceled task,
+        // it exit once the task return and is finished when the thread is about to end.
+        CancelToken task;
+        bool released;
+        bool finished;
+    };
+
+    SDL_mutex* mMutex;
+    SDL_cond* mTaskQueued;
+    std::deque<QueuedTask> mQueues[LANE_COUNT];
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    bool mIsRunning;
+
+    WorkerPool(const WorkerPool& copy);
+
+    void startWorker(Lane lane);
+
+    static int workerThreadFunc(void* worker);
+};
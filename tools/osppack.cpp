@@ -0,0 +1,199 @@
+/*
+ * This file is part of OSP (https://github.com/notnotme/osp).
+ * Copyright (c) 2020 Romain Graillot
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * Host tool building an OSP pack from a directory, see source/system/file/PackFormat.h.
+ * Usage: osppack <directory> <output.osp> [alignment]
+ */
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+
+#include "../source/system/file/PackFormat.h"
+
+#define COPY_BUFFER_SIZE 1048576 // Size of the buffer used to copy the files in the pack
+
+
+struct Node
+{
+    std::filesystem::path source;
+    std::string name;
+    bool isFolder;
+    uint64_t size;
+};
+
+static uint64_t align(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static std::vector<Node> listFolder(const std::filesystem::path& path)
+{
+    // Same rules as the local mount point, hidden files are skipped
+    auto nodes = std::vector<Node>();
+    for (auto& item : std::filesystem::directory_iterator(path))
+    {
+        auto name = item.path().filename().string();
+        if (name[0] == '.' || (!item.is_directory() && !item.is_regular_file()))
+        {
+            continue;
+        }
+
+        if (name.size() > UINT16_MAX)
+        {
+            throw std::runtime_error("Name too long: " + item.path().string());
+        }
+
+        nodes.push_back({ .source = item.path(), .name = name, .isFolder = item.is_directory(), .size = item.is_directory() ? 0 : item.file_size() });
+    }
+
+    // Byte order, the mount point use a binary search
+    std::sort(nodes.begin(), nodes.end(), [](const Node& a, const Node& b) { return a.name < b.name; });
+    return nodes;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <directory> <output.osp> [alignment]" << std::endl;
+        return 1;
+    }
+
+    auto alignment = argc > 3 ? std::stoul(argv[3]) : (unsigned long) PACK_DEFAULT_ALIGNMENT;
+    if (alignment == 0 || alignment > UINT32_MAX)
+    {
+        std::cerr << "Invalid alignment" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        // Folders are expanded breadth first so the children of each one are contiguous
+        auto nodes = std::vector<Node>({{ .source = argv[1], .name = "", .isFolder = true, .size = 0 }});
+        auto entries = std::vector<PackEntry>(1, PackEntry());
+        auto names = std::string();
+        auto folders = std::deque<uint32_t>({ PACK_ROOT_ENTRY });
+        while (!folders.empty())
+        {
+            auto folder = folders.front();
+            folders.pop_front();
+
+            auto children = listFolder(nodes[folder].source);
+            entries[folder].flags = PACK_ENTRY_FOLDER;
+            entries[folder].firstChild = entries.size();
+            entries[folder].childCount = children.size();
+            for (auto& child : children)
+            {
+                if (child.isFolder)
+                {
+                    folders.push_back(entries.size());
+                }
+
+                auto entry = PackEntry();
+                entry.nameOffset = names.size();
+                entry.nameLength = child.name.size();
+                entry.size = child.size;
+                entries.push_back(entry);
+                nodes.push_back(child);
+                names += child.name;
+            }
+
+            if (entries.size() > UINT32_MAX || names.size() > UINT32_MAX)
+            {
+                throw std::runtime_error("Too many files");
+            }
+        }
+
+        // Index first, then the payloads in the order of the entries
+        auto header = PackHeader();
+        memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+        header.version = PACK_VERSION;
+        header.alignment = alignment;
+        header.entryCount = entries.size();
+        header.entriesOffset = sizeof(PackHeader);
+        header.namesOffset = header.entriesOffset + entries.size() * sizeof(PackEntry);
+        header.namesSize = names.size();
+        header.metadataOffset = header.namesOffset + header.namesSize;
+        header.metadataSize = 0;
+
+        auto offset = header.metadataOffset + header.metadataSize;
+        for (auto& entry : entries)
+        {
+            if ((entry.flags & PACK_ENTRY_FOLDER) == 0)
+            {
+                offset = align(offset, alignment);
+                entry.offset = offset;
+                offset += entry.size;
+            }
+        }
+
+        std::ofstream ofs(argv[2], std::ios::out | std::ios::binary | std::ios::trunc);
+        ofs.write((const char*) &header, sizeof(PackHeader));
+        ofs.write((const char*) entries.data(), entries.size() * sizeof(PackEntry));
+        ofs.write(names.data(), names.size());
+
+        auto copyBuffer = std::vector<char>(COPY_BUFFER_SIZE);
+        auto fileCount = 0;
+        for (auto i=(size_t) 0; i<entries.size(); ++i)
+        {
+            auto& entry = entries[i];
+            if ((entry.flags & PACK_ENTRY_FOLDER) != 0)
+            {
+                continue;
+            }
+
+            auto padding = std::vector<char>(entry.offset - (uint64_t) ofs.tellp(), 0);
+            ofs.write(padding.data(), padding.size());
+
+            // The size was taken while listing, the file must not change meanwhile
+            std::ifstream ifs(nodes[i].source, std::ios::in | std::ios::binary);
+            auto remaining = entry.size;
+            while (remaining > 0 && ifs.good())
+            {
+                ifs.read(copyBuffer.data(), std::min(remaining, (uint64_t) copyBuffer.size()));
+                ofs.write(copyBuffer.data(), ifs.gcount());
+                remaining -= ifs.gcount();
+            }
+
+            if (remaining != 0)
+            {
+                throw std::runtime_error("Failed to read " + nodes[i].source.string());
+            }
+            fileCount++;
+        }
+
+        if (!ofs.good())
+        {
+            throw std::runtime_error("Failed to write " + std::string(argv[2]));
+        }
+
+        std::cout << fileCount << " file(s) and " << entries.size() - fileCount << " folder(s) packed, "
+            << (uint64_t) ofs.tellp() << " bytes" << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}